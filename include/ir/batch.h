@@ -0,0 +1,92 @@
+/**
+ * @file   batch.h
+ * @author Dennis Sitelew
+ * @date   Dec. 19, 2021
+ */
+#ifndef INCLUDE_IR_BATCH_H
+#define INCLUDE_IR_BATCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ir {
+
+/**
+ * Batch of IR commands, sent as a JSON array to POST /batch:
+ *
+ *    [{"code": 529287, "repeat": 2, "delay_ms": 100},
+ *     {"code": "0x81387"},
+ *     {"remote": "tv", "key": "power"},
+ *     {"raw": [9000, 4500, 562, 562, 562], "frequency": 38000}]
+ *
+ * Each command has exactly one of: a NECx code, a remote key (see lirc_db) or raw timings (alternating mark and
+ * space durations in µs, starting with a mark). It is sent repeat times, and followed by a delay before the next
+ * command.
+ */
+class batch {
+public:
+   static constexpr std::size_t max_commands = 64;
+   static constexpr std::size_t max_timings = 512;
+   static constexpr std::uint32_t max_timing_us = 1000000;
+   static constexpr unsigned max_repeat = 20;
+   static constexpr std::chrono::milliseconds max_delay{10000};
+
+   struct command {
+      std::optional<std::uint32_t> code{};
+      std::string_view remote{};
+      std::string_view key{};
+
+      //! Raw timings: a range of the timings array
+      std::size_t timings_offset{0};
+      std::size_t timings_count{0};
+      double frequency_hz{38000};
+
+      unsigned repeat{1};
+      std::chrono::milliseconds delay{0}; //!< Pause after the command
+   };
+
+   enum class status : std::uint8_t {
+      ok,
+      unknown_key, //!< Remote key is not in the database
+      failed,      //!< Error sending the command
+      too_long,    //!< Raw wave needs more DMA control blocks than pigpio has
+   };
+
+   struct result {
+      status state{status::ok};
+      std::chrono::microseconds duration{0};
+   };
+
+   struct parse_error {
+      const char *error;
+      std::size_t offset;
+   };
+
+public:
+   /**
+    * Parse the batch in place: names are views into the body, which has to outlive the commands.
+    * The containers are cleared first, their capacity is reused.
+    */
+   static std::optional<parse_error> parse(std::span<char> body,
+                                           std::vector<command> &commands,
+                                           std::vector<std::uint32_t> &timings);
+
+   //! @return Number of transmissions of the batch, its weight in the transmit queue
+   static unsigned cost(std::span<const command> commands);
+
+   //! {"results":[{"status":"ok","duration_us":123},...],"duration_us":456}
+   static void write_results(std::string &out, std::span<const result> results, std::chrono::microseconds total);
+
+   //! {"error":"...","offset":12}
+   static void write_error(std::string &out, const parse_error &error);
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_BATCH_H */
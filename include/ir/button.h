@@ -6,31 +6,85 @@
 #ifndef INCLUDE_IR_BUTTON_H
 #define INCLUDE_IR_BUTTON_H
 
-#include <chrono>
+#include <ir/gesture.h>
+#include <ir/spsc_ring.h>
+
+#include <atomic>
+#include <cstdint>
 #include <functional>
 
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
 namespace ir {
 
+/**
+ * Push button on a GPIO pin.
+ *
+ * The pigpio alert thread only records the edge into a lock-free ring and rings an eventfd doorbell, everything else
+ * (debouncing, gesture detection and the callback itself) happens on the io_context the button was created with.
+ * This keeps the alert thread free for the other GPIO alerts.
+ *
+ * Debouncing is based on the pigpio tick of each edge, so the event loop latency doesn't affect it. The detection
+ * itself is done by the gesture_detector, the button only feeds it the edges and wakes it up at its deadlines.
+ */
 class button {
 public:
-   using callback_t = std::function<void()>;
-   using time_point_t = std::chrono::steady_clock::time_point;
-   using duration_t = std::chrono::milliseconds;
+   using gesture = ir::gesture;
+   using callback_t = std::function<void(gesture)>;
+
+   struct config : gesture_detector::config {
+      //! Optional pigpio glitch filter: level has to stay steady this long (µs) before an edge is reported, 0 - off
+      unsigned glitch_filter_us{0};
+   };
 
 public:
-   button(int pin, callback_t cb, duration_t debounce_interval = duration_t(50));
+   button(boost::asio::io_context &io, int pin, callback_t cb);
+   button(boost::asio::io_context &io, int pin, callback_t cb, config cfg);
    ~button();
 
+   button(const button &) = delete;
+   button &operator=(const button &) = delete;
+
+   //! Number of edges dropped because the event loop didn't keep up
+   [[nodiscard]] std::uint64_t dropped_edges() const { return dropped_edges_.load(std::memory_order_relaxed); }
+
+private:
+   struct edge {
+      int level;
+      std::uint32_t tick;
+   };
+
 private:
    void handler(int gpio, int level, uint32_t tick);
 
+   void wait_for_edges();
+   void process_edge(const edge &e);
+   void settle();
+   void wait_for_deadline();
+
 private:
    const int pin_number_;
-   const callback_t callback_;
-   const duration_t debounce_interval_;
+   const config config_;
+
+   //! Alert thread -> event loop
+   spsc_ring<edge, 64> edges_{};
+   std::atomic<std::uint64_t> dropped_edges_{0};
+
+   //! Doorbell, signalled by the alert thread after each recorded edge
+   int event_fd_;
+   boost::asio::posix::stream_descriptor doorbell_;
+   std::uint64_t doorbell_value_{0};
+
+   //! Debounced state and the gestures
+   gesture_detector detector_;
+
+   //! Re-reads the pin once the debounce interval is over, in case if the final edge was swallowed as a bounce
+   boost::asio::steady_timer settle_timer_;
 
-   bool first_press_{true};
-   time_point_t last_press_time_{};
+   //! Wakes the detector up at its deadline
+   boost::asio::steady_timer deadline_timer_;
 };
 
 } // namespace ir
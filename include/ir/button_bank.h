@@ -0,0 +1,92 @@
+/**
+ * @file   button_bank.h
+ * @author Dennis Sitelew
+ * @date   Dec. 11, 2021
+ */
+#ifndef INCLUDE_IR_BUTTON_BANK_H
+#define INCLUDE_IR_BUTTON_BANK_H
+
+#include <ir/spsc_ring.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace ir {
+
+/**
+ * A panel of push buttons on GPIO pins 0-31.
+ *
+ * All the pins share the same alert function, which samples the whole bank with a single gpioRead_Bits_0_31 call and
+ * passes the sample on to the io_context. The work done on the alert thread doesn't depend on the number of buttons.
+ * The event loop debounces the bank as a bitmask, based on the pigpio ticks of the samples.
+ *
+ * Buttons are active low (pins are pulled up), the callback is invoked with the pin number on each press.
+ */
+class button_bank {
+public:
+   using callback_t = std::function<void(int pin)>;
+   using duration_t = std::chrono::milliseconds;
+
+public:
+   button_bank(boost::asio::io_context &io,
+               const std::vector<int> &pins,
+               callback_t cb,
+               duration_t debounce_interval = duration_t{50});
+   ~button_bank();
+
+   button_bank(const button_bank &) = delete;
+   button_bank &operator=(const button_bank &) = delete;
+
+   //! Number of samples dropped because the event loop didn't keep up
+   [[nodiscard]] std::uint64_t dropped_samples() const { return dropped_samples_.load(std::memory_order_relaxed); }
+
+private:
+   struct sample {
+      std::uint32_t levels;
+      std::uint32_t tick;
+   };
+
+private:
+   void handler(int level, std::uint32_t tick);
+
+   void wait_for_samples();
+   void process_sample(const sample &s);
+   void settle();
+
+private:
+   const std::uint32_t mask_;
+   const callback_t callback_;
+   const duration_t debounce_interval_;
+
+   //! Alert thread -> event loop
+   spsc_ring<sample, 128> samples_{};
+   std::atomic<std::uint64_t> dropped_samples_{0};
+
+   //! Last sample pushed into the ring, only accessed from the alert thread
+   std::uint32_t last_levels_;
+
+   //! Doorbell, signalled by the alert thread after each recorded sample
+   int event_fd_;
+   boost::asio::posix::stream_descriptor doorbell_;
+   std::uint64_t doorbell_value_{0};
+
+   //! Debounced state
+   std::uint32_t levels_;
+   std::uint32_t changed_once_{0}; //!< Pins with a valid last_change_tick_ entry
+   std::array<std::uint32_t, 32> last_change_tick_{};
+
+   //! Re-reads the bank once the debounce interval is over, in case if the final edge was swallowed as a bounce
+   boost::asio::steady_timer settle_timer_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_BUTTON_BANK_H */
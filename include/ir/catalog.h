@@ -0,0 +1,51 @@
+/**
+ * @file   catalog.h
+ * @author Dennis Sitelew
+ * @date   Dec. 17, 2021
+ */
+#ifndef INCLUDE_IR_CATALOG_H
+#define INCLUDE_IR_CATALOG_H
+
+#include <ir/util.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ir {
+
+/**
+ * List of the known IR codes, encoded and uploaded at startup.
+ *
+ * Text file, one entry per line: device name, key name and code (decimal or 0x-prefixed hexadecimal), separated by
+ * whitespace. Empty lines and lines starting with '#' are ignored.
+ *
+ *    # device  key        code
+ *    tv        power      0x81387
+ *    tv        volume_up  0x8138F
+ */
+class catalog {
+public:
+   struct entry {
+      std::string device;
+      std::string key;
+      std::uint32_t code;
+   };
+
+public:
+   //! Read the catalog file. Invalid lines are skipped with a warning.
+   static result_t<catalog> load(const std::string &path);
+
+public:
+   [[nodiscard]] const std::vector<entry> &entries() const { return entries_; }
+
+   //! @return Distinct codes, in the order of their first appearance
+   [[nodiscard]] std::vector<std::uint32_t> codes() const;
+
+private:
+   std::vector<entry> entries_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_CATALOG_H */
@@ -0,0 +1,53 @@
+/**
+ * @file   client_key.h
+ * @author Dennis Sitelew
+ * @date   Dec. 26, 2021
+ */
+#ifndef INCLUDE_IR_CLIENT_KEY_H
+#define INCLUDE_IR_CLIENT_KEY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <boost/asio/ip/address.hpp>
+
+namespace ir {
+
+/**
+ * Client address as a fixed-size key for the per-client tables.
+ * IPv4 addresses are stored IPv4-mapped, so a client has the same key over either protocol.
+ */
+struct client_key {
+   std::array<std::uint8_t, 16> bytes{};
+
+   //! Clients that are not on the network: buttons, the lircd and shared-memory sockets
+   static client_key local() { return {}; }
+
+   static client_key from(const boost::asio::ip::address &address) {
+      const auto v6 = address.is_v4()
+                         ? boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, address.to_v4())
+                         : address.to_v6();
+      client_key result;
+      const auto bytes = v6.to_bytes();
+      std::memcpy(result.bytes.data(), bytes.data(), result.bytes.size());
+      return result;
+   }
+
+   bool operator==(const client_key &other) const = default;
+};
+
+struct client_key_hash {
+   std::size_t operator()(const client_key &k) const noexcept {
+      std::uint64_t lo = 0, hi = 0;
+      std::memcpy(&lo, k.bytes.data(), sizeof(lo));
+      std::memcpy(&hi, k.bytes.data() + sizeof(lo), sizeof(hi));
+      // The interesting bits of an IPv4-mapped address are all in the upper half
+      return static_cast<std::size_t>((hi ^ (lo * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL);
+   }
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_CLIENT_KEY_H */
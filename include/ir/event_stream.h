@@ -0,0 +1,112 @@
+/**
+ * @file   event_stream.h
+ * @author Dennis Sitelew
+ * @date   Dec. 24, 2021
+ */
+#ifndef INCLUDE_IR_EVENT_STREAM_H
+#define INCLUDE_IR_EVENT_STREAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace ir {
+
+/**
+ * Ring of pre-formatted server-sent event records, shared by all the GET /events subscribers.
+ *
+ * Each record is formatted once by the single producer (the transmit strand) and written to the subscriber sockets
+ * straight from its slot. Slots are guarded by sequence numbers (seqlock): even while stable, odd while being
+ * overwritten. A subscriber checks the sequence of the oldest slot it was writing once the write completes: if the
+ * producer has lapped it in the meantime, the record may have been sent garbled and the subscriber is dropped. It
+ * was a whole ring behind then anyway, SSE clients reconnect and resume from their Last-Event-ID.
+ */
+class event_ring {
+public:
+   static constexpr std::size_t capacity = 1024;
+   static constexpr std::size_t max_record_size = 244;
+
+public:
+   event_ring();
+
+   event_ring(const event_ring &) = delete;
+   event_ring &operator=(const event_ring &) = delete;
+
+public:
+   /**
+    * Producer: format and append a record.
+    * @param event SSE event type
+    * @param data Single-line JSON, truncated to fit the slot
+    */
+   void publish(std::string_view event, std::string_view data);
+
+   //! @return Index of the next record to be published
+   [[nodiscard]] std::uint64_t head() const { return head_.load(std::memory_order_acquire); }
+
+   /**
+    * Subscriber: record with the index, as a view into its slot.
+    * @return Empty view if the record was already overwritten.
+    */
+   [[nodiscard]] std::string_view record(std::uint64_t index) const;
+
+   //! Subscriber: @return True if the record is still in its slot, i.e. was not overwritten since it was read
+   [[nodiscard]] bool intact(std::uint64_t index) const;
+
+private:
+   struct alignas(64) slot {
+      std::atomic<std::uint64_t> seq{0};
+      std::atomic<std::uint32_t> size{0}; //!< Atomic: read by the subscribers while the producer may overwrite it
+      std::array<char, max_record_size> data{};
+   };
+
+private:
+   std::unique_ptr<slot[]> slots_;
+   std::atomic<std::uint64_t> head_{0};
+};
+
+/**
+ * Subscribers of a single network thread.
+ * The producer wakes each thread's hub once, the hub wakes its subscribers, so a record costs one cross-thread post
+ * per network thread instead of one per subscriber.
+ */
+class event_hub {
+public:
+   using executor_t = boost::asio::io_context::executor_type;
+   using timer_t = boost::asio::
+      basic_waitable_timer<std::chrono::steady_clock, boost::asio::wait_traits<std::chrono::steady_clock>, executor_t>;
+
+public:
+   event_hub(boost::asio::io_context &io, std::size_t max_subscribers);
+
+   event_hub(const event_hub &) = delete;
+   event_hub &operator=(const event_hub &) = delete;
+
+public:
+   //! Network thread: the subscriber waits on the timer for new records
+   void subscribe(timer_t &timer);
+   void unsubscribe(timer_t &timer);
+
+   //! Any thread: wake all the subscribers. Notifications are coalesced until the hub gets to run, and skipped
+   //! altogether while there are no subscribers.
+   void notify();
+
+   [[nodiscard]] std::size_t size() const { return subscribers_.size(); }
+
+private:
+   boost::asio::io_context *io_;
+   std::atomic<bool> pending_{false};
+   std::atomic<std::size_t> num_subscribers_{0};
+   std::vector<timer_t *> subscribers_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_EVENT_STREAM_H */
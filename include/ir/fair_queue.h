@@ -0,0 +1,169 @@
+/**
+ * @file   fair_queue.h
+ * @author Dennis Sitelew
+ * @date   Dec. 26, 2021
+ */
+#ifndef INCLUDE_IR_FAIR_QUEUE_H
+#define INCLUDE_IR_FAIR_QUEUE_H
+
+#include <ir/client_key.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ir {
+
+/**
+ * Weighted fair queue of transmitter jobs.
+ *
+ * Each client has its own FIFO, the clients share the transmitter in proportion to their weights (self-clocked fair
+ * queueing): a job is stamped with a virtual finish time of max(V, finish of the client's previous job) +
+ * cost / weight, where V is the finish time of the job being sent, and the job with the earliest finish time goes
+ * next. A client flooding the transmitter only delays its own jobs.
+ *
+ * Jobs are type-erased into fixed-size nodes, recycled through a free list: the queue only allocates while it grows
+ * beyond its largest size so far.
+ *
+ * Jobs are pushed right from the threads that receive the commands, so the queue always sees every waiting command
+ * when picking the next one. Jobs are run one at a time by a single dispatcher: push reports when the queue went from
+ * idle to busy and a dispatcher has to be scheduled, run_next reports whether it has to keep going.
+ *
+ * A job may have a deadline for its start. Jobs that are not going to start before it are not run, but expired: the
+ * job is called with true and is expected to fail its command right away. That is the case once the deadline passes,
+ * but also if it passes while the next job runs: the queue keeps an average of the run time per unit of cost, so a
+ * stale job is answered as soon as it is known to be late, instead of one transmission later. The queue is only
+ * searched for expired jobs once the earliest of the deadlines is within reach.
+ */
+class fair_queue {
+public:
+   static constexpr std::size_t job_storage_size = 256;
+
+   using clock_t = std::chrono::steady_clock;
+   using now_function = clock_t::time_point (*)();
+
+   //! Deadline of the jobs that never expire
+   static constexpr clock_t::time_point no_deadline = clock_t::time_point::max();
+
+public:
+   //! @param now Clock measuring the run time of the jobs, replaceable for the tests
+   explicit fair_queue(now_function now = &clock_t::now);
+   ~fair_queue();
+
+   fair_queue(const fair_queue &) = delete;
+   fair_queue &operator=(const fair_queue &) = delete;
+
+public:
+   /**
+    * Queue a job.
+    * @param weight Share of the client, relative to the others
+    * @param cost Number of transmissions the job is going to take
+    * @param deadline Latest start of the job
+    * @param f Function called with false to run the job, or with true once it expired
+    * @return True if the queue was idle: the caller has to schedule run_next
+    */
+   template <class Function>
+   bool push(const client_key &client, unsigned weight, unsigned cost, clock_t::time_point deadline, Function &&f) {
+      using function_t = std::decay_t<Function>;
+      static_assert(sizeof(function_t) <= job_storage_size && alignof(function_t) <= alignof(std::max_align_t),
+                    "Job does not fit into the node");
+
+      std::lock_guard lock{mutex_};
+      auto n = allocate();
+      new (&n->storage) function_t(std::forward<Function>(f));
+      n->invoke = [](node &self, action a) {
+         auto &fn = *std::launder(reinterpret_cast<function_t *>(&self.storage));
+         struct destroy {
+            function_t &fn;
+            ~destroy() { fn.~function_t(); }
+         } guard{fn};
+
+         if (a != action::discard) {
+            fn(a == action::expire);
+         }
+      };
+
+      enqueue(n, client, weight, cost, deadline);
+      return !std::exchange(scheduled_, true);
+   }
+
+   /**
+    * Run the job with the earliest finish time, expiring the jobs that can't start before it is done. The jobs are
+    * called without holding the lock: they may queue more jobs. Only to be called by the scheduled dispatcher.
+    * @return True if there are more jobs, false if the queue went idle and the next push schedules a new dispatcher.
+    */
+   bool run_next(clock_t::time_point now);
+
+   struct counts {
+      std::size_t jobs;
+      std::size_t clients; //!< Clients with queued jobs
+   };
+
+   [[nodiscard]] counts size() const;
+
+private:
+   enum class action { run, expire, discard };
+
+   struct node {
+      node *next{nullptr};
+      std::uint64_t finish{0};
+      unsigned cost{0};
+      clock_t::time_point deadline{no_deadline};
+      void (*invoke)(node &, action){nullptr};
+      std::aligned_storage_t<job_storage_size> storage;
+   };
+
+   struct flow {
+      node *head{nullptr};
+      node *tail{nullptr};
+      std::uint64_t last_finish{0};
+   };
+
+   //! Virtual time resolution: a transmission of a client with the weight 1
+   static constexpr std::uint64_t unit = 1U << 16;
+
+   //! Idle clients are forgotten once there are more of them than this
+   static constexpr std::size_t max_idle_flows = 1024;
+
+private:
+   //! Called with the mutex held
+   node *allocate();
+   void enqueue(node *n, const client_key &client, unsigned weight, unsigned cost, clock_t::time_point deadline);
+   //! @return The jobs with a deadline before the time, unlinked from their clients and prepended to the expired ones
+   node *take_expired(clock_t::time_point time, node *expired);
+   //! @return The job with the earliest finish time, unlinked from its client
+   node *take_next();
+
+   //! Called without the mutex: invoke the job and put the node back to the free list
+   void complete(node *n, action a);
+
+private:
+   const now_function now_;
+
+   mutable std::mutex mutex_{};
+   bool scheduled_{false};
+
+   std::uint64_t virtual_time_{0};
+   std::size_t size_{0};
+   //! May be earlier than the actual earliest deadline, but never later
+   clock_t::time_point earliest_deadline_{no_deadline};
+   //! Moving average of the run time of a job per unit of cost, zero until the first job is done
+   clock_t::duration unit_time_{0};
+
+   std::unordered_map<client_key, flow, client_key_hash> flows_{};
+   std::vector<flow *> active_{};
+
+   std::vector<std::unique_ptr<node>> nodes_{};
+   node *free_{nullptr};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_FAIR_QUEUE_H */
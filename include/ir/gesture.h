@@ -0,0 +1,105 @@
+/**
+ * @file   gesture.h
+ * @author Dennis Sitelew
+ * @date   Nov. 08, 2021
+ */
+#ifndef INCLUDE_IR_GESTURE_H
+#define INCLUDE_IR_GESTURE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace ir {
+
+enum class gesture {
+   short_press,  //!< Single press and release
+   double_press, //!< Two short presses within the double press window
+   long_press,   //!< Button held down for at least the long press duration
+   hold_repeat,  //!< Button is still held down after a long press, fired every repeat interval
+};
+
+/**
+ * Debouncing and gesture detection of a push button, without any I/O.
+ *
+ * Time is counted in pigpio ticks (µs, wrapping around every ~72 minutes): the edges come with their own ticks, and
+ * the owner calls advance() once the tick returned by deadline() is reached. Gestures are reported synchronously
+ * from edge() and advance(). Not thread-safe.
+ */
+class gesture_detector {
+public:
+   using callback_t = std::function<void(gesture)>;
+   using duration_t = std::chrono::milliseconds;
+
+   struct config {
+      //! Edges closer than this to the last accepted edge are considered bounces
+      duration_t debounce_interval{50};
+
+      //! Second press within this window results in a double_press, 0 - double presses are not detected
+      duration_t double_press_window{0};
+
+      //! Hold duration for the long_press, 0 - long presses are not detected
+      duration_t long_press_duration{0};
+
+      //! Interval between the hold_repeat events after a long press, 0 - no repeats
+      duration_t repeat_interval{0};
+   };
+
+public:
+   gesture_detector(const config &cfg, bool pressed, callback_t cb);
+
+public:
+   /**
+    * Level change of the pin at the tick.
+    * @return False if the edge didn't change the debounced state (same level or a bounce)
+    */
+   bool edge(bool pressed, std::uint32_t tick);
+
+   //! Start over with the pin at the level, without reporting anything
+   void reset(bool pressed);
+
+   //! Report the gestures due by the tick
+   void advance(std::uint32_t tick);
+
+   //! Tick of the next advance() the detector needs, none if it only waits for edges
+   [[nodiscard]] std::optional<std::uint32_t> deadline() const;
+
+   //! Debounced state
+   [[nodiscard]] bool pressed() const { return pressed_; }
+
+private:
+   void on_press(std::uint32_t tick);
+   void on_release(std::uint32_t tick);
+   void on_long_press_timer(std::uint32_t tick);
+
+   [[nodiscard]] bool detects_long_press() const { return long_press_us_ > 0; }
+   [[nodiscard]] bool detects_double_press() const { return double_press_us_ > 0; }
+
+   //! Wrap-safe "a is not after b"
+   [[nodiscard]] static bool not_after(std::uint32_t a, std::uint32_t b) {
+      return static_cast<std::int32_t>(a - b) <= 0;
+   }
+
+private:
+   const std::uint32_t debounce_us_;
+   const std::uint32_t double_press_us_;
+   const std::uint32_t long_press_us_;
+   const std::uint32_t repeat_us_;
+   const callback_t callback_;
+
+   //! Debounced state
+   bool pressed_;
+   std::uint32_t last_change_tick_{0};
+   bool first_change_{true};
+
+   //! Gesture state
+   bool long_press_fired_{false};
+   bool release_pending_{false}; //!< A short press is waiting for a possible second press
+   std::optional<std::uint32_t> long_press_tick_;
+   std::optional<std::uint32_t> double_press_tick_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_GESTURE_H */
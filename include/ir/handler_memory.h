@@ -0,0 +1,164 @@
+/**
+ * @file   handler_memory.h
+ * @author Dennis Sitelew
+ * @date   Nov. 28, 2021
+ */
+#ifndef INCLUDE_IR_HANDLER_MEMORY_H
+#define INCLUDE_IR_HANDLER_MEMORY_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+
+namespace ir {
+
+/**
+ * Memory block for the asynchronous operation handlers of a single object.
+ * Objects that only ever have one operation in flight (like an HTTP connection) can serve all their handler
+ * allocations from this block. In case if the block is already in use, allocation falls back to the heap.
+ *
+ * See: boost/libs/asio/example/cpp11/allocation/server.cpp
+ */
+class handler_memory {
+public:
+   static constexpr std::size_t storage_size = 1024;
+
+public:
+   handler_memory() = default;
+   handler_memory(const handler_memory &) = delete;
+   handler_memory &operator=(const handler_memory &) = delete;
+
+public:
+   void *allocate(std::size_t size) {
+      if (!in_use_ && size <= sizeof(storage_)) {
+         in_use_ = true;
+         return &storage_;
+      }
+      return ::operator new(size);
+   }
+
+   void deallocate(void *pointer) {
+      if (pointer == &storage_) {
+         in_use_ = false;
+      } else {
+         ::operator delete(pointer);
+      }
+   }
+
+private:
+   std::aligned_storage_t<storage_size> storage_;
+   bool in_use_{false};
+};
+
+template <class T>
+class handler_allocator {
+public:
+   using value_type = T;
+
+   explicit handler_allocator(handler_memory &mem)
+      : memory_{&mem} {}
+
+   template <class U>
+   handler_allocator(const handler_allocator<U> &other) noexcept
+      : memory_{other.memory_} {}
+
+   T *allocate(std::size_t n) const { return static_cast<T *>(memory_->allocate(sizeof(T) * n)); }
+   void deallocate(T *p, std::size_t /*n*/) const { return memory_->deallocate(p); }
+
+   template <class U>
+   bool operator==(const handler_allocator<U> &other) const noexcept {
+      return memory_ == other.memory_;
+   }
+
+   template <class U>
+   bool operator!=(const handler_allocator<U> &other) const noexcept {
+      return memory_ != other.memory_;
+   }
+
+private:
+   template <class>
+   friend class handler_allocator;
+
+   handler_memory *memory_;
+};
+
+//! Handler wrapper, associating a handler_memory block with the handler
+template <class Handler>
+class custom_alloc_handler {
+public:
+   using allocator_type = handler_allocator<Handler>;
+
+   custom_alloc_handler(handler_memory &m, Handler h)
+      : memory_{&m}
+      , handler_{std::move(h)} {}
+
+   allocator_type get_allocator() const noexcept { return allocator_type(*memory_); }
+
+   template <class... Args>
+   void operator()(Args &&...args) {
+      handler_(std::forward<Args>(args)...);
+   }
+
+   [[nodiscard]] const Handler &handler() const noexcept { return handler_; }
+
+private:
+   handler_memory *memory_;
+   Handler handler_;
+};
+
+template <class Handler>
+inline custom_alloc_handler<Handler> make_custom_alloc_handler(handler_memory &m, Handler h) {
+   return custom_alloc_handler<Handler>(m, std::move(h));
+}
+
+/**
+ * Completion token adapter: the handler produced by the wrapped token (e.g. use_awaitable) allocates its
+ * operation state from the handler_memory block.
+ */
+template <class Token>
+struct custom_alloc_token {
+   handler_memory *memory;
+   Token token;
+};
+
+template <class Token>
+inline custom_alloc_token<std::decay_t<Token>> with_handler_memory(handler_memory &m, Token &&token) {
+   return {&m, std::forward<Token>(token)};
+}
+
+} // namespace ir
+
+namespace boost::asio {
+
+template <class Handler, class Executor>
+struct associated_executor<ir::custom_alloc_handler<Handler>, Executor> {
+   using type = associated_executor_t<Handler, Executor>;
+
+   static type get(const ir::custom_alloc_handler<Handler> &h, const Executor &ex = Executor()) noexcept {
+      return get_associated_executor(h.handler(), ex);
+   }
+};
+
+template <class Token, class Signature>
+struct async_result<ir::custom_alloc_token<Token>, Signature> {
+   using return_type = typename async_result<Token, Signature>::return_type;
+
+   template <class Initiation, class RawToken, class... Args>
+   static return_type initiate(Initiation &&initiation, RawToken &&token, Args &&...args) {
+      return async_initiate<Token, Signature>(
+         [initiation = std::forward<Initiation>(initiation), memory = token.memory](auto handler,
+                                                                                   auto &&...init_args) mutable {
+            std::move(initiation)(ir::make_custom_alloc_handler(*memory, std::move(handler)),
+                                  std::forward<decltype(init_args)>(init_args)...);
+         },
+         token.token, std::forward<Args>(args)...);
+   }
+};
+
+} // namespace boost::asio
+
+#endif /* INCLUDE_IR_HANDLER_MEMORY_H */
@@ -0,0 +1,228 @@
+/**
+ * @file   http_connection.h
+ * @author Dennis Sitelew
+ * @date   Nov. 28, 2021
+ */
+#ifndef INCLUDE_IR_HTTP_CONNECTION_H
+#define INCLUDE_IR_HTTP_CONNECTION_H
+
+#include <ir/batch.h>
+#include <ir/client_key.h>
+#include <ir/event_stream.h>
+#include <ir/handler_memory.h>
+#include <ir/recycling_allocator.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+namespace ir {
+
+class server;
+class http_connection_pool;
+class ws_session;
+
+/**
+ * A single HTTP connection.
+ * Connection objects are owned by the http_connection_pool and are reused for multiple sockets over their lifetime,
+ * all buffers are allocated once and sized for the small requests ir-ctrl is expected to handle.
+ * Each socket is served by a single coroutine, running until the connection is closed.
+ */
+class http_connection {
+public:
+   using tcp = boost::asio::ip::tcp;
+
+   //! Concrete executor and stream types: a type-erased executor would allocate each time it is copied
+   using executor_t = boost::asio::io_context::executor_type;
+   using stream_t = boost::beast::basic_stream<tcp, executor_t>;
+   using socket_t = stream_t::socket_type;
+
+   static constexpr std::size_t read_buffer_size = 4096;
+   static constexpr std::size_t body_buffer_size = 1024;  //!< Body limit of the requests other than POST /batch
+   static constexpr std::size_t batch_body_limit = 16384; //!< Large enough for a batch with raw timings
+   static constexpr std::size_t max_kept_body_capacity = 65536; //!< Larger prepared responses are released once sent
+
+   using read_buffer_t = boost::beast::flat_static_buffer<read_buffer_size>;
+   //! Only requests that have a body allocate it, sized from the Content-Length
+   using body_t = boost::beast::http::basic_dynamic_body<boost::beast::basic_flat_buffer<recycling_allocator<char>>>;
+   using parser_t = boost::beast::http::request_parser<body_t, recycling_allocator<char>>;
+
+   //! Pre-serialized responses
+   enum class response {
+      ok,
+      bad_request,
+      not_found,
+      method_not_allowed,
+      too_many_requests,
+      internal_server_error,
+      gateway_timeout,
+      service_unavailable,
+   };
+
+   static constexpr std::size_t num_responses = 8;
+
+   //! @return HTTP status code of the response
+   static unsigned status_code(response r);
+
+public:
+   http_connection(server &server, http_connection_pool &pool, boost::asio::io_context &io);
+   ~http_connection();
+
+   http_connection(const http_connection &) = delete;
+   http_connection &operator=(const http_connection &) = delete;
+
+public:
+   void start(socket_t socket);
+
+private:
+   //! Outcome of the request routing: either a final response, or an IR code (or a batch) to be sent first.
+   //! Responses that are not canned (e.g. metrics) are prepared by the route handler, result is only used for
+   //! accounting then.
+   struct route_result {
+      response result;
+      std::optional<std::uint32_t> code{};
+      bool prepared{false};
+      bool batch{false};
+      std::optional<std::chrono::milliseconds> deadline{}; //!< Given in the query, overrides the header
+   };
+
+private:
+   boost::asio::awaitable<void> run();
+
+   /**
+    * Move the connection from the request slots of the pool to the session ones, for a long-lived session.
+    * @return False if all the session slots are taken, the 503 response is written then
+    */
+   boost::asio::awaitable<bool> open_session();
+
+   //! Serve GET /events until the subscriber goes away (or falls too far behind)
+   boost::asio::awaitable<void> stream_events(const parser_t::value_type &request);
+
+   //! @return The 429 response if the client exceeded its share, nothing if the command may be queued
+   std::optional<route_result> admit(unsigned cost, std::chrono::steady_clock::time_point now);
+
+   /**
+    * Latest start of the transmission of a command received at the time: from the query, the X-Deadline-Ms header or
+    * the server default, in this order. 0 ms means no deadline.
+    * @return Nothing if the header is malformed
+    */
+   std::optional<std::chrono::steady_clock::time_point> deadline_of(const parser_t::value_type &request,
+                                                                    std::optional<std::chrono::milliseconds> query,
+                                                                    std::chrono::steady_clock::time_point received);
+
+   route_result route(parser_t::value_type &request);
+   route_result handle_send(const parser_t::value_type &request);
+   route_result handle_batch(parser_t::value_type &request);
+   route_result handle_schedule(const parser_t::value_type &request);
+   route_result handle_metrics(const parser_t::value_type &request);
+   route_result handle_trace(const parser_t::value_type &request);
+   route_result refuse(const parser_t::value_type &request);
+   route_result prepare_response(std::string_view content_type, response result = response::ok);
+
+   void handle_error(boost::beast::error_code ec);
+   void close();
+
+private:
+   server *server_;
+   http_connection_pool *pool_;
+   stream_t stream_;
+   client_key client_{};
+
+   //! Memory for the read/write operation state, the connection only ever has one of them in flight
+   handler_memory handler_memory_{};
+   read_buffer_t buffer_{};
+   std::optional<parser_t> parser_{};
+
+   //! Prepared (non-canned) response, the capacity is kept between requests (up to max_kept_body_capacity)
+   std::string response_header_{};
+   std::string response_body_{};
+
+   //! Parsed POST /batch request, the capacity is kept between requests
+   std::vector<batch::command> batch_commands_{};
+   std::vector<std::uint32_t> batch_timings_{};
+   std::vector<batch::result> batch_results_{};
+
+   //! Session of an upgraded connection, the connection object is back to HTTP once it ends
+   std::unique_ptr<ws_session> ws_{};
+
+   //! Holds one of the pool's session slots instead of a request slot
+   bool session_{false};
+
+   //! Woken by the pool's event_hub while the connection is subscribed to the GET /events stream
+   event_hub::timer_t events_timer_;
+};
+
+/**
+ * Fixed-size pool of connection objects.
+ * Each network thread has its own pool, so neither the pool nor its connections need any locking.
+ *
+ * Connections are accepted into the request slots. A connection that turns into a long-lived session (WebSocket or
+ * GET /events) moves to one of the session slots, so that the sessions can't starve the requests.
+ */
+class http_connection_pool {
+public:
+   struct statistics {
+      std::atomic<std::uint64_t> accepted{0};      //!< Connections handed to a connection object
+      std::atomic<std::uint64_t> timed_out{0};     //!< Connections closed because of a read or write deadline
+      std::atomic<std::uint64_t> accept_paused{0}; //!< Times accepting was suspended because the pool was exhausted
+      std::atomic<std::uint64_t> sessions_refused{0}; //!< Long-lived sessions refused because the slots were taken
+      std::atomic<std::int64_t> active{0};         //!< Connections currently being served
+   };
+
+public:
+   using release_handler_t = std::function<void()>;
+
+public:
+   http_connection_pool(server &server,
+                        boost::asio::io_context &io,
+                        std::size_t max_requests,
+                        std::size_t max_sessions,
+                        release_handler_t on_release);
+
+public:
+   //! @return A free connection object in a request slot, or nullptr if all of the request slots are in use.
+   http_connection *acquire();
+
+   //! Move an acquired connection from its request slot to a session slot. @return False if none is left.
+   bool open_session();
+
+   //! @param session The connection holds a session slot
+   void release(http_connection *connection, bool session);
+
+   [[nodiscard]] std::size_t size() const { return storage_.size(); }
+
+   //! @return Number of free request slots
+   [[nodiscard]] std::size_t available() const { return max_requests_ - requests_; }
+
+   [[nodiscard]] statistics &stats() { return stats_; }
+   [[nodiscard]] const statistics &stats() const { return stats_; }
+
+   [[nodiscard]] event_hub &events() { return events_; }
+
+private:
+   release_handler_t on_release_;
+   const std::size_t max_requests_;
+   const std::size_t max_sessions_;
+   std::size_t requests_{0};
+   std::size_t sessions_{0};
+   statistics stats_{};
+   event_hub events_;
+   std::vector<std::unique_ptr<http_connection>> storage_;
+   std::vector<http_connection *> free_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_HTTP_CONNECTION_H */
@@ -0,0 +1,102 @@
+/**
+ * @file   json.h
+ * @author Dennis Sitelew
+ * @date   Dec. 19, 2021
+ */
+#ifndef INCLUDE_IR_JSON_H
+#define INCLUDE_IR_JSON_H
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace ir {
+
+/**
+ * Allocation-free pull reader for JSON documents.
+ *
+ * The document is never turned into a tree: the caller walks it value by value, and strings are returned as views
+ * into the document. Escaped strings are decoded in place (an escape sequence is never shorter than the character it
+ * encodes), so the document buffer has to be writable and outlive the views.
+ *
+ * Errors are sticky: once the reader failed, every call fails, and error()/offset() tell what and where.
+ *
+ *    json_reader r{text};
+ *    for (r.begin_array(); r.next_item();) {
+ *       std::string_view key;
+ *       for (r.begin_object(); r.next_member(key);) {
+ *          if (key == "code") {
+ *             auto code = r.number();
+ *          } else {
+ *             r.skip();
+ *          }
+ *       }
+ *    }
+ *    bool ok = r.finish();
+ */
+class json_reader {
+public:
+   enum class value_type { string, number, boolean, null, array, object, none };
+
+public:
+   explicit json_reader(std::span<char> text)
+      : text_{text} {}
+
+public:
+   bool begin_array() { return begin('['); }
+   bool begin_object() { return begin('{'); }
+
+   //! @return True if there is another element in the current array, false on its end (or on an error)
+   bool next_item() { return next(']'); }
+
+   //! @return True if there is another member in the current object (its key is read into the key), false on its end
+   bool next_member(std::string_view &key);
+
+   //! @return Type of the next value, judging by its first character (none at the end of the document)
+   value_type next_type();
+
+   std::optional<std::string_view> string();
+   std::optional<double> number();
+   std::optional<bool> boolean();
+
+   //! Skip any value. @return Text of the value, e.g. to read an array of numbers later with a separate reader.
+   std::optional<std::string_view> skip();
+
+   //! Check that nothing but whitespace follows the document
+   bool finish();
+
+   //! Fail with an error of the caller (e.g. a value out of range)
+   void fail(const char *error);
+
+   [[nodiscard]] bool failed() const { return error_ != nullptr; }
+   [[nodiscard]] const char *error() const { return error_; }
+
+   //! @return Position of the error in the document
+   [[nodiscard]] std::size_t offset() const { return pos_; }
+
+private:
+   bool begin(char open);
+   bool next(char close);
+
+   //! Skip whitespace. @return Next character, 0 at the end of the document.
+   char peek();
+
+   std::optional<std::string_view> read_string(bool decode);
+   bool literal(std::string_view text);
+   bool decode_escape(std::size_t &write);
+
+private:
+   std::span<char> text_;
+   std::size_t pos_{0};
+
+   //! An element has just been read, the next one has to be preceded by a comma
+   bool after_value_{false};
+
+   const char *error_{nullptr};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_JSON_H */
@@ -0,0 +1,112 @@
+/**
+ * @file   lirc_db.h
+ * @author Dennis Sitelew
+ * @date   Dec. 18, 2021
+ */
+#ifndef INCLUDE_IR_LIRC_DB_H
+#define INCLUDE_IR_LIRC_DB_H
+
+#include <ir/util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ir {
+
+/**
+ * Compiled database of named remote keys (see ir-lirc-import), memory-mapped by the server.
+ *
+ * (remote, key) pairs are mapped to the entries with a minimal perfect hash (hash and displace): the name pair is
+ * hashed once, the first hash selects a bucket, and the bucket's seed remixes the hash into an entry index. A lookup
+ * is thus a single hash, two array reads and a name comparison, without any allocations.
+ *
+ * File layout (native byte order):
+ * - header: magic, version, number of entries, buckets and string bytes, file size;
+ * - bucket seeds;
+ * - entries: offsets and sizes of the names, protocol and code;
+ * - names.
+ */
+class lirc_db {
+public:
+   //! Protocols the codes are stored in
+   enum class protocol : std::uint8_t {
+      necx,
+   };
+
+   struct ir_code {
+      protocol proto;
+      std::uint32_t value;
+   };
+
+   //! Remote key of the mapped database, the names point into the mapping
+   struct key_view {
+      std::string_view remote;
+      std::string_view key;
+      ir_code code;
+   };
+
+   //! Remote key to be written to a database file
+   struct record {
+      std::string remote;
+      std::string key;
+      ir_code code;
+   };
+
+public:
+   //! Open the database file. A missing or invalid file results in an empty database.
+   explicit lirc_db(std::string path);
+   ~lirc_db();
+
+   lirc_db(const lirc_db &) = delete;
+   lirc_db &operator=(const lirc_db &) = delete;
+
+public:
+   [[nodiscard]] std::optional<ir_code> find(std::string_view remote, std::string_view key) const;
+
+   //! @return Key with the index, 0 <= index < size(). Keys are stored in hash order.
+   [[nodiscard]] key_view at(std::size_t index) const;
+
+   [[nodiscard]] std::size_t size() const { return entries_.size(); }
+   [[nodiscard]] const std::string &path() const { return path_; }
+
+   /**
+    * Build the perfect hash and write the database file.
+    * @return std::errc::invalid_argument if a (remote, key) pair is not unique or a name is too long.
+    */
+   static result_t<void> write(const std::string &path, const std::vector<record> &records);
+
+private:
+   //! Entry of the mapped file, names are stored as offsets into the name area
+   struct entry {
+      std::uint32_t remote_offset;
+      std::uint32_t key_offset;
+      std::uint16_t remote_size;
+      std::uint16_t key_size;
+      std::uint32_t code;
+      protocol proto;
+      std::uint8_t reserved[3];
+   };
+
+private:
+   result_t<void> load();
+   void unmap();
+
+private:
+   const std::string path_;
+
+   void *mapping_{nullptr};
+   std::size_t mapping_size_{0};
+
+   std::span<const std::uint32_t> seeds_{};
+   std::span<const entry> entries_{};
+   std::string_view names_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_LIRC_DB_H */
@@ -0,0 +1,92 @@
+/**
+ * @file   lirc_import.h
+ * @author Dennis Sitelew
+ * @date   Dec. 18, 2021
+ */
+#ifndef INCLUDE_IR_LIRC_IMPORT_H
+#define INCLUDE_IR_LIRC_IMPORT_H
+
+#include <ir/lirc_db.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace ir {
+
+/**
+ * Reads remote definitions in the lircd.conf format and converts their codes for the lirc_db.
+ *
+ * Files are read line by line, only the codes of the current remote are kept in memory. Remotes are imported if their
+ * timings match the NEC protocol (within the remote's eps/aeps tolerance) and they send 32 bits in total
+ * (pre_data + code + post_data). Each key code has to consist of an address and a command followed by its inverse,
+ * like the NECx codes of /send?code=. Other remotes and keys are skipped with a warning.
+ */
+class lirc_import {
+public:
+   //! Parse a lircd.conf stream, source is only used in the warnings
+   void parse(std::istream &in, std::string_view source);
+
+   [[nodiscard]] const std::vector<lirc_db::record> &records() const { return records_; }
+   [[nodiscard]] const std::vector<std::string> &warnings() const { return warnings_; }
+
+   [[nodiscard]] std::size_t imported_remotes() const { return imported_remotes_; }
+   [[nodiscard]] std::size_t skipped_remotes() const { return skipped_remotes_; }
+
+private:
+   //! Pulse and space durations, µs
+   using timing_t = std::pair<std::uint64_t, std::uint64_t>;
+
+   struct remote {
+      std::string name;
+      std::uint64_t line{0};
+
+      std::uint64_t bits{0};
+      std::uint64_t pre_data_bits{0};
+      std::uint64_t pre_data{0};
+      std::uint64_t post_data_bits{0};
+      std::uint64_t post_data{0};
+
+      std::string flags;
+      std::uint64_t eps{30};
+      std::uint64_t aeps{100};
+      std::uint64_t frequency{38000};
+
+      timing_t header{0, 0};
+      timing_t one{0, 0};
+      timing_t zero{0, 0};
+      std::uint64_t ptrail{0};
+
+      //! Reason the remote can not be imported, regardless of the timings
+      std::string unsupported;
+
+      std::vector<std::pair<std::string, std::uint64_t>> codes;
+   };
+
+private:
+   void finish(const remote &r, std::string_view source);
+   void warn(std::string_view source, std::uint64_t line, const std::string &text);
+
+   //! @return Empty string if the remote's protocol is NECx, the reason otherwise
+   static std::string check_protocol(const remote &r);
+
+   static std::optional<std::uint32_t> to_necx(const remote &r, std::uint64_t code);
+
+private:
+   std::vector<lirc_db::record> records_{};
+   std::vector<std::string> warnings_{};
+   std::unordered_set<std::string> names_{};
+
+   std::size_t imported_remotes_{0};
+   std::size_t skipped_remotes_{0};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_LIRC_IMPORT_H */
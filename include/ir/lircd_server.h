@@ -0,0 +1,114 @@
+/**
+ * @file   lircd_server.h
+ * @author Dennis Sitelew
+ * @date   Dec. 22, 2021
+ */
+#ifndef INCLUDE_IR_LIRCD_SERVER_H
+#define INCLUDE_IR_LIRCD_SERVER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <boost/asio.hpp>
+
+namespace ir {
+
+class server;
+
+/**
+ * Unix socket speaking the lircd protocol, so that irsend and other LIRC clients can use ir-ctrl directly.
+ * Remotes and keys are looked up in the remote database (--lirc-db).
+ *
+ * Supported directives (case-insensitive):
+ *    SEND_ONCE remote key [repeats]
+ *    SEND_START remote key      - repeat the key until SEND_STOP, or until the client disconnects
+ *    SEND_STOP remote key
+ *    LIST [remote]
+ *    VERSION
+ *
+ * Each directive is answered with a reply packet:
+ *    BEGIN / the directive / SUCCESS or ERROR / [DATA / number of lines / lines] / END
+ * Like lircd, only a single key can be repeated at a time.
+ */
+class lircd_server {
+public:
+   using protocol_t = boost::asio::local::stream_protocol;
+   using executor_t = boost::asio::io_context::executor_type;
+   using socket_t = boost::asio::basic_stream_socket<protocol_t, executor_t>;
+
+   static constexpr std::size_t max_line_size = 256;
+   static constexpr unsigned max_repeat = 20;
+
+public:
+   lircd_server(server &server, boost::asio::io_context &io, std::chrono::milliseconds repeat_interval);
+
+   lircd_server(const lircd_server &) = delete;
+   lircd_server &operator=(const lircd_server &) = delete;
+
+public:
+   /**
+    * Bind the socket, replacing a stale socket file. Any other file at the path is left alone and fails the call.
+    * @param mode Permission bits of the socket file
+    */
+   void listen(const std::string &path, unsigned mode);
+
+   //! Close the socket and remove the socket file
+   void stop();
+
+private:
+   //! Reply under construction
+   class reply {
+   public:
+      reply(std::string &out, std::string_view directive);
+
+      void success() { out_->append("SUCCESS\n"); }
+      void error(std::string_view message);
+
+      //! Add the data section, each line has to end with a newline
+      void data(std::size_t lines, std::string_view text);
+
+      void end() { out_->append("END\n"); }
+
+   private:
+      std::string *out_;
+   };
+
+private:
+   boost::asio::awaitable<void> accept_loop();
+   boost::asio::awaitable<void> serve(socket_t socket, std::uint64_t client);
+
+   //! Handle a single directive, appending the reply to the output
+   boost::asio::awaitable<void> handle(std::string_view line, std::uint64_t client, std::string &out);
+
+   boost::asio::awaitable<void> repeat_loop();
+   void list(std::string_view remote, reply &r);
+   void stop_repeat();
+
+private:
+   server *server_;
+   boost::asio::basic_socket_acceptor<protocol_t, executor_t> acceptor_;
+   std::string path_{};
+   std::uint64_t next_client_{1};
+
+   //! Key being repeated, owned by the client that started it
+   std::chrono::milliseconds repeat_interval_;
+   boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+                                     boost::asio::wait_traits<std::chrono::steady_clock>,
+                                     executor_t>
+      repeat_timer_;
+   std::uint64_t repeat_owner_{0};
+   std::uint32_t repeat_code_{0};
+   std::string repeat_remote_{};
+   std::string repeat_key_{};
+   bool repeat_running_{false};
+
+   //! Scratch buffer for LIST
+   std::string list_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_LIRCD_SERVER_H */
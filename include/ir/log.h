@@ -0,0 +1,147 @@
+/**
+ * @file   log.h
+ * @author Dennis Sitelew
+ * @date   Dec. 14, 2021
+ */
+#ifndef INCLUDE_IR_LOG_H
+#define INCLUDE_IR_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+namespace ir::log {
+
+enum class level : std::uint8_t {
+   debug,
+   info,
+   warning,
+   error,
+};
+
+/**
+ * A single key-value pair of a log record.
+ * Keys (and the values of literal fields) are only recorded as pointers, so they have to be string literals.
+ * Text fields are copied into the record and truncated if the record runs out of space.
+ */
+struct field {
+   enum class kind : std::uint8_t { unsigned_int, signed_int, hex, real, literal, text };
+
+   const char *key;
+   kind type;
+   union {
+      std::uint64_t u;
+      std::int64_t i;
+      double d;
+      const char *s;
+   };
+   std::string_view text{};
+};
+
+inline field kv(const char *key, std::uint64_t v) {
+   field f{key, field::kind::unsigned_int, {}};
+   f.u = v;
+   return f;
+}
+
+inline field kv(const char *key, std::uint32_t v) {
+   return kv(key, static_cast<std::uint64_t>(v));
+}
+
+inline field kv(const char *key, std::int64_t v) {
+   field f{key, field::kind::signed_int, {}};
+   f.i = v;
+   return f;
+}
+
+inline field kv(const char *key, int v) {
+   return kv(key, static_cast<std::int64_t>(v));
+}
+
+inline field kv(const char *key, double v) {
+   field f{key, field::kind::real, {}};
+   f.d = v;
+   return f;
+}
+
+//! String literal value
+inline field kv(const char *key, const char *v) {
+   field f{key, field::kind::literal, {}};
+   f.s = v;
+   return f;
+}
+
+//! Hexadecimal value (IR codes)
+inline field hex(const char *key, std::uint64_t v) {
+   field f{key, field::kind::hex, {}};
+   f.u = v;
+   return f;
+}
+
+//! Arbitrary text, copied into the record
+inline field text(const char *key, std::string_view v) {
+   field f{key, field::kind::text, {}};
+   f.text = v;
+   return f;
+}
+
+/**
+ * Start the background thread, writing the records to stdout.
+ * Records are written as logfmt lines; if stdout is connected to the journal, each line is prefixed with the syslog
+ * priority instead of a timestamp.
+ *
+ * @param min_level Records below this level are discarded right away.
+ * @param rate_limit Maximal number of records per second for each event, 0 - unlimited. The number of suppressed
+ *                   records is attached to the next record of the same event.
+ */
+void start(level min_level, unsigned rate_limit);
+
+//! Write all pending records and stop the background thread
+void stop();
+
+//! RAII wrapper for start/stop
+class session {
+public:
+   session(level min_level, unsigned rate_limit) { start(min_level, rate_limit); }
+   ~session() { stop(); }
+
+   session(const session &) = delete;
+   session &operator=(const session &) = delete;
+};
+
+[[nodiscard]] bool enabled(level l);
+
+/**
+ * Queue a record for the background thread.
+ * Never blocks: the record is copied into a lock-free ring, and dropped (and counted) if the ring is full.
+ *
+ * @param event Event name, has to be a string literal.
+ */
+void write(level l, const char *event, std::initializer_list<field> fields = {});
+
+inline void debug(const char *event, std::initializer_list<field> fields = {}) {
+   write(level::debug, event, fields);
+}
+
+inline void info(const char *event, std::initializer_list<field> fields = {}) {
+   write(level::info, event, fields);
+}
+
+inline void warning(const char *event, std::initializer_list<field> fields = {}) {
+   write(level::warning, event, fields);
+}
+
+inline void error(const char *event, std::initializer_list<field> fields = {}) {
+   write(level::error, event, fields);
+}
+
+//! @return Number of records dropped because the ring was full
+[[nodiscard]] std::uint64_t dropped();
+
+//! Parse a level name (debug, info, warning, error)
+bool parse_level(std::string_view text, level &result);
+
+} // namespace ir::log
+
+#endif /* INCLUDE_IR_LOG_H */
@@ -0,0 +1,180 @@
+/**
+ * @file   metrics.h
+ * @author Dennis Sitelew
+ * @date   Dec. 12, 2021
+ */
+#ifndef INCLUDE_IR_METRICS_H
+#define INCLUDE_IR_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace ir::metrics {
+
+static constexpr std::size_t max_shards = 16;
+static constexpr std::size_t cache_line = 64;
+
+/**
+ * Shard of the calling thread.
+ * Threads are assigned round-robin, so as long as there are no more than max_shards threads, every thread updates its
+ * own cache line and the updates are never contended.
+ */
+inline std::size_t this_thread_shard() {
+   static std::atomic<std::size_t> next{0};
+   static thread_local const std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % max_shards;
+   return shard;
+}
+
+/**
+ * Monotonic counter.
+ * Updates are relaxed atomic additions to the shard of the calling thread, reading sums up all the shards.
+ */
+class counter {
+public:
+   void add(std::uint64_t n = 1) noexcept { shards_[this_thread_shard()].value.fetch_add(n, std::memory_order_relaxed); }
+
+   [[nodiscard]] std::uint64_t value() const noexcept {
+      std::uint64_t result = 0;
+      for (const auto &s : shards_) {
+         result += s.value.load(std::memory_order_relaxed);
+      }
+      return result;
+   }
+
+private:
+   struct alignas(cache_line) shard {
+      std::atomic<std::uint64_t> value{0};
+   };
+
+   std::array<shard, max_shards> shards_{};
+};
+
+//! Value that can go up and down, usually set by a single thread
+class gauge {
+public:
+   void set(std::int64_t v) noexcept { value_.store(v, std::memory_order_relaxed); }
+   void add(std::int64_t n) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+
+   [[nodiscard]] std::int64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+   std::atomic<std::int64_t> value_{0};
+};
+
+/**
+ * Log-linear (HDR-style) histogram of durations in microseconds.
+ *
+ * Each power of two range is split into sub_buckets linear buckets, so the relative bucket width (and the error of any
+ * derived quantile) stays below 1 / sub_buckets across the whole range, from single microseconds to minutes.
+ * Values above the range are only accounted for in the +Inf bucket.
+ */
+class histogram {
+public:
+   static constexpr unsigned sub_bucket_bits = 2;
+   static constexpr std::uint64_t sub_buckets = 1U << sub_bucket_bits;
+
+   //! Values up to 2^max_exponent µs (~134 s) have their own buckets
+   static constexpr unsigned max_exponent = 27;
+   static constexpr std::size_t num_buckets = sub_buckets * (max_exponent - sub_bucket_bits + 1);
+
+   //! Counts of all buckets plus the sum of all values
+   struct snapshot {
+      std::array<std::uint64_t, num_buckets + 1> counts{};
+      std::uint64_t sum{0};
+   };
+
+public:
+   void record(std::uint64_t us) noexcept {
+      auto &s = shards_[this_thread_shard()];
+      s.counts[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+      s.sum.fetch_add(us, std::memory_order_relaxed);
+   }
+
+   template <class Rep, class Period>
+   void record(std::chrono::duration<Rep, Period> d) noexcept {
+      const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+      record(static_cast<std::uint64_t>(us < 0 ? 0 : us));
+   }
+
+   [[nodiscard]] snapshot read() const noexcept;
+
+   //! @return Bucket of the value, num_buckets for the values above the range
+   static constexpr std::size_t bucket_index(std::uint64_t v) noexcept {
+      if (v < sub_buckets) {
+         return static_cast<std::size_t>(v);
+      }
+
+      const unsigned e = std::bit_width(v) - 1;
+      if (e >= max_exponent) {
+         return num_buckets;
+      }
+
+      return sub_buckets * (e - sub_bucket_bits + 1) + ((v >> (e - sub_bucket_bits)) & (sub_buckets - 1));
+   }
+
+   //! @return Largest value (inclusive) that falls into the bucket
+   static constexpr std::uint64_t bucket_upper_bound(std::size_t index) noexcept {
+      if (index < sub_buckets) {
+         return index;
+      }
+
+      const unsigned e = index / sub_buckets + sub_bucket_bits - 1;
+      const std::uint64_t width = std::uint64_t{1} << (e - sub_bucket_bits);
+      return (sub_buckets + index % sub_buckets) * width + width - 1;
+   }
+
+private:
+   struct alignas(cache_line) shard {
+      std::array<std::atomic<std::uint64_t>, num_buckets + 1> counts{};
+      std::atomic<std::uint64_t> sum{0};
+   };
+
+   std::array<shard, max_shards> shards_{};
+};
+
+/**
+ * Prometheus text exposition format (version 0.0.4) writer.
+ */
+class text_writer {
+public:
+   explicit text_writer(std::string &out)
+      : out_{&out} {}
+
+public:
+   void header(std::string_view name, std::string_view help, std::string_view type);
+
+   //! @param labels Label list without the braces, e.g. code="200"
+   void sample(std::string_view name, std::string_view labels, std::uint64_t value);
+   void sample(std::string_view name, std::string_view labels, std::int64_t value);
+   void sample(std::string_view name, std::string_view labels, double value);
+
+   void counter(std::string_view name, std::string_view help, std::uint64_t value);
+   void gauge(std::string_view name, std::string_view help, std::int64_t value);
+
+   //! Histogram in seconds
+   void histogram(std::string_view name, std::string_view help, const metrics::histogram &h);
+
+private:
+   void append(std::uint64_t value);
+   void append(double value);
+
+private:
+   std::string *out_;
+};
+
+/**
+ * Number of allocations made with the global operator new by any thread of the process. Only available in builds with
+ * IR_CTRL_COUNT_ALLOCATIONS, which replace the operator (alloc_counter.cpp). The request paths meant to be
+ * allocation-free are checked against it (see ir-alloc-check).
+ */
+[[nodiscard]] std::uint64_t heap_allocations() noexcept;
+
+} // namespace ir::metrics
+
+#endif /* INCLUDE_IR_METRICS_H */
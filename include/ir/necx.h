@@ -30,6 +30,11 @@ class necx : public ir::wave {
 public:
    necx(int pin_number, std::uint32_t code);
 
+   //! Create the wave from an already encoded pulse train (see pulse_cache)
+   necx(int pin_number, std::uint32_t code, std::span<const gpioPulse_t> pulses);
+
+   static key make_key(int pin_number, std::uint32_t code);
+
 public:
    std::string name() const override { return "necx"; }
 
@@ -0,0 +1,92 @@
+/**
+ * @file   pulse_cache.h
+ * @author Dennis Sitelew
+ * @date   Dec. 16, 2021
+ */
+#ifndef INCLUDE_IR_PULSE_CACHE_H
+#define INCLUDE_IR_PULSE_CACHE_H
+
+#include <ir/util.h>
+#include <ir/wave.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ir {
+
+/**
+ * Persistent cache of encoded pulse trains.
+ *
+ * The cache file is memory-mapped when the cache is opened, the pulse trains are used straight from the mapping.
+ * Waves are lost on each restart of pigpio, but with the cache they only have to be uploaded, not encoded again.
+ *
+ * File layout (native byte order, the file is not meant to be moved between machines):
+ * - header: magic, version, number of entries, file size and a CRC-32 of the entry table;
+ * - entry table: key, number of times the wave was sent, offset, number of pulses and a CRC-32 of the pulses;
+ * - pulse trains.
+ *
+ * A file with a bad header or entry table is ignored as a whole, entries with bad pulse trains are skipped.
+ */
+class pulse_cache {
+public:
+   //! Wave to be stored in the cache
+   struct record {
+      wave::key key;
+      std::uint64_t hits;
+      std::span<const gpioPulse_t> pulses;
+   };
+
+public:
+   //! Open the cache file. A missing or invalid file results in an empty cache.
+   explicit pulse_cache(std::string path);
+   ~pulse_cache();
+
+   pulse_cache(const pulse_cache &) = delete;
+   pulse_cache &operator=(const pulse_cache &) = delete;
+
+public:
+   [[nodiscard]] std::optional<std::span<const gpioPulse_t>> find(const wave::key &key) const;
+
+   //! @return Number of times the wave was sent, as of the last save
+   [[nodiscard]] std::uint64_t hits(const wave::key &key) const;
+
+   //! @return Up to count keys with the most hits, most used first
+   [[nodiscard]] std::vector<wave::key> hottest(std::size_t count) const;
+
+   [[nodiscard]] std::size_t size() const { return index_.size(); }
+   [[nodiscard]] const std::string &path() const { return path_; }
+
+   /**
+    * Write the cache file: the records plus all the entries of the current file that are not in the list.
+    * The file is written next to the original one and renamed over it, so a crash leaves either the old or the new
+    * version. The current mapping stays valid.
+    */
+   result_t<void> save(const std::vector<record> &records) const;
+
+private:
+   struct entry {
+      std::uint64_t hits;
+      std::span<const gpioPulse_t> pulses;
+   };
+
+private:
+   result_t<void> load();
+   void unmap();
+
+private:
+   const std::string path_;
+
+   void *mapping_{nullptr};
+   std::size_t mapping_size_{0};
+
+   std::unordered_map<wave::key, entry, wave::key_hash> index_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_PULSE_CACHE_H */
@@ -0,0 +1,82 @@
+/**
+ * @file   rate_limiter.h
+ * @author Dennis Sitelew
+ * @date   Dec. 26, 2021
+ */
+#ifndef INCLUDE_IR_RATE_LIMITER_H
+#define INCLUDE_IR_RATE_LIMITER_H
+
+#include <ir/client_key.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace ir {
+
+/**
+ * Per-client admission control for the transmitter, shared by all the network threads.
+ *
+ * Each client address gets a token bucket (rate commands per second, up to burst of them at once) and a limit on
+ * the number of its commands waiting for the transmitter. A command is admitted only if both allow it, so a client
+ * exceeding its share is answered right away instead of being queued.
+ *
+ * The decisions are made on the network threads, the table is guarded by a mutex: the critical section is a handful
+ * of arithmetic operations, and the transmitter itself only handles a few commands per second anyway.
+ */
+class rate_limiter {
+public:
+   struct config {
+      double rate;               //!< Commands per second and client, 0 - unlimited
+      unsigned burst;            //!< Bucket size
+      unsigned max_pending;      //!< Commands per client waiting for (or being sent by) the transmitter, 0 - unlimited
+      std::size_t max_clients;   //!< Size of the client table
+   };
+
+   struct decision {
+      bool admitted;
+      std::chrono::seconds retry_after{0};
+   };
+
+   using clock_t = std::chrono::steady_clock;
+
+public:
+   explicit rate_limiter(const config &cfg);
+
+   rate_limiter(const rate_limiter &) = delete;
+   rate_limiter &operator=(const rate_limiter &) = delete;
+
+public:
+   //! @return True if there are any limits at all, otherwise acquire always admits and release is not needed
+   [[nodiscard]] bool enabled() const { return config_.rate > 0 || config_.max_pending > 0; }
+
+   /**
+    * Take a token for a command costing cost transmissions.
+    * An admitted command has to be released once it is done.
+    */
+   decision acquire(const client_key &client, unsigned cost, clock_t::time_point now);
+   void release(const client_key &client);
+
+private:
+   struct bucket {
+      double tokens;
+      clock_t::time_point updated;
+      unsigned pending{0};
+   };
+
+private:
+   //! Drop the clients that are idle and have a full bucket, i.e. that are indistinguishable from new ones
+   void sweep(clock_t::time_point now);
+
+private:
+   const config config_;
+
+   std::mutex mutex_{};
+   std::unordered_map<client_key, bucket, client_key_hash> buckets_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_RATE_LIMITER_H */
@@ -0,0 +1,43 @@
+/**
+ * @file   raw_wave.h
+ * @author Dennis Sitelew
+ * @date   Dec. 19, 2021
+ */
+#ifndef INCLUDE_IR_RAW_WAVE_H
+#define INCLUDE_IR_RAW_WAVE_H
+
+#include <ir/wave.h>
+
+#include <cstdint>
+#include <span>
+
+namespace ir {
+
+/**
+ * Wave given by its raw timings, for protocols ir-ctrl has no encoder for.
+ * Marks are sent as bursts on the carrier frequency (50% duty cycle), spaces as silence.
+ */
+class raw_wave : public ir::wave {
+public:
+   /**
+    * Construct (encode) the wave.
+    * @param pin_number Raspberry Pi pin number for the IR LED.
+    * @param frequency_hz Carrier frequency.
+    * @param timings Alternating mark and space durations in µs, starting with a mark.
+    */
+   raw_wave(int pin_number, double frequency_hz, std::span<const std::uint32_t> timings);
+
+public:
+   std::string name() const override { return "raw"; }
+
+protected:
+   void add_payload() override;
+
+private:
+   //! Only used while the wave is being encoded
+   std::span<const std::uint32_t> timings_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_RAW_WAVE_H */
@@ -0,0 +1,136 @@
+/**
+ * @file   recycling_allocator.h
+ * @author Dennis Sitelew
+ * @date   Nov. 28, 2021
+ */
+#ifndef INCLUDE_IR_RECYCLING_ALLOCATOR_H
+#define INCLUDE_IR_RECYCLING_ALLOCATOR_H
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+namespace ir {
+
+namespace detail {
+
+/**
+ * Per-thread cache of small memory blocks, grouped by power-of-two size classes.
+ * Freed blocks are kept in an intrusive free list and handed out again on the next allocation of the same class,
+ * so repeating request/response cycles stop hitting the global heap once the cache is warm.
+ */
+class block_cache {
+public:
+   static constexpr std::size_t min_block_size = 64;
+   static constexpr std::size_t num_classes = 6; // 64 .. 2048 bytes
+   static constexpr std::size_t max_cached_blocks = 64;
+
+public:
+   ~block_cache() {
+      for (auto &list : free_) {
+         while (list.head) {
+            auto next = list.head->next;
+            ::operator delete(list.head);
+            list.head = next;
+         }
+      }
+   }
+
+   static block_cache &instance() {
+      static thread_local block_cache cache;
+      return cache;
+   }
+
+   void *allocate(std::size_t size) {
+      const auto cls = size_class(size);
+      if (cls >= num_classes) {
+         return ::operator new(size);
+      }
+
+      auto &list = free_[cls];
+      if (list.head) {
+         auto block = list.head;
+         list.head = block->next;
+         --list.count;
+         return block;
+      }
+
+      return ::operator new(min_block_size << cls);
+   }
+
+   void deallocate(void *ptr, std::size_t size) {
+      const auto cls = size_class(size);
+      if (cls >= num_classes) {
+         ::operator delete(ptr);
+         return;
+      }
+
+      auto &list = free_[cls];
+      if (list.count == max_cached_blocks) {
+         ::operator delete(ptr);
+         return;
+      }
+
+      auto block = static_cast<node *>(ptr);
+      block->next = list.head;
+      list.head = block;
+      ++list.count;
+   }
+
+private:
+   struct node {
+      node *next;
+   };
+
+   struct free_list {
+      node *head{nullptr};
+      std::size_t count{0};
+   };
+
+   static std::size_t size_class(std::size_t size) {
+      std::size_t cls = 0;
+      for (auto block = min_block_size; block < size; block <<= 1) {
+         ++cls;
+      }
+      return cls;
+   }
+
+private:
+   std::array<free_list, num_classes> free_{};
+};
+
+} // namespace detail
+
+/**
+ * Stateless allocator backed by the per-thread block cache.
+ * Intended for short-lived containers that are rebuilt over and over again, e.g. HTTP header fields.
+ * Blocks may be released on a different thread, they simply migrate to that thread's cache.
+ */
+template <class T>
+class recycling_allocator {
+public:
+   using value_type = T;
+
+   recycling_allocator() noexcept = default;
+
+   template <class U>
+   recycling_allocator(const recycling_allocator<U> &) noexcept {}
+
+   T *allocate(std::size_t n) { return static_cast<T *>(detail::block_cache::instance().allocate(n * sizeof(T))); }
+
+   void deallocate(T *ptr, std::size_t n) noexcept { detail::block_cache::instance().deallocate(ptr, n * sizeof(T)); }
+
+   template <class U>
+   bool operator==(const recycling_allocator<U> &) const noexcept {
+      return true;
+   }
+
+   template <class U>
+   bool operator!=(const recycling_allocator<U> &) const noexcept {
+      return false;
+   }
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_RECYCLING_ALLOCATOR_H */
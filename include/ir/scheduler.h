@@ -0,0 +1,139 @@
+/**
+ * @file   scheduler.h
+ * @author Dennis Sitelew
+ * @date   Dec. 27, 2021
+ */
+#ifndef INCLUDE_IR_SCHEDULER_H
+#define INCLUDE_IR_SCHEDULER_H
+
+#include <ir/client_key.h>
+#include <ir/timer_wheel.h>
+#include <ir/util.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace ir {
+
+class server;
+
+/**
+ * Delayed and periodic transmissions, e.g. switching the equipment off at night or keeping a projector awake.
+ *
+ * Jobs are kept in a timing wheel with a millisecond tick, driven by a single timer on the control context that only
+ * wakes up for the next due job. A due job is queued for the transmitter like any other command, on the flow of the
+ * client that created it, with the scheduled time as the start of the transmission: the transmitter waits for it, so
+ * a precise job is queued a little ahead of its time and its wave is started right at it, busy-waiting on gpioTick
+ * for the last stretch.
+ *
+ * A periodic job keeps its phase: the next run is always a whole number of periods after the first one. A run that is
+ * due while the previous one is still queued or being sent is skipped, instead of piling up behind it.
+ *
+ * Jobs are managed from the network threads, the table and the wheel are guarded by a mutex.
+ */
+class scheduler {
+public:
+   using clock_t = std::chrono::steady_clock;
+
+   //! Precise jobs are queued this far ahead of their time, to have the wave ready when it comes
+   static constexpr std::chrono::milliseconds precise_lead{5};
+
+   struct job_spec {
+      std::uint32_t code;
+      unsigned count;                     //!< Transmissions per run
+      clock_t::time_point first;          //!< First run
+      std::chrono::milliseconds period;   //!< 0 - a single run
+      std::chrono::milliseconds deadline; //!< How late a run may start, 0 - whenever the transmitter is free
+      bool precise;
+      client_key client; //!< Creator of the job, the runs count against its share of the transmitter
+   };
+
+public:
+   scheduler(server &server, boost::asio::io_context &io, std::size_t max_jobs, std::size_t max_jobs_per_client);
+
+   scheduler(const scheduler &) = delete;
+   scheduler &operator=(const scheduler &) = delete;
+
+public:
+   void start();
+   void stop();
+
+   /**
+    * Add a job, safe to call from any thread.
+    * @return Identifier of the job, std::errc::no_buffer_space if there are max_jobs of them already,
+    *         std::errc::resource_unavailable_try_again if its client has max_jobs_per_client of them
+    */
+   result_t<std::uint64_t> add(const job_spec &spec);
+
+   //! Remove a job, safe to call from any thread. @return False if there is no such job.
+   bool cancel(std::uint64_t id);
+
+   //! Append the list of the jobs as JSON, safe to call from any thread
+   void write_json(std::string &out) const;
+
+   [[nodiscard]] std::size_t size() const { return num_jobs_.load(std::memory_order_relaxed); }
+
+private:
+   struct job : timer_wheel::entry {
+      std::uint32_t index{0};
+      std::uint32_t generation{1};
+      bool used{false};
+      bool running{false}; //!< A run is queued for (or being sent by) the transmitter
+      job_spec spec{};
+      clock_t::time_point next{};
+      std::uint64_t runs{0};
+      std::uint64_t skipped{0};
+      std::uint64_t expired{0};
+      std::uint64_t failed{0};
+   };
+
+private:
+   boost::asio::awaitable<void> run();
+
+   //! Control context: queue the due jobs for the transmitter
+   void fire(clock_t::time_point now);
+   void complete(std::uint64_t id, boost::system::error_code ec);
+
+   //! Put the job into the wheel for its next run. Called with the mutex held.
+   void schedule(job &j);
+
+   //! @return The job with the identifier, nullptr if it is gone. Called with the mutex held.
+   job *find(std::uint64_t id) const;
+   void release(job &j);
+
+   [[nodiscard]] static std::uint64_t id_of(const job &j) { return (std::uint64_t{j.generation} << 32) | j.index; }
+
+   //! @return Wheel tick of the time, rounded up: a job never fires early
+   [[nodiscard]] std::uint64_t tick_of(clock_t::time_point time) const;
+
+private:
+   server *server_;
+   const std::size_t max_jobs_;
+   const std::size_t max_jobs_per_client_;
+   const clock_t::time_point origin_;
+
+   mutable std::mutex mutex_{};
+   timer_wheel wheel_{};
+   std::vector<std::unique_ptr<job>> jobs_{};
+   std::vector<std::uint32_t> free_{};
+   std::atomic<std::size_t> num_jobs_{0};
+   std::unordered_map<client_key, std::size_t, client_key_hash> jobs_per_client_{};
+
+   //! Tick the timer is set to, a job due earlier has to wake it up
+   std::atomic<std::uint64_t> wake_tick_{0};
+   bool stopped_{false};
+   boost::asio::steady_timer timer_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_SCHEDULER_H */
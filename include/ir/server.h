@@ -6,13 +6,34 @@
 #ifndef INCLUDE_IR_SERVER_H
 #define INCLUDE_IR_SERVER_H
 
+#include <chrono>
+#include <atomic>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <vector>
 #include <cstdint>
 
 #include <ir/wave.h>
+#include <ir/batch.h>
 #include <ir/led.h>
+#include <ir/log.h>
 #include <ir/button.h>
+#include <ir/button_bank.h>
+#include <ir/client_key.h>
+#include <ir/event_stream.h>
+#include <ir/fair_queue.h>
+#include <ir/http_connection.h>
+#include <ir/lirc_db.h>
+#include <ir/lircd_server.h>
+#include <ir/metrics.h>
+#include <ir/pulse_cache.h>
+#include <ir/rate_limiter.h>
+#include <ir/scheduler.h>
+#include <ir/shm_listener.h>
+#include <ir/trace.h>
+#include <ir/udp_listener.h>
 #include <ir/util.h>
 
 #include <boost/asio.hpp>
@@ -23,40 +44,491 @@ class server {
 public:
    using wave_t = std::unique_ptr<wave>;
    using code_t = std::uint32_t;
-   using wave_list_t = std::unordered_map<code_t, wave_t>;
+
+   //! Encoded wave, uploaded to pigpio as long as there are enough DMA control blocks for it
+   struct cached_wave {
+      wave_t wave;
+      std::uint64_t last_used; //!< Transmission sequence number, least recently used waves are released first
+   };
+
+   using wave_list_t = std::unordered_map<code_t, cached_wave>;
+
+   //! Button of the panel (button bank) and its code
+   struct panel_button {
+      int pin;
+      code_t code;
+   };
+
+   //! Share of a client in the transmit queue
+   struct client_weight {
+      boost::asio::ip::address address;
+      unsigned weight;
+   };
 
    struct options {
       int ir_pin;
       int button_pin;
       int led_pin;
       code_t button_code;
+      std::optional<code_t> button_double_code;
+      std::optional<code_t> button_long_code;
+      button::config button_config;
+      std::vector<panel_button> panel_buttons;
       std::uint16_t listen_port;
+      std::chrono::seconds keep_alive_timeout;
+      std::chrono::seconds read_timeout;
+      std::chrono::seconds write_timeout;
+      unsigned max_keep_alive_requests;
+      unsigned max_connections;
+      unsigned threads;
+      log::level log_level;
+      unsigned log_rate_limit;
+      bool trace;
+      std::string trace_file;
+      std::string wave_cache;
+      unsigned wave_cache_preload;
+      std::string catalog;
+      unsigned catalog_threads;
+      std::string lirc_db;
+      std::chrono::milliseconds ws_hold_interval;
+      std::uint16_t udp_port;
+      std::string lircd_socket;
+      std::chrono::milliseconds lircd_repeat_interval;
+      std::string shm_socket;
+      std::uint32_t shm_capacity;
+      double rate_limit;
+      unsigned rate_burst;
+      unsigned max_pending_per_client;
+      std::vector<client_weight> client_weights;
+      //! Default time a command may wait for the transmitter, per protocol (0 - forever)
+      std::chrono::milliseconds http_deadline;
+      std::chrono::milliseconds ws_deadline;
+      std::chrono::milliseconds udp_deadline;
+      std::chrono::milliseconds lircd_deadline;
+      std::chrono::milliseconds shm_deadline;
+      unsigned max_scheduled_jobs; //!< 0 - no scheduler
+      unsigned max_subscribers;    //!< Long-lived sessions, on top of max_connections
+      unsigned lircd_socket_mode;  //!< Permission bits of the lircd socket file
+      unsigned shm_socket_mode;    //!< Permission bits of the shared-memory socket file
+      int shm_socket_group;        //!< -1 - the group of the process
+      unsigned max_scheduled_jobs_per_client;
 
       static result_t<options> load(int argc, char **argv);
    };
 
+   //! Application metrics, exported over GET /metrics
+   struct statistics {
+      metrics::histogram request_duration; //!< From a fully read request to a fully written response
+      metrics::histogram queue_wait;       //!< Time spent waiting for the transmitter
+      metrics::histogram wave_build;       //!< Time to encode and upload a wave
+      metrics::histogram on_air;           //!< Time to transmit a wave
+
+      metrics::counter cache_hits;   //!< Transmissions of an already uploaded wave
+      metrics::counter cache_misses; //!< Transmissions that had to build the wave first
+      metrics::gauge cached_waves;       //!< Encoded waves, uploaded or not
+      metrics::gauge uploaded_waves;
+      metrics::gauge dma_control_blocks; //!< DMA control blocks used by the uploaded waves
+      metrics::counter wave_evictions;   //!< Waves released to make room for another one
+      metrics::counter disk_cache_hits;    //!< Waves uploaded from the pulse_cache
+      metrics::counter disk_cache_misses;  //!< Waves encoded because they were not in the pulse_cache
+
+      metrics::gauge ws_sessions;
+      metrics::counter ws_commands;
+      metrics::counter ws_events_dropped;     //!< Events dropped because the client was not reading
+      metrics::histogram ws_command_duration; //!< From a received send command to the end of the transmission
+
+      metrics::counter udp_datagrams;
+      metrics::counter udp_invalid;
+      metrics::counter udp_duplicates; //!< Retransmitted commands, acknowledged but not sent again
+      metrics::counter udp_ack_errors;
+      metrics::histogram udp_dispatch;  //!< From a received datagram to the end of the transmission
+
+      metrics::gauge lircd_clients;
+      metrics::counter lircd_commands;
+
+      metrics::counter shm_clients;    //!< Clients that received the ring
+      metrics::counter shm_commands;
+      metrics::counter shm_invalid;
+      metrics::counter shm_stalled;    //!< Slots skipped because their producer never published them
+      metrics::histogram shm_dispatch; //!< From the submission by the client to the start of the transmission
+
+      metrics::counter events_published;
+      metrics::gauge event_subscribers;
+      metrics::counter event_subscribers_lapped; //!< Subscribers dropped for falling a whole ring behind
+
+      metrics::gauge transmit_queued;      //!< Jobs waiting in the fair queue
+      metrics::gauge transmit_clients;     //!< Clients with jobs waiting in the fair queue
+
+      //! Commands refused because the client exceeded its rate or queue share, per protocol
+      metrics::counter http_rate_limited;
+      metrics::counter ws_rate_limited;
+      metrics::counter udp_rate_limited;
+      metrics::counter lircd_rate_limited;
+      metrics::counter shm_rate_limited;
+
+      //! Commands dropped because they could not start before their deadline, per protocol
+      metrics::counter http_expired;
+      metrics::counter ws_expired;
+      metrics::counter udp_expired;
+      metrics::counter lircd_expired;
+      metrics::counter shm_expired;
+
+      metrics::gauge scheduled_jobs;
+      metrics::counter schedule_runs;
+      metrics::counter schedule_skipped;       //!< Runs skipped because the previous one was still queued
+      metrics::counter schedule_expired;       //!< Runs dropped because they could not start before their deadline
+      metrics::histogram schedule_start_error; //!< From the scheduled time to the actual start of the wave
+
+      metrics::counter button_presses;
+      metrics::counter panel_presses;
+
+      //! Indexed by http_connection::response
+      std::array<metrics::counter, http_connection::num_responses> responses;
+   };
+
 public:
    server(const options &options);
 
 public:
    void run();
 
+   [[nodiscard]] const options &get_options() const { return options_; }
+
+   [[nodiscard]] statistics &stats() { return stats_; }
+
+   //! @return Records for the GET /events subscribers, safe to read from any thread
+   [[nodiscard]] const event_ring &events() const { return events_; }
+
+   //! @return Per-client admission control for the transmitter, safe to use from any thread
+   [[nodiscard]] rate_limiter &limits() { return limits_; }
+
+   //! @return Delayed and periodic transmissions, nullptr if disabled. Safe to use from any thread.
+   [[nodiscard]] scheduler *schedule() { return scheduler_.get(); }
+
+   //! @return Remote database, nullptr if none is configured. Read-only, safe to use from any thread.
+   [[nodiscard]] const lirc_db *remotes() const { return remotes_.get(); }
+
+   //! Append all the metrics to the output in the Prometheus text format. Safe to call from any thread.
+   void write_metrics(std::string &out) const;
+
    void add_necx_wave(code_t code);
 
-   void send_necx_wave(code_t code);
+   void send_necx_wave(code_t code, std::optional<std::chrono::steady_clock::time_point> start = {});
+
+   /**
+    * Send a NECx wave from the transmit strand.
+    * The transmission itself is blocking, but only occupies the control thread, network threads keep serving requests.
+    * The completion handler is invoked with the handler's associated executor.
+    */
+   template <class CompletionToken>
+   auto async_send_necx_wave(code_t code, CompletionToken &&token) {
+      return async_send_necx_wave(client_key::local(), code, 1, fair_queue::no_deadline,
+                                  std::forward<CompletionToken>(token));
+   }
+
+   //! Send a NECx wave count times in a row, without any other transmission in between
+   template <class CompletionToken>
+   auto async_send_necx_wave(code_t code, unsigned count, CompletionToken &&token) {
+      return async_send_necx_wave(client_key::local(), code, count, fair_queue::no_deadline,
+                                  std::forward<CompletionToken>(token));
+   }
+
+   /**
+    * Send a NECx wave count times in a row, queued fairly with the other commands of the client.
+    * If the transmission can't start before the deadline, the command is dropped and completes with
+    * boost::asio::error::timed_out.
+    */
+   template <class CompletionToken>
+   auto async_send_necx_wave(const client_key &client,
+                             code_t code,
+                             unsigned count,
+                             std::chrono::steady_clock::time_point deadline,
+                             CompletionToken &&token) {
+      using signature_t = void(boost::system::error_code);
+      return boost::asio::async_initiate<CompletionToken, signature_t>(
+         [this, client, code, count, deadline](auto handler) {
+            auto ex = boost::asio::get_associated_executor(handler, io_.get_executor());
+            post_transmit(client, count, deadline,
+                          [this, code, count, ex, handler = std::move(handler)](bool expired) mutable {
+                             auto ec = expired ? make_error_code(boost::asio::error::timed_out)
+                                               : try_send_necx_wave(code, count);
+                             boost::asio::post(ex, [ec, handler = std::move(handler)]() mutable { handler(ec); });
+                          });
+         },
+         token);
+   }
+
+   /**
+    * Send a NECx wave count times in a row, starting at the time: the transmitter sleeps until shortly before it and
+    * busy-waits on gpioTick for the rest, so the wave starts within microseconds of it. A start in the past is sent
+    * right away. Queued on the client's flow, completes with boost::asio::error::timed_out after the deadline.
+    */
+   template <class CompletionToken>
+   auto async_send_necx_wave_at(const client_key &client,
+                                code_t code,
+                                unsigned count,
+                                std::chrono::steady_clock::time_point start,
+                                std::chrono::steady_clock::time_point deadline,
+                                CompletionToken &&token) {
+      using signature_t = void(boost::system::error_code);
+      return boost::asio::async_initiate<CompletionToken, signature_t>(
+         [this, client, code, count, start, deadline](auto handler) {
+            auto ex = boost::asio::get_associated_executor(handler, io_.get_executor());
+            post_transmit(client, count, deadline,
+                          [this, code, count, start, ex, handler = std::move(handler)](bool expired) mutable {
+                             auto ec = expired ? make_error_code(boost::asio::error::timed_out)
+                                               : try_send_necx_wave(code, count, start);
+                             boost::asio::post(ex, [ec, handler = std::move(handler)]() mutable { handler(ec); });
+                          });
+         },
+         token);
+   }
+
+   /**
+    * Send a batch of commands from the transmit strand, in a single pass: no other transmission can get in between.
+    * The delays between the commands are waited for on a timer, the control context keeps running meanwhile.
+    * Raw timings of the commands are taken from the timings, the results have to be sized for the commands.
+    * The completion handler is invoked with the handler's associated executor, with boost::asio::error::timed_out if
+    * the batch could not start before the deadline.
+    */
+   template <class CompletionToken>
+   auto async_send_batch(const client_key &client,
+                         std::chrono::steady_clock::time_point deadline,
+                         std::span<const batch::command> commands,
+                         std::span<const std::uint32_t> timings,
+                         std::span<batch::result> results,
+                         CompletionToken &&token) {
+      using signature_t = void(boost::system::error_code);
+      return boost::asio::async_initiate<CompletionToken, signature_t>(
+         [this, client, deadline, commands, timings, results](auto handler) {
+            auto ex = boost::asio::get_associated_executor(handler, io_.get_executor());
+            post_transmit(client, batch::cost(commands), deadline,
+                          [this, commands, timings, results, ex, handler = std::move(handler)](bool expired) mutable {
+                             if (expired) {
+                                boost::asio::post(ex, [handler = std::move(handler)]() mutable {
+                                   handler(make_error_code(boost::asio::error::timed_out));
+                                });
+                                return;
+                             }
+                             continue_batch(commands, timings, results, 0, std::chrono::steady_clock::now(), ex,
+                                            std::move(handler));
+                          });
+         },
+         token);
+   }
+
+   //! @return Deadline of a command received at the time, with the budget of the protocol (0 - no deadline)
+   [[nodiscard]] static std::chrono::steady_clock::time_point deadline_after(std::chrono::steady_clock::time_point time,
+                                                                            std::chrono::milliseconds budget) {
+      return budget.count() > 0 ? time + budget : fair_queue::no_deadline;
+   }
 
 private:
-   void handle_button_press();
-   void do_accept(boost::asio::ip::tcp::acceptor &acceptor, boost::asio::ip::tcp::socket &socket);
+   /**
+    * Network thread: its own io_context, listening socket (bound with SO_REUSEPORT) and connection pool.
+    * Connections never migrate between workers, so none of the HTTP handling needs to be synchronized.
+    */
+   class worker {
+   public:
+      worker(server &server, std::size_t max_connections, std::size_t max_sessions);
+      ~worker();
+
+   public:
+      void listen(std::uint16_t port);
+      void run() { io_.run(); }
+      void stop() { io_.stop(); }
+
+      [[nodiscard]] const http_connection_pool &connections() const { return connections_; }
+      [[nodiscard]] event_hub &events() { return connections_.events(); }
+
+   private:
+      //! Exposes the shutdown of the context, destroying all the handlers it still holds
+      class context : public boost::asio::io_context {
+      public:
+         using io_context::io_context;
+         using io_context::shutdown;
+      };
+
+   private:
+      boost::asio::awaitable<void> accept_loop();
+
+   private:
+      context io_{1};
+      http_connection_pool connections_;
+
+      boost::asio::basic_socket_acceptor<boost::asio::ip::tcp, http_connection::executor_t> acceptor_{io_};
+
+      //! Accepting is suspended on this timer while all the connection objects are in use, releasing a connection
+      //! object cancels the wait.
+      boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+                                        boost::asio::wait_traits<std::chrono::steady_clock>,
+                                        http_connection::executor_t>
+         resume_{io_};
+   };
+
+private:
+   //! Run the function on the transmit strand, on behalf of the server itself
+   template <class Function>
+   void post_transmit(Function &&f) {
+      post_transmit(client_key::local(), 1, fair_queue::no_deadline,
+                    [f = std::forward<Function>(f)](bool) mutable { f(); });
+   }
+
+   /**
+    * Queue the function for the transmitter, accounting for the time it spent in the queue.
+    * The job goes into the fair queue right away, from the calling thread; the transmit strand only runs the jobs.
+    * The function is called with true instead if the job did not get to the transmitter before the deadline.
+    */
+   template <class Function>
+   void post_transmit(const client_key &client,
+                      unsigned cost,
+                      std::chrono::steady_clock::time_point deadline,
+                      Function &&f) {
+      const auto idle = transmit_queue_.push(
+         client, client_weight_of(client), cost, deadline,
+         [this, queued = std::chrono::steady_clock::now(), f = std::forward<Function>(f)](bool expired) mutable {
+            const auto now = std::chrono::steady_clock::now();
+            stats_.queue_wait.record(now - queued);
+            if (trace::enabled()) {
+               trace::record(expired ? "transmit.expired" : "transmit.queue", queued, now);
+            }
+            f(expired);
+         });
+
+      if (idle) {
+         boost::asio::post(transmit_strand_, [this] { dispatch_transmit(); });
+      }
+   }
+
+   //! Transmit strand: run the next job of the fair queue, unless a batch holds the transmitter
+   void dispatch_transmit();
+
+   /**
+    * Transmit strand: send the batch from the first command on. At a delay the batch keeps the transmitter, but
+    * returns to the control context: the batch timer continues with the rest.
+    */
+   template <class Executor, class Handler>
+   void continue_batch(std::span<const batch::command> commands,
+                       std::span<const std::uint32_t> timings,
+                       std::span<batch::result> results,
+                       std::size_t first,
+                       std::chrono::steady_clock::time_point started,
+                       Executor ex,
+                       Handler handler) {
+      const auto next = send_batch(commands, timings, results, first);
+      if (next == commands.size()) {
+         finish_batch(commands, results, started);
+         boost::asio::post(ex, [handler = std::move(handler)]() mutable { handler(boost::system::error_code{}); });
+         return;
+      }
+
+      transmitter_held_ = true;
+      batch_timer_.expires_after(commands[next - 1].delay);
+      batch_timer_.async_wait([this, commands, timings, results, next, started, ex, handler = std::move(handler)](
+                                 boost::system::error_code ec) mutable {
+         if (!ec) {
+            continue_batch(commands, timings, results, next, started, ex, std::move(handler));
+            return;
+         }
+
+         for (auto i = next; i < results.size(); ++i) {
+            results[i].state = batch::status::failed;
+         }
+         finish_batch(commands, results, started);
+         boost::asio::post(ex, [ec, handler = std::move(handler)]() mutable { handler(ec); });
+      });
+   }
+
+   //! Transmit strand: account for a finished batch and hand the transmitter back to the fair queue
+   void finish_batch(std::span<const batch::command> commands,
+                     std::span<const batch::result> results,
+                     std::chrono::steady_clock::time_point started);
+
+   [[nodiscard]] unsigned client_weight_of(const client_key &client) const;
+
+   //! @param start Scheduled start of the first transmission, nothing to send right away
+   boost::system::error_code try_send_necx_wave(code_t code,
+                                                unsigned count,
+                                                std::optional<std::chrono::steady_clock::time_point> start = {});
+   /**
+    * Send the commands of a batch from the first one on, up to the next delay.
+    * @return Index of the command to continue with once the delay is over, the number of commands when done
+    */
+   std::size_t send_batch(std::span<const batch::command> commands,
+                          std::span<const std::uint32_t> timings,
+                          std::span<batch::result> results,
+                          std::size_t first);
+
+   /**
+    * Upload, send and release a one-off raw wave, evicting the cached waves as needed.
+    * @return too_long without uploading anything if the wave could never fit into pigpio's control blocks
+    */
+   batch::status transmit_raw(const batch::command &c, std::span<const std::uint32_t> timings, std::size_t index);
+
+   void preload_waves();
+   void save_waves();
+   void load_catalog();
+
+   //! Encode (or copy from the wave cache) and upload a wave. @return False if the wave could not be uploaded.
+   bool build_wave(code_t code, bool evict);
+
+   /**
+    * Upload the wave, optionally releasing the least recently used other waves if pigpio runs out of resources.
+    * @return False if the wave could not be uploaded.
+    */
+   bool upload_wave(wave &w, bool evict);
+   bool evict_wave(const wave *keep);
+
+   //! Delete the wave from pigpio, accounting for the freed resources
+   void release_wave(wave &w);
+
+   //! Publish a server-sent event and wake the subscribers, from the transmit strand
+   void publish_event(std::string_view event, std::string_view data);
+
+   void handle_button(button::gesture g);
+   void handle_panel_button(int pin);
+   void send_button_code(const char *name, code_t code);
+   //! Send the wave, publishing the transmit_start and transmit_finish events around it
+   void transmit(code_t code, std::optional<std::chrono::steady_clock::time_point> start = {});
+   //! Send the wave, at the start if there is one
+   void transmit_wave(code_t code, std::optional<std::chrono::steady_clock::time_point> start);
 
 private:
    options options_;
+   statistics stats_{};
+
+   //! Declared before the control context: jobs still queued for the transmitter at shutdown hold coroutines of the
+   //! network threads, so the workers have to outlive both the context and the fair queue
+   std::vector<std::unique_ptr<worker>> workers_{};
+
+   //! Control context: signal handling, button events and transmissions
+   boost::asio::io_context io_{};
+
+   //! Serializes access to the shared transmitter state: waves_ and led_
+   boost::asio::strand<boost::asio::io_context::executor_type> transmit_strand_{io_.get_executor()};
+   fair_queue transmit_queue_{};
+
+   //! A batch waiting for its next command keeps the transmitter: the dispatcher is deferred until it is done
+   boost::asio::steady_timer batch_timer_{transmit_strand_};
+   bool transmitter_held_{false};
+   bool dispatch_deferred_{false};
+   std::unordered_map<client_key, unsigned, client_key_hash> client_weights_{};
+   rate_limiter limits_;
 
    led led_;
    button button_;
+   //! A hold repeat of the button is waiting for the transmitter, the next ones are skipped until it is sent
+   std::atomic<bool> hold_pending_{false};
+   std::unique_ptr<button_bank> panel_;
    wave_list_t waves_;
-
-   boost::asio::io_context io_{};
+   std::uint64_t use_clock_{0};
+   std::unique_ptr<pulse_cache> cache_;
+   std::unique_ptr<lirc_db> remotes_;
+   event_ring events_{};
+   std::unique_ptr<udp_listener> udp_;
+   std::unique_ptr<lircd_server> lircd_;
+   std::unique_ptr<shm_listener> shm_;
+   std::unique_ptr<scheduler> scheduler_;
 };
 
 } // namespace ir
@@ -0,0 +1,58 @@
+/**
+ * @file   shm_client.h
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ */
+#ifndef INCLUDE_IR_SHM_CLIENT_H
+#define INCLUDE_IR_SHM_CLIENT_H
+
+#include <ir/shm_ring.h>
+#include <ir/util.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace ir {
+
+/**
+ * Client library for the shared-memory command ring of ir-ctrl (--shm-socket), for processes running on the same
+ * machine. Submitting a command is a memory write, plus an eventfd write if ir-ctrl is idle.
+ *
+ * The ring and the doorbell are handed out over the Unix socket, access is controlled by its file permissions.
+ * A client may be used from multiple threads.
+ */
+class shm_client {
+public:
+   //! Connect to the ir-ctrl socket and map the ring
+   static result_t<shm_client> connect(const std::string &socket_path);
+
+   shm_client(shm_client &&other) noexcept;
+   shm_client &operator=(shm_client &&other) noexcept;
+   ~shm_client();
+
+   shm_client(const shm_client &) = delete;
+   shm_client &operator=(const shm_client &) = delete;
+
+public:
+   /**
+    * Queue a NECx code.
+    * @param repeat Number of additional transmissions.
+    * @return Ticket of the command, or nothing if the ring is full.
+    */
+   std::optional<std::uint32_t> submit(std::uint32_t code, std::uint8_t repeat = 0);
+
+   //! @return True once the command was transmitted (or rejected)
+   [[nodiscard]] bool done(std::uint32_t ticket) const { return ring_.done(ticket); }
+
+private:
+   shm_client(shm_ring ring, int doorbell);
+
+private:
+   shm_ring ring_;
+   int doorbell_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_SHM_CLIENT_H */
@@ -0,0 +1,76 @@
+/**
+ * @file   shm_listener.h
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ */
+#ifndef INCLUDE_IR_SHM_LISTENER_H
+#define INCLUDE_IR_SHM_LISTENER_H
+
+#include <ir/shm_ring.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <boost/asio.hpp>
+
+namespace ir {
+
+class server;
+
+/**
+ * Consumer of the shared-memory command ring (see shm_ring and shm_client).
+ * Clients connect to the Unix socket to receive the ring's memfd and the doorbell eventfd, commands are then taken
+ * from the ring in order, one transmission at a time: a full ring is the back-pressure for the clients.
+ */
+class shm_listener {
+public:
+   using executor_t = boost::asio::io_context::executor_type;
+   using protocol_t = boost::asio::local::stream_protocol;
+
+   static constexpr unsigned max_repeat = 20;
+
+   //! A slot claimed by a producer for this long without being published is skipped
+   static constexpr std::chrono::milliseconds stall_timeout{500};
+   static constexpr std::chrono::milliseconds stall_poll_interval{1};
+
+public:
+   //! @throws std::system_error if the ring or the doorbell can't be created
+   shm_listener(server &server, boost::asio::io_context &io, std::uint32_t capacity);
+
+   shm_listener(const shm_listener &) = delete;
+   shm_listener &operator=(const shm_listener &) = delete;
+
+public:
+   /**
+    * Bind the socket, replacing a stale socket file, and start consuming the ring. Any other file at the path is left
+    * alone and fails the call.
+    * @param mode Permission bits of the socket file
+    * @param group Group of the socket file, -1 - the group of the process
+    */
+   void listen(const std::string &path, unsigned mode, int group);
+
+   //! Close the socket and remove the socket file
+   void stop();
+
+private:
+   boost::asio::awaitable<void> accept_loop();
+   boost::asio::awaitable<void> consume_loop();
+
+private:
+   server *server_;
+   shm_ring ring_;
+   boost::asio::posix::basic_stream_descriptor<executor_t> doorbell_;
+   std::uint64_t doorbell_value_{0};
+   boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+                                     boost::asio::wait_traits<std::chrono::steady_clock>,
+                                     executor_t>
+      stall_timer_;
+
+   boost::asio::basic_socket_acceptor<protocol_t, executor_t> acceptor_;
+   std::string path_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_SHM_LISTENER_H */
@@ -0,0 +1,137 @@
+/**
+ * @file   shm_ring.h
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ */
+#ifndef INCLUDE_IR_SHM_RING_H
+#define INCLUDE_IR_SHM_RING_H
+
+#include <ir/util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace ir {
+
+//! Fixed-size command record of the shared-memory ring
+struct shm_command {
+   std::uint64_t submitted_ns; //!< steady_clock time of the submission, for the dispatch latency
+   std::uint32_t code;
+   std::uint8_t protocol; //!< 0 - NECx
+   std::uint8_t repeat;   //!< Number of additional transmissions
+   std::uint16_t reserved;
+};
+
+/**
+ * Bounded multi-producer/single-consumer command ring in a sealed memfd, shared between ir-ctrl (the consumer) and
+ * trusted local processes (the producers).
+ *
+ * Each slot carries a sequence number telling its state (Vyukov's bounded queue): producers claim a position with a
+ * CAS on the shared tail and publish the slot by advancing its sequence, the consumer keeps its position to itself.
+ * The memfd is sealed against resizing, so a client can corrupt the commands, but not crash the server.
+ *
+ * The consumer announces when it is about to sleep, producers only ring the doorbell (an eventfd, kept by the
+ * users of the ring) in that case, so a busy server handles the commands without any system calls.
+ *
+ * A producer dying between claiming a position and publishing its slot would stall the consumer for good, so the
+ * consumer skips such a slot after a while (see skip()); publishing fails for a producer that was merely too slow.
+ *
+ * Commands are handled in the order of their positions: a command with position (ticket) N is done once the
+ * completion counter is above N. Positions are 32 bit and compared with wrap-around, 64-bit atomics are not
+ * lock-free (and thus not usable across processes) on every Raspberry Pi.
+ */
+class shm_ring {
+public:
+   static constexpr std::uint32_t version = 1;
+   static constexpr std::uint32_t max_capacity = 65536;
+
+public:
+   //! Create a new ring in a memfd
+   static result_t<shm_ring> create(std::uint32_t capacity);
+
+   //! Map the ring of the memfd, taking over the descriptor
+   static result_t<shm_ring> attach(int fd);
+
+   shm_ring(shm_ring &&other) noexcept;
+   shm_ring &operator=(shm_ring &&other) noexcept;
+   ~shm_ring();
+
+   shm_ring(const shm_ring &) = delete;
+   shm_ring &operator=(const shm_ring &) = delete;
+
+public:
+   /**
+    * Producer: add a command, claim() followed by publish().
+    * @return Ticket of the command, or nothing if the ring is full.
+    */
+   std::optional<std::uint32_t> try_push(const shm_command &command);
+
+   //! Producer: claim the next position. @return Its ticket, or nothing if the ring is full.
+   std::optional<std::uint32_t> claim();
+
+   /**
+    * Producer: fill the claimed slot and hand it to the consumer.
+    * @return False if the consumer skipped the slot for taking too long, the command is dropped then.
+    */
+   bool publish(std::uint32_t ticket, const shm_command &command);
+
+   //! Producer: @return True if the doorbell has to be rung after a push
+   [[nodiscard]] bool consumer_sleeping() const;
+
+   //! Producer: @return True once the command with the ticket was handled
+   [[nodiscard]] bool done(std::uint32_t ticket) const;
+
+   //! Consumer: take the next command. @return False if there is none.
+   bool try_pop(shm_command &command);
+
+   //! Consumer: mark the oldest pending command as handled
+   void complete();
+
+   //! Consumer: @return True if the next position is claimed by a producer, but not published yet
+   [[nodiscard]] bool claimed() const;
+
+   /**
+    * Consumer: give up on the claimed slot at the next position, for a producer that died (or stalled) between
+    * claiming and publishing it. The slot goes back to the producers, and has to be completed like a popped command.
+    * @return False if it was published in the meantime.
+    */
+   bool skip();
+
+   /**
+    * Consumer: announce sleeping on the doorbell.
+    * @return False if a command was pushed in the meantime, the consumer has to keep on popping then.
+    */
+   bool prepare_sleep();
+
+   //! Consumer: woken up by the doorbell
+   void wake_up();
+
+   [[nodiscard]] int fd() const { return fd_; }
+   [[nodiscard]] std::uint32_t capacity() const { return capacity_; }
+
+private:
+   struct header;
+   struct slot;
+
+private:
+   shm_ring(int fd, void *mapping, std::size_t size);
+
+   [[nodiscard]] header &get_header() const;
+   [[nodiscard]] slot &get_slot(std::uint32_t position) const;
+
+   static std::size_t mapping_size(std::uint32_t capacity);
+
+private:
+   int fd_{-1};
+   void *mapping_{nullptr};
+   std::size_t mapping_size_{0};
+   std::uint32_t capacity_{0};
+
+   //! Consumer position, only known to the consumer
+   std::uint32_t head_{0};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_SHM_RING_H */
@@ -0,0 +1,62 @@
+/**
+ * @file   spsc_ring.h
+ * @author Dennis Sitelew
+ * @date   Dec. 04, 2021
+ */
+#ifndef INCLUDE_IR_SPSC_RING_H
+#define INCLUDE_IR_SPSC_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace ir {
+
+/**
+ * Wait-free single-producer/single-consumer ring buffer.
+ * Both push and pop complete in a bounded number of steps and never allocate, which makes the ring safe to use from
+ * the callbacks of foreign threads (e.g. the pigpio alert thread).
+ *
+ * @tparam T Element type, should be trivially copyable.
+ * @tparam Capacity Number of slots, has to be a power of two.
+ */
+template <class T, std::size_t Capacity>
+class spsc_ring {
+   static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+   //! @return false if the ring is full (the element is dropped).
+   bool try_push(const T &value) {
+      const auto head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) == Capacity) {
+         return false;
+      }
+
+      slots_[head & (Capacity - 1)] = value;
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+   }
+
+   std::optional<T> try_pop() {
+      const auto tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head_.load(std::memory_order_acquire)) {
+         return std::nullopt;
+      }
+
+      T result = slots_[tail & (Capacity - 1)];
+      tail_.store(tail + 1, std::memory_order_release);
+      return result;
+   }
+
+private:
+   static constexpr std::size_t cache_line = 64;
+
+   alignas(cache_line) std::atomic<std::size_t> head_{0}; //!< Next slot to write, owned by the producer
+   alignas(cache_line) std::atomic<std::size_t> tail_{0}; //!< Next slot to read, owned by the consumer
+   alignas(cache_line) std::array<T, Capacity> slots_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_SPSC_RING_H */
@@ -0,0 +1,127 @@
+/**
+ * @file   timer_wheel.h
+ * @author Dennis Sitelew
+ * @date   Dec. 27, 2021
+ */
+#ifndef INCLUDE_IR_TIMER_WHEEL_H
+#define INCLUDE_IR_TIMER_WHEEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace ir {
+
+/**
+ * Hierarchical timing wheel: any number of timers, inserted and cancelled in constant time.
+ *
+ * Four levels of 256 slots each, time is counted in ticks (the owner decides what a tick is). A timer is kept on the
+ * level of the highest 8-bit digit where its expiry differs from the current time, in the slot of that digit. As time
+ * advances and reaches a slot of a higher level, its timers are redistributed to the lower levels ("cascading"), so a
+ * timer moves at most three times before it fires. Timers that differ from the current time above the 32 bits the
+ * levels cover wait in an overflow list until the current time crosses the next 2^32 boundary.
+ *
+ * Slots are intrusive lists of the timers, each level has an occupancy bitmap: the next slot to be processed is found
+ * without scanning, so the owner only has to wake up for the next expiry (or cascade) instead of every tick.
+ * Not thread-safe.
+ */
+class timer_wheel {
+public:
+   static constexpr unsigned level_bits = 8;
+   static constexpr unsigned num_levels = 4;
+   static constexpr std::size_t num_slots = std::size_t{1} << level_bits;
+
+   //! Intrusive hook, embedded into the timer objects
+   struct entry {
+      entry *prev{nullptr};
+      entry *next{nullptr};
+      std::uint64_t expiry{0};
+      std::uint32_t slot{0};
+
+      [[nodiscard]] bool linked() const { return next != nullptr; }
+   };
+
+public:
+   explicit timer_wheel(std::uint64_t now = 0);
+
+   timer_wheel(const timer_wheel &) = delete;
+   timer_wheel &operator=(const timer_wheel &) = delete;
+
+public:
+   //! Schedule the timer for the tick. A timer that is already due fires on the next advance.
+   void insert(entry &e, std::uint64_t expiry);
+
+   //! Cancel a linked timer
+   void remove(entry &e);
+
+   /**
+    * Fire all the timers due by the tick, in the order of their expiry (timers of the same tick in no particular
+    * order). Each timer is unlinked before the handler is called, the handler may insert it (or any other) again.
+    */
+   template <class Handler>
+   void advance(std::uint64_t to, Handler &&on_expired) {
+      while (size_) {
+         const auto next = next_event();
+         if (next > to) {
+            break;
+         }
+
+         now_ = next;
+         cascade();
+
+         // The slot is detached first: a timer inserted again for the current tick fires on the next iteration
+         entry due;
+         take_slot(now_ & (num_slots - 1), due);
+         while (due.next != &due) {
+            auto &e = *due.next;
+            unlink(e);
+            on_expired(e);
+         }
+      }
+
+      if (to > now_) {
+         now_ = to;
+      }
+   }
+
+   //! @return Tick to call advance at: the next expiry or cascade, nothing if there are no timers
+   [[nodiscard]] std::optional<std::uint64_t> next_expiry() const;
+
+   [[nodiscard]] std::uint64_t now() const { return now_; }
+   [[nodiscard]] std::size_t size() const { return size_; }
+   [[nodiscard]] bool empty() const { return size_ == 0; }
+
+private:
+   static constexpr std::uint32_t overflow_slot = num_levels * num_slots;
+   static constexpr unsigned words_per_level = num_slots / 64;
+
+private:
+   //! @return Next tick where a slot is to be processed, the current one if its level 0 slot is occupied
+   [[nodiscard]] std::uint64_t next_event() const;
+
+   //! @return First occupied slot of the level at or after the index, num_slots if there is none
+   [[nodiscard]] std::size_t find_occupied(unsigned level, std::size_t from) const;
+
+   void place(entry &e);
+   void link(entry &e, std::uint32_t slot);
+   void unlink(entry &e);
+
+   //! Move all the timers of the slot into the list, the slot is left empty
+   void take_slot(std::uint32_t slot, entry &list);
+
+   //! Redistribute the slots reached by the current tick (overflow included) to the lower levels
+   void cascade();
+
+private:
+   std::uint64_t now_;
+   std::size_t size_{0};
+
+   //! List heads of all the slots and the overflow list, circular with the head as the sentinel
+   std::array<entry, overflow_slot + 1> heads_{};
+   std::array<std::array<std::uint64_t, words_per_level>, num_levels> occupied_{};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_TIMER_WHEEL_H */
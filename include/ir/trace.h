@@ -0,0 +1,87 @@
+/**
+ * @file   trace.h
+ * @author Dennis Sitelew
+ * @date   Dec. 13, 2021
+ */
+#ifndef INCLUDE_IR_TRACE_H
+#define INCLUDE_IR_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace ir::trace {
+
+using clock_t = std::chrono::steady_clock;
+
+namespace detail {
+inline std::atomic<bool> enabled{false};
+} // namespace detail
+
+//! Start or stop recording spans
+inline void enable(bool on) {
+   detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+[[nodiscard]] inline bool enabled() {
+   return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Record a completed span into the flight recorder.
+ * The recorder is a fixed-size ring, shared by all threads: recording never locks or allocates, the oldest spans are
+ * overwritten once the ring is full.
+ *
+ * @param name Span name, has to be a string literal (only the pointer is recorded) without any JSON special characters.
+ * @param arg Optional span argument (IR code, number of bytes, ...), exported as args.arg.
+ */
+void record(const char *name, clock_t::time_point begin, clock_t::time_point end, std::uint64_t arg = 0);
+
+/**
+ * Scoped span: records the time between its construction and destruction.
+ * A disabled recorder costs a single relaxed load.
+ */
+class span {
+public:
+   explicit span(const char *name, std::uint64_t arg = 0)
+      : name_{enabled() ? name : nullptr}
+      , arg_{arg} {
+      if (name_) {
+         begin_ = clock_t::now();
+      }
+   }
+
+   ~span() {
+      if (name_) {
+         record(name_, begin_, clock_t::now(), arg_);
+      }
+   }
+
+   span(const span &) = delete;
+   span &operator=(const span &) = delete;
+
+   void set_arg(std::uint64_t arg) { arg_ = arg; }
+
+private:
+   const char *name_;
+   std::uint64_t arg_;
+   clock_t::time_point begin_{};
+};
+
+//! Append the recorded spans to the output as Chrome trace JSON (chrome://tracing, Perfetto)
+void write_chrome_trace(std::string &out);
+
+/**
+ * Dump the recorded spans as Chrome trace JSON into the file on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT.
+ * The signal is passed on to the handler installed before (pigpio's), or to the default disposition, afterwards.
+ * The file is replaced, never followed if it is a link. Also installs the signal stack of the calling thread.
+ */
+void install_crash_handler(const std::string &path);
+
+//! Alternate signal stack for the calling thread, so that the crash handler also runs on a stack overflow
+void install_signal_stack();
+
+} // namespace ir::trace
+
+#endif /* INCLUDE_IR_TRACE_H */
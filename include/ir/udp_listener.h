@@ -0,0 +1,106 @@
+/**
+ * @file   udp_listener.h
+ * @author Dennis Sitelew
+ * @date   Dec. 21, 2021
+ */
+#ifndef INCLUDE_IR_UDP_LISTENER_H
+#define INCLUDE_IR_UDP_LISTENER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <boost/asio.hpp>
+
+namespace ir {
+
+class server;
+
+/**
+ * Single-datagram command protocol for sensors and microcontrollers on the local network: no connection state, one
+ * packet per command.
+ *
+ * Command, 8 or 12 bytes, little-endian:
+ *    flags (u8)     - bit 0: reply with an ack once the command was transmitted
+ *    protocol (u8)  - 0: NECx
+ *    repeat (u8)    - number of additional transmissions, up to max_repeat
+ *    reserved (u8)
+ *    code (u32)
+ *    sequence (u32) - optional: a command repeating the sequence number of a recent command from the same sender
+ *                     is acknowledged, but not transmitted again
+ *
+ * Ack, 8 bytes: status (u8, see status), 3 reserved bytes and the sequence number of the command (u32).
+ */
+class udp_listener {
+public:
+   using udp = boost::asio::ip::udp;
+   using socket_t = boost::asio::basic_datagram_socket<udp, boost::asio::io_context::executor_type>;
+
+   static constexpr unsigned max_repeat = 20;
+   static constexpr std::size_t dedup_size = 64;
+   static constexpr std::chrono::seconds dedup_window{5};
+
+   enum class status : std::uint8_t {
+      ok = 0,
+      failed = 1,
+      invalid = 2,
+      duplicate = 3,
+      expired = 4,      //!< Dropped, the transmission could not start before the --udp-deadline
+      rate_limited = 5, //!< Refused, over the sender's share (--rate-limit, --max-pending-per-client)
+   };
+
+public:
+   udp_listener(server &server, boost::asio::io_context &io);
+
+   udp_listener(const udp_listener &) = delete;
+   udp_listener &operator=(const udp_listener &) = delete;
+
+public:
+   void listen(std::uint16_t port);
+   void stop();
+
+private:
+   struct command {
+      bool ack;
+      std::uint8_t protocol;
+      std::uint8_t repeat;
+      std::uint32_t code;
+      std::optional<std::uint32_t> sequence;
+   };
+
+   //! Recently seen sequence number
+   struct seen {
+      udp::endpoint sender;
+      std::uint32_t sequence;
+      std::chrono::steady_clock::time_point received;
+   };
+
+private:
+   boost::asio::awaitable<void> receive_loop();
+
+   static std::optional<command> parse(const unsigned char *data, std::size_t size);
+
+   //! @return True if the sequence number was seen recently
+   [[nodiscard]] bool is_duplicate(const udp::endpoint &sender,
+                                   std::uint32_t sequence,
+                                   std::chrono::steady_clock::time_point now) const;
+
+   //! Record the sequence number of an admitted command: a refused one may be retried
+   void remember(const udp::endpoint &sender, std::uint32_t sequence, std::chrono::steady_clock::time_point now);
+
+   void reply(const udp::endpoint &to, status s, std::uint32_t sequence);
+
+private:
+   server *server_;
+   socket_t socket_;
+   std::array<unsigned char, 16> buffer_{};
+
+   std::array<seen, dedup_size> seen_{};
+   std::size_t seen_next_{0};
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_UDP_LISTENER_H */
@@ -0,0 +1,85 @@
+/**
+ * @file   uri.h
+ * @author Dennis Sitelew
+ * @date   Nov. 27, 2021
+ */
+#ifndef INCLUDE_IR_URI_H
+#define INCLUDE_IR_URI_H
+
+#include <ir/util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace ir {
+
+/**
+ * Allocation-free URI helpers.
+ *
+ * Query parameters are yielded as views into the original request target, percent-decoding is only done when
+ * the caller explicitly asks for it (most values, e.g. IR codes, never contain escaped characters).
+ */
+class uri {
+public:
+   struct query_param {
+      std::string_view key;
+      std::string_view value;
+   };
+
+   //! Single-pass forward iterator over the "key=value&key=value" query string
+   class query_iterator {
+   public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = query_param;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const query_param *;
+      using reference = const query_param &;
+
+   public:
+      query_iterator() = default;
+      explicit query_iterator(std::string_view text);
+
+   public:
+      reference operator*() const { return current_; }
+      pointer operator->() const { return &current_; }
+
+      query_iterator &operator++();
+      query_iterator operator++(int);
+
+      bool operator==(const query_iterator &o) const { return at_end_ == o.at_end_ && rest_.data() == o.rest_.data(); }
+      bool operator!=(const query_iterator &o) const { return !(*this == o); }
+
+   private:
+      void advance();
+
+   private:
+      std::string_view rest_{};
+      query_param current_{};
+      bool at_end_{true};
+   };
+
+   class query_range {
+   public:
+      explicit query_range(std::string_view text)
+         : text_{text} {}
+
+      [[nodiscard]] query_iterator begin() const { return query_iterator{text_}; }
+      [[nodiscard]] query_iterator end() const { return {}; }
+
+   private:
+      std::string_view text_;
+   };
+
+public:
+   static query_range get_query_params(std::string_view text) { return query_range{text}; }
+
+   static result_t<std::string_view> decode(std::string_view text, char *buffer, std::size_t size);
+
+   static result_t<std::uint32_t> parse_code(std::string_view text);
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_URI_H */
@@ -7,7 +7,11 @@
 #define INCLUDE_IR_WAVE_H
 
 #include <chrono>
+#include <cstdint>
 #include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include <pigpio.h>
@@ -62,6 +66,22 @@ public:
       std::optional<duration_t> trailing_pulse;
    };
 
+   //! Identifies an encoded wave: same key - same pulse train
+   struct key {
+      std::uint32_t protocol;   //!< FNV-1a of the protocol name
+      std::uint32_t parameters; //!< Fingerprint of the wave_parameters
+      std::int32_t pin;
+      std::uint32_t code;
+
+      bool operator==(const key &) const = default;
+   };
+
+   struct key_hash {
+      std::size_t operator()(const key &k) const noexcept;
+   };
+
+   static key make_key(std::string_view protocol, const wave_parameters &parameters, int pin, std::uint32_t code);
+
 private:
    //! Stores internal information related to the carrier frequency and provides some convenience functionality
    struct carrier_parameters {
@@ -78,13 +98,45 @@ public:
    wave(int pin_number, wave_parameters parameters);
    virtual ~wave();
 
-   wave(const wave &) = default;
-   wave(wave &&) = default;
+   wave(const wave &) = delete;
+   wave(wave &&) = delete;
 
 public:
+   /**
+    * Upload the encoded wave to pigpio.
+    * @return False if pigpio is out of DMA control blocks or wave identifiers - other waves have to be released first.
+    * @throws std::runtime_error on any other failure.
+    */
+   bool try_upload();
+
+   //! Delete the wave from pigpio, freeing its DMA control blocks. The encoding is kept for a later upload.
+   void release();
+
+   [[nodiscard]] bool uploaded() const { return wave_id_ != PI_NO_WAVEFORM_ID; }
+
+   //! Send the uploaded wave
    virtual void send();
+
+   /**
+    * Send the uploaded wave, busy-waiting for the gpioTick to start it at. The wait has to be short, the caller is
+    * expected to sleep through most of it.
+    * @return gpioTick the transmission was started at
+    */
+   std::uint32_t send_at(std::uint32_t start_tick);
    virtual std::string name() const = 0;
 
+   //! @return Lower bound of the DMA control blocks the wave takes once uploaded: one per GPIO change, one per delay
+   [[nodiscard]] std::size_t min_control_blocks() const;
+
+   //! @return Number of DMA control blocks used by the wave, 0 if it is not uploaded
+   [[nodiscard]] int control_blocks() const { return control_blocks_; }
+
+   //! @return Number of times the wave was sent
+   [[nodiscard]] std::uint64_t sent_count() const { return sent_count_; }
+
+   //! @return Encoded pulse train
+   [[nodiscard]] std::span<const gpioPulse_t> pulses() const { return wave_; }
+
 protected:
    void add_carrier_frequency(duration_t duration);
    void add_gap(duration_t duration);
@@ -93,7 +145,11 @@ protected:
 
    virtual void add_payload() = 0;
 
-   void build();
+   //! Encode the wave. Only touches the wave itself, so different waves can be encoded in parallel.
+   void encode();
+
+   //! Use a previously encoded pulse train (e.g. from the pulse_cache) instead of encoding it
+   void assign(std::span<const gpioPulse_t> pulses);
 
 private:
    //! The pigpio uses bit masks for pin state manipulations.
@@ -104,6 +160,8 @@ private:
 
    //! pigpio wave identifier
    int wave_id_{PI_NO_WAVEFORM_ID};
+   int control_blocks_{0};
+   std::uint64_t sent_count_{0};
 
    //! Wave encoding as a sequence of GPIO operations
    std::vector<gpioPulse_t> wave_{};
@@ -0,0 +1,129 @@
+/**
+ * @file   ws_session.h
+ * @author Dennis Sitelew
+ * @date   Dec. 20, 2021
+ */
+#ifndef INCLUDE_IR_WS_SESSION_H
+#define INCLUDE_IR_WS_SESSION_H
+
+#include <ir/handler_memory.h>
+#include <ir/http_connection.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+namespace ir {
+
+class server;
+
+/**
+ * WebSocket control channel, upgraded from an HTTP connection to /ws.
+ * Saves the connection setup and the request parsing for each command, e.g. when scrolling through the channels.
+ *
+ * Commands, as text frames:
+ *    send CODE [ID]  - send the code once
+ *    hold CODE [ID]  - send the code repeatedly, until released (or replaced by another hold)
+ *    release [ID]    - stop the hold
+ * or as binary frames of 9 bytes: operation (1 - send, 2 - hold, 3 - release), ID and CODE as little-endian uint32.
+ *
+ * Each transmission (each repeat of a hold as well) is followed by a "sent" event, the end of a hold by a "released"
+ * event, and an invalid command by an "error" event. Events use the frame type of the command they belong to:
+ *    {"event":"sent","id":1,"code":529287,"status":"ok","duration_us":53412}
+ * or 14 bytes: event (1 - sent, 2 - released, 3 - error), status (0 - ok, 1 - failed, 2 - expired, 3 - rate_limited),
+ * ID, CODE and the duration in µs as little-endian uint32. A command that could not start before the --ws-deadline is
+ * "expired", a command over the client's rate or queue share (--rate-limit, --max-pending-per-client) is
+ * "rate_limited" and not sent at all.
+ */
+class ws_session {
+public:
+   using stream_t = http_connection::stream_t;
+   using request_t = http_connection::parser_t::value_type;
+
+   static constexpr std::size_t max_frame_size = 64;
+   static constexpr std::size_t queue_size = 32;
+
+public:
+   ws_session(server &server, stream_t &stream, const client_key &client);
+
+   ws_session(const ws_session &) = delete;
+   ws_session &operator=(const ws_session &) = delete;
+
+public:
+   //! Accept the upgrade request and serve the session until it is closed
+   boost::asio::awaitable<void> run(const request_t &request);
+
+private:
+   enum class operation : std::uint8_t { send = 1, hold = 2, release = 3 };
+   enum class event_type : std::uint8_t { sent = 1, released = 2, error = 3 };
+   enum class event_status : std::uint8_t { ok = 0, failed = 1, expired = 2, rate_limited = 3 };
+
+   struct command {
+      operation op;
+      std::uint32_t id;
+      std::uint32_t code;
+      bool binary;
+   };
+
+   struct event {
+      std::array<char, 128> data;
+      std::size_t size;
+      bool binary;
+   };
+
+   using timer_t = boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+                                                     boost::asio::wait_traits<std::chrono::steady_clock>,
+                                                     http_connection::executor_t>;
+
+private:
+   std::optional<command> parse(bool binary) const;
+
+   boost::asio::awaitable<void> send(command c, std::chrono::steady_clock::time_point received);
+   boost::asio::awaitable<void> hold_loop();
+   boost::asio::awaitable<void> write_loop();
+
+   void push_event(event_type type, event_status status, const command &c, std::chrono::microseconds duration);
+
+   //! @return Status of a sent command, accounting for the expired ones
+   event_status sent_status(boost::system::error_code ec);
+
+   //! Run a task next to the read loop, the session only ends once all of them have finished
+   void spawn(boost::asio::awaitable<void> task);
+
+private:
+   server *server_;
+   const client_key client_;
+   boost::beast::websocket::stream<stream_t &> ws_;
+   boost::beast::flat_static_buffer<max_frame_size> buffer_{};
+
+   //! Memory for the operations of the read loop, the hold loop and the write loop, each has one in flight at most
+   handler_memory read_memory_{};
+   handler_memory hold_memory_{};
+   handler_memory write_memory_{};
+
+   //! Current hold, the hold loop picks up a new code with the next repeat
+   command hold_{};
+   bool holding_{false};
+   bool hold_running_{false};
+   timer_t hold_timer_;
+
+   //! Events waiting to be written, the write loop sleeps on the wakeup timer while the queue is empty
+   std::array<event, queue_size> events_{};
+   std::size_t events_head_{0};
+   std::size_t events_count_{0};
+   timer_t write_wakeup_;
+
+   std::size_t tasks_{0};
+   bool closing_{false};
+   timer_t tasks_done_;
+};
+
+} // namespace ir
+
+#endif /* INCLUDE_IR_WS_SESSION_H */
@@ -0,0 +1,191 @@
+/**
+ * @file   alloc_check.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 28, 2021
+ *
+ * Allocations per HTTP request of a running ir-ctrl, from its ir_heap_allocations_total metric: sends the request
+ * over a keep-alive connection many times in a row and reads the metric before and after. The metric is only there if
+ * ir-ctrl was built with -DIR_CTRL_COUNT_ALLOCATIONS=ON. The connection has to last for the whole run, so ir-ctrl
+ * needs a --max-keep-alive-requests above the number of requests.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+namespace {
+
+//! Blocking keep-alive HTTP/1.1 connection, just enough for ir-ctrl's responses
+class connection {
+public:
+   connection(const std::string &host, std::uint16_t port)
+      : fd_{::socket(AF_INET, SOCK_STREAM, 0)} {
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      const int one = 1;
+      if (fd_ < 0 || ::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+          ::connect(fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+          ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+         ::close(fd_);
+         throw std::runtime_error{"cannot connect to " + host + ":" + std::to_string(port)};
+      }
+   }
+
+   connection(const connection &) = delete;
+   connection &operator=(const connection &) = delete;
+
+   ~connection() { ::close(fd_); }
+
+   //! @return Status code, the body is left in body()
+   unsigned request(std::string_view method, std::string_view target) {
+      std::string out;
+      out.append(method).append(" ").append(target).append(" HTTP/1.1\r\nHost: ir-ctrl\r\nContent-Length: 0\r\n\r\n");
+      if (::send(fd_, out.data(), out.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(out.size())) {
+         throw std::runtime_error{"send failed"};
+      }
+
+      std::size_t header_end;
+      while ((header_end = in_.find("\r\n\r\n")) == std::string::npos) {
+         receive();
+      }
+
+      const std::string_view header{in_.data(), header_end};
+      std::size_t length = 0;
+      if (auto pos = header.find("Content-Length: "); pos != std::string_view::npos) {
+         length = std::strtoul(header.data() + pos + 16, nullptr, 10);
+      }
+      if (header.find("Connection: close") != std::string_view::npos) {
+         throw std::runtime_error{"the server closes the connection, raise its --max-keep-alive-requests"};
+      }
+      const auto status = static_cast<unsigned>(std::strtoul(header.data() + 9, nullptr, 10));
+
+      while (in_.size() < header_end + 4 + length) {
+         receive();
+      }
+      body_.assign(in_, header_end + 4, length);
+      in_.erase(0, header_end + 4 + length);
+      return status;
+   }
+
+   [[nodiscard]] const std::string &body() const { return body_; }
+
+private:
+   void receive() {
+      char buffer[16384];
+      const auto size = ::recv(fd_, buffer, sizeof(buffer), 0);
+      if (size <= 0) {
+         throw std::runtime_error{"connection closed"};
+      }
+      in_.append(buffer, static_cast<std::size_t>(size));
+   }
+
+private:
+   int fd_;
+   std::string in_{};
+   std::string body_{};
+};
+
+std::uint64_t heap_allocations(connection &c) {
+   constexpr std::string_view name = "\nir_heap_allocations_total ";
+   if (c.request("GET", "/metrics") != 200) {
+      throw std::runtime_error{"GET /metrics failed"};
+   }
+
+   const auto pos = c.body().find(name);
+   if (pos == std::string::npos) {
+      throw std::runtime_error{
+         "no ir_heap_allocations_total in the metrics, build ir-ctrl with -DIR_CTRL_COUNT_ALLOCATIONS=ON"};
+   }
+   return std::strtoull(c.body().c_str() + pos + name.size(), nullptr, 10);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+   namespace po = boost::program_options;
+
+   po::options_description all("Count the allocations per HTTP request of a running ir-ctrl");
+   all.add_options()
+      ("help,h", "Show help")
+      ("host", po::value<std::string>()->default_value("127.0.0.1"), "Address of ir-ctrl")
+      ("port", po::value<std::uint16_t>()->default_value(80), "HTTP port of ir-ctrl (its --listen-port)")
+      ("method", po::value<std::string>()->default_value("POST"), "Request method")
+      ("target", po::value<std::string>()->default_value("/send?code=529287"), "Request target")
+      ("requests", po::value<unsigned>()->default_value(1000), "Number of measured requests")
+      ("warm-up", po::value<unsigned>()->default_value(100), "Number of requests before the measurement, filling the pools and caches")
+      ("max", po::value<double>(), "Fail if a request takes more allocations than this on average");
+
+   std::string host, method, target;
+   std::uint16_t port = 0;
+   unsigned requests = 0, warm_up = 0;
+   double max = -1;
+   try {
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, all), vm);
+
+      if (vm.count("help")) {
+         std::cout << all << "\n";
+         return EXIT_SUCCESS;
+      }
+
+      po::notify(vm);
+      host = vm["host"].as<std::string>();
+      port = vm["port"].as<std::uint16_t>();
+      method = vm["method"].as<std::string>();
+      target = vm["target"].as<std::string>();
+      requests = std::max(1U, vm["requests"].as<unsigned>());
+      warm_up = vm["warm-up"].as<unsigned>();
+      if (vm.count("max")) {
+         max = vm["max"].as<double>();
+      }
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      std::cerr << all << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   try {
+      connection c{host, port};
+      unsigned status = 0;
+      for (unsigned i = 0; i < warm_up; ++i) {
+         status = c.request(method, target);
+      }
+
+      // Two reads in a row tell the cost of a read itself
+      const auto first = heap_allocations(c);
+      const auto before = heap_allocations(c);
+      for (unsigned i = 0; i < requests; ++i) {
+         status = c.request(method, target);
+      }
+      const auto after = heap_allocations(c);
+
+      const auto read_cost = static_cast<double>(before - first);
+      const auto per_request = (static_cast<double>(after - before) - read_cost) / requests;
+      std::printf("%s %s -> %u: %u requests, %.2f allocations per request\n", method.c_str(), target.c_str(), status,
+                  requests, per_request);
+
+      if (max >= 0 && per_request > max) {
+         std::fprintf(stderr, "more than %.2f allocations per request\n", max);
+         return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+   }
+}
@@ -0,0 +1,42 @@
+/**
+ * @file   alloc_counter.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 28, 2021
+ *
+ * Global operator new counting the allocations, for ir_heap_allocations_total. Diagnostics only: linked into
+ * ir-ctrl with -DIR_CTRL_COUNT_ALLOCATIONS=ON, release builds keep the allocator of the standard library.
+ */
+
+#include <ir/metrics.h>
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+constinit ir::metrics::counter s_heap_allocations{};
+
+} // namespace
+
+std::uint64_t ir::metrics::heap_allocations() noexcept {
+   return s_heap_allocations.value();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Global operator new, counting the allocations
+////////////////////////////////////////////////////////////////////////////////
+void *operator new(std::size_t size) {
+   s_heap_allocations.add();
+   if (auto p = std::malloc(size ? size : 1)) {
+      return p;
+   }
+   throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept {
+   std::free(p);
+}
+
+void operator delete(void *p, std::size_t /*size*/) noexcept {
+   std::free(p);
+}
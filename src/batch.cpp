@@ -0,0 +1,184 @@
+/**
+ * @file   batch.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 19, 2021
+ */
+
+#include <ir/batch.h>
+#include <ir/json.h>
+#include <ir/uri.h>
+
+#include <charconv>
+#include <cmath>
+
+using namespace ir;
+
+namespace {
+
+//! @return The number if it is an integer within the range, nullopt otherwise
+std::optional<std::uint64_t> integer(std::optional<double> value, std::uint64_t min, std::uint64_t max) {
+   if (!value || *value != std::floor(*value) || *value < static_cast<double>(min) ||
+       *value > static_cast<double>(max)) {
+      return std::nullopt;
+   }
+   return static_cast<std::uint64_t>(*value);
+}
+
+bool parse_command(json_reader &r, batch::command &c, std::vector<std::uint32_t> &timings) {
+   bool has_raw = false;
+   std::string_view key;
+
+   for (r.begin_object(); r.next_member(key);) {
+      if (key == "code") {
+         // Either a number, or a string like the code parameter of /send
+         std::optional<std::uint64_t> code;
+         if (r.next_type() == json_reader::value_type::string) {
+            auto parsed = uri::parse_code(r.string().value_or(""));
+            code = parsed ? std::optional<std::uint64_t>{parsed.value()} : std::nullopt;
+         } else {
+            code = integer(r.number(), 0, UINT32_MAX);
+         }
+         if (!code) {
+            r.fail("invalid code");
+            return false;
+         }
+         c.code = static_cast<std::uint32_t>(*code);
+      } else if (key == "remote" || key == "key") {
+         auto name = r.string();
+         if (!name) {
+            return false;
+         }
+         (key == "remote" ? c.remote : c.key) = *name;
+      } else if (key == "raw") {
+         has_raw = true;
+         c.timings_offset = timings.size();
+         for (r.begin_array(); r.next_item();) {
+            auto timing = integer(r.number(), 1, batch::max_timing_us);
+            if (!timing || timings.size() - c.timings_offset == batch::max_timings) {
+               r.fail("invalid raw timing");
+               return false;
+            }
+            timings.push_back(static_cast<std::uint32_t>(*timing));
+         }
+         c.timings_count = timings.size() - c.timings_offset;
+      } else if (key == "frequency") {
+         auto frequency = integer(r.number(), 10000, 100000);
+         if (!frequency) {
+            r.fail("invalid frequency");
+            return false;
+         }
+         c.frequency_hz = static_cast<double>(*frequency);
+      } else if (key == "repeat") {
+         auto repeat = integer(r.number(), 1, batch::max_repeat);
+         if (!repeat) {
+            r.fail("invalid repeat count");
+            return false;
+         }
+         c.repeat = static_cast<unsigned>(*repeat);
+      } else if (key == "delay_ms") {
+         auto delay = integer(r.number(), 0, static_cast<std::uint64_t>(batch::max_delay.count()));
+         if (!delay) {
+            r.fail("invalid delay");
+            return false;
+         }
+         c.delay = std::chrono::milliseconds(*delay);
+      } else {
+         // Unknown members are ignored
+         r.skip();
+      }
+   }
+
+   if (r.failed()) {
+      return false;
+   }
+
+   const bool named = !c.remote.empty() || !c.key.empty();
+   const int sources = int{c.code.has_value()} + int{named} + int{has_raw};
+   if (sources != 1 || (named && (c.remote.empty() || c.key.empty())) || (has_raw && c.timings_count == 0)) {
+      r.fail("exactly one of code, remote and key or raw expected");
+      return false;
+   }
+
+   return true;
+}
+
+const char *status_name(batch::status s) {
+   switch (s) {
+      case batch::status::ok:
+         return "ok";
+      case batch::status::unknown_key:
+         return "unknown_key";
+      case batch::status::failed:
+         return "failed";
+      case batch::status::too_long:
+         return "too_long";
+   }
+   return "unknown";
+}
+
+void append_integer(std::string &out, std::uint64_t value) {
+   char buffer[24];
+   auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+   out.append(buffer, ptr);
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: batch
+////////////////////////////////////////////////////////////////////////////////
+std::optional<batch::parse_error> batch::parse(std::span<char> body,
+                                               std::vector<command> &commands,
+                                               std::vector<std::uint32_t> &timings) {
+   commands.clear();
+   timings.clear();
+
+   json_reader r{body};
+   for (r.begin_array(); r.next_item();) {
+      if (commands.size() == max_commands) {
+         r.fail("too many commands");
+         break;
+      }
+
+      commands.emplace_back();
+      if (!parse_command(r, commands.back(), timings)) {
+         break;
+      }
+   }
+
+   if (!r.finish()) {
+      return parse_error{r.error(), r.offset()};
+   }
+   return std::nullopt;
+}
+
+unsigned batch::cost(std::span<const command> commands) {
+   unsigned result = 0;
+   for (const auto &c : commands) {
+      result += c.repeat;
+   }
+   return result;
+}
+
+void batch::write_results(std::string &out, std::span<const result> results, std::chrono::microseconds total) {
+   out += "{\"results\":[";
+   for (std::size_t i = 0; i < results.size(); ++i) {
+      out += i ? ",{\"status\":\"" : "{\"status\":\"";
+      out += status_name(results[i].state);
+      out += "\",\"duration_us\":";
+      append_integer(out, static_cast<std::uint64_t>(results[i].duration.count()));
+      out += '}';
+   }
+   out += "],\"duration_us\":";
+   append_integer(out, static_cast<std::uint64_t>(total.count()));
+   out += "}\n";
+}
+
+void batch::write_error(std::string &out, const parse_error &error) {
+   // Error messages are literals without any characters that would need escaping
+   out += "{\"error\":\"";
+   out += error.error;
+   out += "\",\"offset\":";
+   append_integer(out, error.offset);
+   out += "}\n";
+}
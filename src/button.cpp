@@ -6,16 +6,44 @@
 
 #include <ir/button.h>
 
+#include <algorithm>
+#include <stdexcept>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <boost/asio/buffer.hpp>
+
 #include <pigpio.h>
 
 using namespace std;
 
-ir::button::button(const int pin, callback_t cb, const duration_t debounce_interval)
+ir::button::button(boost::asio::io_context &io, const int pin, callback_t cb)
+   : button(io, pin, std::move(cb), config{}) {}
+
+ir::button::button(boost::asio::io_context &io, const int pin, callback_t cb, config cfg)
    : pin_number_{pin}
-   , callback_{std::move(cb)}
-   , debounce_interval_{debounce_interval} {
+   , config_{cfg}
+   , event_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+   , doorbell_{io}
+   , detector_{config_, false, std::move(cb)}
+   , settle_timer_{io}
+   , deadline_timer_{io} {
+   if (event_fd_ < 0) {
+      throw std::runtime_error("Error creating the button eventfd");
+   }
+
+   // Keep a separate descriptor for the alert thread, so that it stays valid until the alert function is removed
+   doorbell_.assign(dup(event_fd_));
+   wait_for_edges();
+
    gpioSetMode(pin_number_, PI_INPUT);
    gpioSetPullUpDown(pin_number_, PI_PUD_UP);
+   if (config_.glitch_filter_us) {
+      gpioGlitchFilter(pin_number_, config_.glitch_filter_us);
+   }
+   detector_.reset(gpioRead(pin_number_) == PI_LOW);
+
    gpioSetAlertFuncEx(
       pin_number_,
       [](int gpio, int level, uint32_t tick, void *userdata) {
@@ -26,15 +54,83 @@ ir::button::button(const int pin, callback_t cb, const duration_t debounce_inter
 
 ir::button::~button() {
    gpioSetAlertFuncEx(pin_number_, nullptr, this);
+   ::close(event_fd_);
+}
+
+/**
+ * pigpio alert thread: record the edge and wake up the event loop, nothing else.
+ */
+void ir::button::handler(int /*gpio*/, int level, uint32_t tick) {
+   if (level == PI_TIMEOUT) {
+      return;
+   }
+
+   if (!edges_.try_push(edge{level, tick})) {
+      dropped_edges_.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+
+   const std::uint64_t one = 1;
+   [[maybe_unused]] auto res = ::write(event_fd_, &one, sizeof(one));
 }
 
-void ir::button::handler(int gpio, int level, uint32_t tick) {
-   bool far_apart = (chrono::steady_clock::now() - last_press_time_) >= debounce_interval_;
-   if (first_press_ || far_apart) {
-      if (level == PI_LOW) {
-         callback_();
+void ir::button::wait_for_edges() {
+   doorbell_.async_read_some(boost::asio::buffer(&doorbell_value_, sizeof(doorbell_value_)),
+                             [this](const boost::system::error_code &ec, std::size_t) {
+                                if (ec == boost::asio::error::operation_aborted) {
+                                   return;
+                                }
+
+                                while (auto e = edges_.try_pop()) {
+                                   process_edge(*e);
+                                }
+
+                                wait_for_edges();
+                             });
+}
+
+void ir::button::process_edge(const edge &e) {
+   if (!detector_.edge(e.level == PI_LOW, e.tick)) {
+      // Bounce, the settle timer will pick up the final level
+      return;
+   }
+
+   settle_timer_.expires_after(config_.debounce_interval);
+   settle_timer_.async_wait([this](const boost::system::error_code &ec) {
+      if (!ec) {
+         settle();
       }
-      first_press_ = false;
-      last_press_time_ = chrono::steady_clock::now();
+   });
+   wait_for_deadline();
+}
+
+/**
+ * The debounce interval after the last accepted edge is over: make sure the debounced level matches the actual one.
+ * A tap shorter than the debounce interval would otherwise leave the button "pressed" until the next edge.
+ */
+void ir::button::settle() {
+   const int level = gpioRead(pin_number_);
+   if (level == PI_LOW || level == PI_HIGH) {
+      process_edge(edge{level, gpioTick()});
+   }
+}
+
+/**
+ * The detector counts in pigpio ticks, the timer waits for the same number of microseconds of the steady clock.
+ */
+void ir::button::wait_for_deadline() {
+   const auto deadline = detector_.deadline();
+   if (!deadline) {
+      deadline_timer_.cancel();
+      return;
    }
+
+   const auto remaining = std::max(0, static_cast<std::int32_t>(*deadline - gpioTick()));
+   deadline_timer_.expires_after(chrono::microseconds{remaining});
+   deadline_timer_.async_wait([this](const boost::system::error_code &ec) {
+      if (!ec) {
+         detector_.advance(gpioTick());
+         wait_for_deadline();
+      }
+   });
 }
@@ -0,0 +1,166 @@
+/**
+ * @file   button_bank.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 11, 2021
+ */
+
+#include <ir/button_bank.h>
+
+#include <bit>
+#include <stdexcept>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <boost/asio/buffer.hpp>
+
+#include <pigpio.h>
+
+using namespace ir;
+
+namespace {
+
+std::uint32_t make_mask(const std::vector<int> &pins) {
+   std::uint32_t result = 0;
+   for (auto pin : pins) {
+      if (pin < 0 || pin > 31) {
+         throw std::invalid_argument("Button bank pins have to be in the 0-31 range");
+      }
+      result |= (1U << pin);
+   }
+   return result;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: button_bank
+////////////////////////////////////////////////////////////////////////////////
+button_bank::button_bank(boost::asio::io_context &io,
+                         const std::vector<int> &pins,
+                         callback_t cb,
+                         duration_t debounce_interval)
+   : mask_{make_mask(pins)}
+   , callback_{std::move(cb)}
+   , debounce_interval_{debounce_interval}
+   , last_levels_{mask_}
+   , event_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+   , doorbell_{io}
+   , levels_{mask_}
+   , settle_timer_{io} {
+   if (event_fd_ < 0) {
+      throw std::runtime_error("Error creating the button bank eventfd");
+   }
+
+   // Keep a separate descriptor for the alert thread, so that it stays valid until the alert functions are removed
+   doorbell_.assign(dup(event_fd_));
+   wait_for_samples();
+
+   for (auto pin : pins) {
+      gpioSetMode(pin, PI_INPUT);
+      gpioSetPullUpDown(pin, PI_PUD_UP);
+   }
+
+   levels_ = last_levels_ = gpioRead_Bits_0_31() & mask_;
+
+   for (auto pin : pins) {
+      gpioSetAlertFuncEx(
+         pin,
+         [](int /*gpio*/, int level, uint32_t tick, void *userdata) {
+            reinterpret_cast<button_bank *>(userdata)->handler(level, tick);
+         },
+         this);
+   }
+}
+
+button_bank::~button_bank() {
+   for (std::uint32_t pins = mask_; pins; pins &= pins - 1) {
+      gpioSetAlertFuncEx(std::countr_zero(pins), nullptr, this);
+   }
+   ::close(event_fd_);
+}
+
+/**
+ * pigpio alert thread: sample the whole bank and wake up the event loop.
+ * Edges on several pins within the same pigpio sampling period result in a single sample.
+ */
+void button_bank::handler(int level, std::uint32_t tick) {
+   if (level == PI_TIMEOUT) {
+      return;
+   }
+
+   const auto levels = gpioRead_Bits_0_31() & mask_;
+   if (levels == last_levels_) {
+      return;
+   }
+
+   if (!samples_.try_push(sample{levels, tick})) {
+      dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   last_levels_ = levels;
+
+   const std::uint64_t one = 1;
+   [[maybe_unused]] auto res = ::write(event_fd_, &one, sizeof(one));
+}
+
+void button_bank::wait_for_samples() {
+   doorbell_.async_read_some(boost::asio::buffer(&doorbell_value_, sizeof(doorbell_value_)),
+                             [this](const boost::system::error_code &ec, std::size_t) {
+                                if (ec == boost::asio::error::operation_aborted) {
+                                   return;
+                                }
+
+                                while (auto s = samples_.try_pop()) {
+                                   process_sample(*s);
+                                }
+
+                                wait_for_samples();
+                             });
+}
+
+void button_bank::process_sample(const sample &s) {
+   const auto debounce_us =
+      static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(debounce_interval_).count());
+
+   std::uint32_t accepted = 0;
+   bool bounced = false;
+   for (std::uint32_t changed = (s.levels ^ levels_) & mask_; changed; changed &= changed - 1) {
+      const int pin = std::countr_zero(changed);
+      const std::uint32_t bit = 1U << pin;
+
+      // Unsigned subtraction handles the tick wrap-around (every ~72 minutes)
+      if ((changed_once_ & bit) && (s.tick - last_change_tick_[pin]) < debounce_us) {
+         bounced = true;
+         continue;
+      }
+
+      last_change_tick_[pin] = s.tick;
+      changed_once_ |= bit;
+      accepted |= bit;
+   }
+
+   if (!accepted && !bounced) {
+      return;
+   }
+
+   if (accepted) {
+      levels_ ^= accepted;
+   }
+
+   settle_timer_.expires_after(debounce_interval_);
+   settle_timer_.async_wait([this](const boost::system::error_code &ec) {
+      if (!ec) {
+         settle();
+      }
+   });
+
+   // Active low: a press is an accepted change to zero
+   for (std::uint32_t pressed = accepted & ~levels_; pressed; pressed &= pressed - 1) {
+      callback_(std::countr_zero(pressed));
+   }
+}
+
+void button_bank::settle() {
+   process_sample(sample{gpioRead_Bits_0_31() & mask_, gpioTick()});
+}
@@ -0,0 +1,61 @@
+/**
+ * @file   catalog.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 17, 2021
+ */
+
+#include <ir/catalog.h>
+#include <ir/log.h>
+#include <ir/uri.h>
+
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+using namespace ir;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: catalog
+////////////////////////////////////////////////////////////////////////////////
+result_t<catalog> catalog::load(const std::string &path) {
+   std::ifstream file{path};
+   if (!file) {
+      return std::errc::no_such_file_or_directory;
+   }
+
+   catalog result;
+   std::string line;
+   for (std::uint64_t number = 1; std::getline(file, line); ++number) {
+      std::istringstream fields{line};
+      std::string device, key, code, extra;
+      if (!(fields >> device) || device.front() == '#') {
+         continue;
+      }
+
+      const bool complete = fields >> key >> code && !(fields >> extra);
+      auto parsed = uri::parse_code(code);
+      if (!complete || !parsed) {
+         log::warning("catalog.bad_line", {log::text("path", path), log::kv("line", number)});
+         continue;
+      }
+
+      result.entries_.push_back(entry{std::move(device), std::move(key), parsed.value()});
+   }
+
+   if (file.bad()) {
+      return std::errc::io_error;
+   }
+
+   return result;
+}
+
+std::vector<std::uint32_t> catalog::codes() const {
+   std::vector<std::uint32_t> result;
+   std::unordered_set<std::uint32_t> seen;
+   for (const auto &e : entries_) {
+      if (seen.insert(e.code).second) {
+         result.push_back(e.code);
+      }
+   }
+   return result;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file   event_stream.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 24, 2021
+ */
+
+#include <ir/event_stream.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+using namespace ir;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: event_ring
+////////////////////////////////////////////////////////////////////////////////
+event_ring::event_ring()
+   : slots_{std::make_unique<slot[]>(capacity)} {
+   // Nothing to do here
+}
+
+void event_ring::publish(std::string_view event, std::string_view data) {
+   const auto index = head_.load(std::memory_order_relaxed);
+   auto &s = slots_[index % capacity];
+
+   s.seq.store(2 * index + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+
+   // id: N\nevent: E\ndata: D\n\n
+   auto out = s.data.data();
+   const auto end = out + s.data.size();
+   const auto put = [&](std::string_view text) {
+      const auto size = std::min(text.size(), static_cast<std::size_t>(end - out));
+      std::memcpy(out, text.data(), size);
+      out += size;
+   };
+
+   put("id: ");
+   out = std::to_chars(out, end, index).ptr;
+   put("\nevent: ");
+   put(event);
+   put("\ndata: ");
+   // The record has to stay well-formed even if the data gets truncated
+   put(data.substr(0, std::max<std::ptrdiff_t>(0, end - out - 2)));
+   put("\n\n");
+
+   s.size.store(static_cast<std::uint32_t>(out - s.data.data()), std::memory_order_relaxed);
+   s.seq.store(2 * index + 2, std::memory_order_release);
+   head_.store(index + 1, std::memory_order_release);
+}
+
+std::string_view event_ring::record(std::uint64_t index) const {
+   const auto &s = slots_[index % capacity];
+   const auto seq = s.seq.load(std::memory_order_acquire);
+   if (seq != 2 * index + 2) {
+      return {};
+   }
+
+   // The size is only valid if the slot was not overwritten while it was read
+   const auto size = s.size.load(std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_acquire);
+   if (s.seq.load(std::memory_order_relaxed) != seq) {
+      return {};
+   }
+   return {s.data.data(), std::min<std::size_t>(size, s.data.size())};
+}
+
+bool event_ring::intact(std::uint64_t index) const {
+   std::atomic_thread_fence(std::memory_order_acquire);
+   return slots_[index % capacity].seq.load(std::memory_order_relaxed) == 2 * index + 2;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: event_hub
+////////////////////////////////////////////////////////////////////////////////
+event_hub::event_hub(boost::asio::io_context &io, std::size_t max_subscribers)
+   : io_{&io} {
+   subscribers_.reserve(max_subscribers);
+}
+
+void event_hub::subscribe(timer_t &timer) {
+   subscribers_.push_back(&timer);
+   num_subscribers_.store(subscribers_.size(), std::memory_order_relaxed);
+   // Pairs with the fence in notify: either the producer sees the subscriber, or the subscriber sees the record
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void event_hub::unsubscribe(timer_t &timer) {
+   subscribers_.erase(std::remove(subscribers_.begin(), subscribers_.end(), &timer), subscribers_.end());
+   num_subscribers_.store(subscribers_.size(), std::memory_order_relaxed);
+}
+
+void event_hub::notify() {
+   // A subscriber that is just joining checks the ring head after subscribing, it can't miss the record
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (num_subscribers_.load(std::memory_order_relaxed) == 0 || pending_.exchange(true, std::memory_order_acq_rel)) {
+      return;
+   }
+
+   boost::asio::post(*io_, [this] {
+      // Cleared first: a record published while the subscribers are being woken triggers another round
+      pending_.store(false, std::memory_order_release);
+      for (auto timer : subscribers_) {
+         timer->cancel();
+      }
+   });
+}
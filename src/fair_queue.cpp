@@ -0,0 +1,174 @@
+/**
+ * @file   fair_queue.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 26, 2021
+ */
+
+#include <ir/fair_queue.h>
+
+#include <algorithm>
+
+using namespace ir;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: fair_queue
+////////////////////////////////////////////////////////////////////////////////
+fair_queue::fair_queue(now_function now)
+   : now_{now} {
+   // Nothing to do here
+}
+
+fair_queue::~fair_queue() {
+   // Jobs that never got to run are only destroyed
+   for (auto f : active_) {
+      for (auto n = f->head; n; n = n->next) {
+         n->invoke(*n, action::discard);
+      }
+   }
+}
+
+fair_queue::node *fair_queue::allocate() {
+   if (!free_) {
+      nodes_.push_back(std::make_unique<node>());
+      return nodes_.back().get();
+   }
+
+   auto result = free_;
+   free_ = result->next;
+   result->next = nullptr;
+   return result;
+}
+
+void fair_queue::enqueue(node *n,
+                         const client_key &client,
+                         unsigned weight,
+                         unsigned cost,
+                         clock_t::time_point deadline) {
+   if (flows_.size() >= max_idle_flows + active_.size() && !flows_.count(client)) {
+      std::erase_if(flows_, [](const auto &entry) { return entry.second.head == nullptr; });
+   }
+
+   auto &f = flows_[client];
+   n->finish = std::max(virtual_time_, f.last_finish) + std::max(1U, cost) * unit / std::max(1U, weight);
+   f.last_finish = n->finish;
+   n->cost = std::max(1U, cost);
+   n->deadline = deadline;
+   earliest_deadline_ = std::min(earliest_deadline_, deadline);
+
+   if (f.tail) {
+      f.tail->next = n;
+   } else {
+      f.head = n;
+      active_.push_back(&f);
+   }
+   f.tail = n;
+   ++size_;
+}
+
+bool fair_queue::run_next(clock_t::time_point now) {
+   std::unique_lock lock{mutex_};
+   auto expired = now >= earliest_deadline_ ? take_expired(now, nullptr) : nullptr;
+   auto next = active_.empty() ? nullptr : take_next();
+
+   // Whatever is left starts after the next job at best
+   const auto next_done = next ? now + next->cost * unit_time_ : now;
+   if (next_done > earliest_deadline_) {
+      expired = take_expired(next_done, expired);
+   }
+   const auto cost = next ? next->cost : 0U;
+   lock.unlock();
+
+   // The expired jobs only answer their clients, that goes before the next transmission
+   while (expired) {
+      complete(std::exchange(expired, expired->next), action::expire);
+   }
+
+   if (next) {
+      complete(next, action::run);
+   }
+
+   std::lock_guard relock{mutex_};
+   if (cost) {
+      const auto sample = (now_() - now) / cost;
+      unit_time_ = unit_time_.count() ? unit_time_ + (sample - unit_time_) / 8 : sample;
+   }
+
+   if (active_.empty()) {
+      scheduled_ = false;
+      return false;
+   }
+   return true;
+}
+
+fair_queue::node *fair_queue::take_expired(clock_t::time_point time, node *expired) {
+   earliest_deadline_ = no_deadline;
+
+   for (std::size_t i = 0; i < active_.size();) {
+      auto &f = *active_[i];
+      node *last = nullptr;
+      for (auto link = &f.head; *link;) {
+         auto n = *link;
+         if (n->deadline <= time) {
+            *link = n->next;
+            n->next = expired;
+            expired = n;
+            --size_;
+         } else {
+            earliest_deadline_ = std::min(earliest_deadline_, n->deadline);
+            last = n;
+            link = &n->next;
+         }
+      }
+
+      // The client keeps the finish time of its expired jobs: its queue position is not refunded
+      f.tail = last;
+      if (f.head) {
+         ++i;
+      } else {
+         active_[i] = active_.back();
+         active_.pop_back();
+      }
+   }
+
+   return expired;
+}
+
+fair_queue::node *fair_queue::take_next() {
+   // Only the clients with queued jobs are scanned, there are never many of them
+   auto next = std::min_element(active_.begin(), active_.end(),
+                                [](const flow *lhs, const flow *rhs) { return lhs->head->finish < rhs->head->finish; });
+
+   auto &f = **next;
+   auto n = f.head;
+   f.head = n->next;
+   n->next = nullptr;
+   if (!f.head) {
+      f.tail = nullptr;
+      *next = active_.back();
+      active_.pop_back();
+   }
+
+   virtual_time_ = n->finish;
+   --size_;
+   return n;
+}
+
+void fair_queue::complete(node *n, action a) {
+   // The node goes back to the free list even if the job throws
+   struct recycle {
+      fair_queue *queue;
+      node *n;
+      ~recycle() {
+         std::lock_guard lock{queue->mutex_};
+         n->next = queue->free_;
+         queue->free_ = n;
+      }
+   } guard{this, n};
+
+   n->invoke(*n, a);
+}
+
+fair_queue::counts fair_queue::size() const {
+   std::lock_guard lock{mutex_};
+   return {size_, active_.size()};
+}
@@ -0,0 +1,160 @@
+/**
+ * @file   gesture.cpp
+ * @author Dennis Sitelew
+ * @date   Nov. 08, 2021
+ */
+
+#include <ir/gesture.h>
+
+#include <utility>
+
+using namespace ir;
+
+namespace {
+
+std::uint32_t to_us(std::chrono::milliseconds d) {
+   return static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: gesture_detector
+////////////////////////////////////////////////////////////////////////////////
+gesture_detector::gesture_detector(const config &cfg, bool pressed, callback_t cb)
+   : debounce_us_{to_us(cfg.debounce_interval)}
+   , double_press_us_{to_us(cfg.double_press_window)}
+   , long_press_us_{to_us(cfg.long_press_duration)}
+   , repeat_us_{to_us(cfg.repeat_interval)}
+   , callback_{std::move(cb)}
+   , pressed_{pressed} {
+   // Nothing to do here
+}
+
+bool gesture_detector::edge(bool pressed, std::uint32_t tick) {
+   if (pressed == pressed_) {
+      return false;
+   }
+
+   // Unsigned subtraction handles the tick wrap-around
+   if (!first_change_ && (tick - last_change_tick_) < debounce_us_) {
+      return false;
+   }
+
+   pressed_ = pressed;
+   last_change_tick_ = tick;
+   first_change_ = false;
+
+   if (pressed_) {
+      on_press(tick);
+   } else {
+      on_release(tick);
+   }
+   return true;
+}
+
+void gesture_detector::reset(bool pressed) {
+   pressed_ = pressed;
+   first_change_ = true;
+   long_press_fired_ = release_pending_ = false;
+   long_press_tick_.reset();
+   double_press_tick_.reset();
+}
+
+void gesture_detector::advance(std::uint32_t tick) {
+   for (;;) {
+      // Whichever of the two is due first goes first: a double press window ending before the long press is reached
+      // reports the pending short press on its own
+      const bool double_due = double_press_tick_ && not_after(*double_press_tick_, tick);
+      const bool long_due = long_press_tick_ && not_after(*long_press_tick_, tick);
+      if (double_due && (!long_due || not_after(*double_press_tick_, *long_press_tick_))) {
+         double_press_tick_.reset();
+         if (release_pending_) {
+            release_pending_ = false;
+            callback_(gesture::short_press);
+         }
+      } else if (long_due) {
+         on_long_press_timer(tick);
+      } else {
+         return;
+      }
+   }
+}
+
+std::optional<std::uint32_t> gesture_detector::deadline() const {
+   if (long_press_tick_ && double_press_tick_) {
+      return not_after(*long_press_tick_, *double_press_tick_) ? long_press_tick_ : double_press_tick_;
+   }
+   return long_press_tick_ ? long_press_tick_ : double_press_tick_;
+}
+
+void gesture_detector::on_press(std::uint32_t tick) {
+   long_press_fired_ = false;
+
+   if (!detects_long_press() && !detects_double_press()) {
+      // Nothing to wait for, react right away
+      callback_(gesture::short_press);
+      return;
+   }
+
+   if (detects_long_press()) {
+      long_press_tick_ = tick + long_press_us_;
+   }
+}
+
+void gesture_detector::on_release(std::uint32_t tick) {
+   long_press_tick_.reset();
+
+   if (!detects_long_press() && !detects_double_press()) {
+      // Already reported on press
+      return;
+   }
+
+   if (long_press_fired_) {
+      // End of a hold
+      long_press_fired_ = false;
+      return;
+   }
+
+   if (!detects_double_press()) {
+      callback_(gesture::short_press);
+      return;
+   }
+
+   if (release_pending_) {
+      release_pending_ = false;
+      double_press_tick_.reset();
+      callback_(gesture::double_press);
+      return;
+   }
+
+   release_pending_ = true;
+   double_press_tick_ = tick + double_press_us_;
+}
+
+void gesture_detector::on_long_press_timer(std::uint32_t tick) {
+   if (long_press_fired_) {
+      callback_(gesture::hold_repeat);
+   } else {
+      if (release_pending_) {
+         // Short press followed by a long one: report both
+         release_pending_ = false;
+         double_press_tick_.reset();
+         callback_(gesture::short_press);
+      }
+
+      long_press_fired_ = true;
+      callback_(gesture::long_press);
+   }
+
+   if (repeat_us_ == 0) {
+      long_press_tick_.reset();
+      return;
+   }
+
+   // Repeats keep their phase, but a late advance doesn't make up for the missed ones with a burst
+   *long_press_tick_ += repeat_us_;
+   if (not_after(*long_press_tick_, tick)) {
+      long_press_tick_ = tick + repeat_us_;
+   }
+}
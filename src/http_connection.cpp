@@ -0,0 +1,874 @@
+/**
+ * @file   http_connection.cpp
+ * @author Dennis Sitelew
+ * @date   Nov. 28, 2021
+ */
+
+#include <ir/http_connection.h>
+#include <ir/log.h>
+#include <ir/server.h>
+#include <ir/trace.h>
+#include <ir/uri.h>
+#include <ir/ws_session.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace ir;
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+namespace {
+
+//! Idle GET /events streams get a comment line this often
+constexpr std::chrono::seconds event_keep_alive_interval{15};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Canned responses
+////////////////////////////////////////////////////////////////////////////////
+struct canned_response {
+   http::status status;
+   std::string_view body;
+   std::string_view extra_headers;
+};
+
+// Indexed by http_connection::response
+constexpr std::array<canned_response, http_connection::num_responses> canned_responses{{
+   {http::status::ok, "", ""},
+   {http::status::bad_request, "Invalid IR code\r\n", ""},
+   {http::status::not_found, "Unexpected request\r\n", ""},
+   {http::status::method_not_allowed, "Invalid request-method\r\n", "Allow: POST\r\n"},
+   {http::status::too_many_requests, "Too many requests\r\n", "Retry-After: 1\r\n"},
+   {http::status::internal_server_error, "Error sending the IR code\r\n", ""},
+   {http::status::gateway_timeout, "Deadline passed before the IR code could be sent\r\n", ""},
+   {http::status::service_unavailable, "Too many scheduled jobs\r\n", ""},
+}};
+
+/**
+ * All the common responses, serialized once at startup: one variant for persistent connections and one for the
+ * connections that are about to be closed.
+ */
+class response_table {
+public:
+   response_table() {
+      for (std::size_t i = 0; i < canned_responses.size(); ++i) {
+         serialized_[i][0] = serialize(canned_responses[i], false);
+         serialized_[i][1] = serialize(canned_responses[i], true);
+      }
+   }
+
+   [[nodiscard]] boost::asio::const_buffer get(http_connection::response r, bool keep_alive) const {
+      const auto &text = serialized_[static_cast<std::size_t>(r)][keep_alive ? 1 : 0];
+      return boost::asio::buffer(text);
+   }
+
+   static const response_table &instance() {
+      static const response_table table;
+      return table;
+   }
+
+private:
+   static std::string serialize(const canned_response &r, bool keep_alive) {
+      std::string result = "HTTP/1.1 ";
+      result += std::to_string(static_cast<unsigned>(r.status));
+      result += " ";
+      result += std::string(http::obsolete_reason(r.status));
+      result += "\r\nServer: ir-ctrl\r\n";
+      result += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+      if (!r.body.empty()) {
+         result += "Content-Type: text/plain\r\n";
+      }
+      result += r.extra_headers;
+      result += "Content-Length: " + std::to_string(r.body.size()) + "\r\n\r\n";
+      result += r.body;
+      return result;
+   }
+
+private:
+   std::array<std::array<std::string, 2>, canned_responses.size()> serialized_;
+};
+
+//! Deadline in milliseconds, as given in the query or the X-Deadline-Ms header
+std::optional<std::chrono::milliseconds> parse_deadline(std::string_view text) {
+   unsigned value = 0;
+   const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+   if (text.empty() || ec != std::errc{} || ptr != text.data() + text.size()) {
+      return std::nullopt;
+   }
+   return std::chrono::milliseconds{value};
+}
+
+//! IR code of a request, given as code=CODE or as remote=NAME&key=NAME. The names are decoded on the stack.
+class code_params {
+public:
+   //! @return False if the parameter is one of the code parameters, and it is malformed
+   bool parse(const uri::query_param &p) {
+      if (p.key == "remote" || p.key == "key") {
+         const bool is_remote = p.key == "remote";
+         auto name = is_remote ? uri::decode(p.value, remote_buffer_, sizeof(remote_buffer_))
+                               : uri::decode(p.value, key_buffer_, sizeof(key_buffer_));
+         if (!name) {
+            return false;
+         }
+         (is_remote ? remote_ : key_) = name.value();
+      } else if (p.key == "code") {
+         char buffer[32];
+         auto decoded = uri::decode(p.value, buffer, sizeof(buffer));
+         auto parsed = decoded ? uri::parse_code(decoded.value()) : result_t<std::uint32_t>{decoded.error()};
+         if (!parsed) {
+            return false;
+         }
+         code_ = parsed.value();
+      }
+      return true;
+   }
+
+   //! @return True if neither a code nor a remote key were given
+   [[nodiscard]] bool empty() const { return !code_ && !(remote_ && key_); }
+
+   //! @return The code, or the one of the remote key, nothing if the key is not in the database or is not NECx
+   [[nodiscard]] std::optional<std::uint32_t> resolve(const lirc_db *db) const {
+      if (code_) {
+         return code_;
+      }
+
+      // No allocations: the names are looked up in the mapped database
+      auto found = db && remote_ && key_ ? db->find(*remote_, *key_) : std::nullopt;
+      return found && found->proto == lirc_db::protocol::necx ? std::optional<std::uint32_t>{found->value}
+                                                              : std::nullopt;
+   }
+
+private:
+   char remote_buffer_[128];
+   char key_buffer_[128];
+   std::optional<std::string_view> remote_{}, key_{};
+   std::optional<std::uint32_t> code_{};
+};
+
+//! Methods served on a path, as for the Allow header. Empty for the paths that are not served.
+std::string_view allowed_methods(std::string_view path) {
+   if (path == "/send" || path == "/batch") {
+      return "POST";
+   }
+   if (path == "/schedule") {
+      return "GET, POST";
+   }
+   if (path.starts_with("/schedule/")) {
+      return "DELETE";
+   }
+   if (path == "/metrics" || path == "/trace" || path == "/events" || path == "/ws") {
+      return "GET";
+   }
+   return {};
+}
+
+//! @return True if the method is in the list of allowed_methods
+bool allows(std::string_view allowed, std::string_view method) {
+   while (!allowed.empty()) {
+      const auto end = std::min(allowed.find(", "), allowed.size());
+      if (allowed.substr(0, end) == method) {
+         return true;
+      }
+      allowed.remove_prefix(std::min(end + 2, allowed.size()));
+   }
+   return false;
+}
+
+//! Unsigned number parameter, within the range
+template <class T>
+std::optional<T> parse_number(std::string_view text, T min, T max) {
+   T value{};
+   const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+   if (text.empty() || ec != std::errc{} || ptr != text.data() + text.size() || !(value >= min && value <= max)) {
+      return std::nullopt;
+   }
+   return value;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: http_connection
+////////////////////////////////////////////////////////////////////////////////
+http_connection::http_connection(server &server, http_connection_pool &pool, boost::asio::io_context &io)
+   : server_{&server}
+   , pool_{&pool}
+   , stream_{io.get_executor()}
+   , events_timer_{io.get_executor()} {
+   // Nothing to do here
+}
+
+http_connection::~http_connection() = default;
+
+unsigned http_connection::status_code(response r) {
+   return static_cast<unsigned>(canned_responses[static_cast<std::size_t>(r)].status);
+}
+
+void http_connection::start(socket_t socket) {
+   stream_.socket() = std::move(socket);
+   buffer_.clear();
+
+   beast::error_code ec;
+   const auto remote = stream_.socket().remote_endpoint(ec);
+   client_ = ec ? client_key::local() : client_key::from(remote.address());
+
+   ++pool_->stats().active;
+
+   boost::asio::co_spawn(stream_.get_executor(), run(), [this](std::exception_ptr e) {
+      if (e) {
+         try {
+            std::rethrow_exception(e);
+         } catch (const std::exception &ex) {
+            log::error("http.connection_error", {log::text("error", ex.what())});
+         }
+      }
+      close();
+   });
+}
+
+boost::asio::awaitable<void> http_connection::run() {
+   const auto &opts = server_->get_options();
+   auto token = with_handler_memory(handler_memory_, boost::asio::use_awaitable);
+
+   for (unsigned num_requests = 0;;) {
+      // Any pipelined data is kept in the buffer_, so only the parser itself has to be reset
+      parser_.emplace();
+      parser_->body_limit(batch_body_limit);
+
+      // A new client has to send its request within the read timeout, a persistent connection has to start (and
+      // finish) the next request within the idle timeout. Both deadlines cover the whole request, so a client
+      // trickling in the headers byte by byte can't hold the connection open indefinitely.
+      stream_.expires_after(num_requests == 0 ? opts.read_timeout : opts.keep_alive_timeout);
+
+      beast::error_code ec;
+      co_await http::async_read_header(stream_, buffer_, *parser_, boost::asio::redirect_error(token, ec));
+      if (!ec && !parser_->is_done()) {
+         // Only a batch gets the larger body limit, the body is allocated once its size is known
+         const auto limit = parser_->get().target() == "/batch" ? batch_body_limit : body_buffer_size;
+         const auto length = parser_->content_length();
+         if (length && *length > limit) {
+            ec = http::error::body_limit;
+         } else {
+            parser_->body_limit(limit);
+            if (length) {
+               parser_->get().body().reserve(static_cast<std::size_t>(*length));
+            }
+            co_await http::async_read(stream_, buffer_, *parser_, boost::asio::redirect_error(token, ec));
+         }
+      }
+      if (ec) {
+         handle_error(ec);
+         co_return;
+      }
+
+      if (beast::websocket::is_upgrade(parser_->get()) && parser_->get().target() == "/ws") {
+         if (!co_await open_session()) {
+            co_return;
+         }
+         ws_ = std::make_unique<ws_session>(*server_, stream_, client_);
+         co_await ws_->run(parser_->get());
+         ws_.reset();
+         co_return;
+      }
+
+      if (parser_->get().method() == http::verb::get && parser_->get().target() == "/events") {
+         if (!co_await open_session()) {
+            co_return;
+         }
+         co_await stream_events(parser_->get());
+         co_return;
+      }
+
+      ++num_requests;
+      const auto started = std::chrono::steady_clock::now();
+      trace::span request_span{"http.request"};
+
+      auto &request = parser_->get();
+      const bool keep_alive = request.keep_alive() && num_requests < opts.max_keep_alive_requests;
+
+      auto [result, code, prepared, batch, query_deadline] = route(request);
+      auto deadline = fair_queue::no_deadline;
+      if (code || batch) {
+         if (auto d = deadline_of(request, query_deadline, started)) {
+            deadline = *d;
+            if (auto refused = admit(code ? 1U : ir::batch::cost(batch_commands_), started)) {
+               result = refused->result;
+               prepared = refused->prepared;
+               code.reset();
+               batch = false;
+            }
+         } else {
+            result = response::bad_request;
+            prepared = false;
+            code.reset();
+            batch = false;
+         }
+      }
+
+      if (code) {
+         trace::span transmit_span{"http.transmit", *code};
+         co_await server_->async_send_necx_wave(client_, *code, 1, deadline, boost::asio::redirect_error(token, ec));
+         server_->limits().release(client_);
+         if (ec == boost::asio::error::timed_out) {
+            server_->stats().http_expired.add();
+            result = response::gateway_timeout;
+         } else {
+            result = ec ? response::internal_server_error : response::ok;
+         }
+      } else if (batch) {
+         trace::span transmit_span{"http.transmit_batch", batch_commands_.size()};
+         const auto batch_started = std::chrono::steady_clock::now();
+         co_await server_->async_send_batch(client_, deadline, batch_commands_, batch_timings_, batch_results_,
+                                            boost::asio::redirect_error(token, ec));
+         server_->limits().release(client_);
+
+         if (ec == boost::asio::error::timed_out) {
+            server_->stats().http_expired.add();
+            result = response::gateway_timeout;
+         } else {
+            response_body_.clear();
+            batch::write_results(
+               response_body_, batch_results_,
+               std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - batch_started));
+            result = prepare_response("application/json").result;
+            prepared = true;
+         }
+      }
+
+      // Sending the IR code may take a while, so the write deadline is only armed once the response is ready
+      stream_.expires_after(opts.write_timeout);
+
+      {
+         trace::span write_span{"http.write"};
+         if (prepared) {
+            response_header_ += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+            const std::array<boost::asio::const_buffer, 2> buffers{boost::asio::buffer(response_header_),
+                                                                   boost::asio::buffer(response_body_)};
+            co_await boost::asio::async_write(stream_, buffers, boost::asio::redirect_error(token, ec));
+
+            // The metrics fit, but a GET /trace dump would otherwise stay with the pooled connection for good
+            if (response_body_.capacity() > max_kept_body_capacity) {
+               std::string{}.swap(response_body_);
+            }
+         } else {
+            auto buffer = response_table::instance().get(result, keep_alive);
+            co_await boost::asio::async_write(stream_, buffer, boost::asio::redirect_error(token, ec));
+         }
+      }
+
+      auto &stats = server_->stats();
+      stats.responses[static_cast<std::size_t>(result)].add();
+      stats.request_duration.record(std::chrono::steady_clock::now() - started);
+
+      if (ec) {
+         handle_error(ec);
+         co_return;
+      }
+
+      if (!keep_alive) {
+         co_return;
+      }
+   }
+}
+
+boost::asio::awaitable<bool> http_connection::open_session() {
+   if (pool_->open_session()) {
+      session_ = true;
+      co_return true;
+   }
+
+   ++pool_->stats().sessions_refused;
+   server_->stats().responses[static_cast<std::size_t>(response::service_unavailable)].add();
+
+   beast::error_code ec;
+   stream_.expires_after(server_->get_options().write_timeout);
+   co_await boost::asio::async_write(stream_, response_table::instance().get(response::service_unavailable, false),
+                                     boost::asio::redirect_error(
+                                        with_handler_memory(handler_memory_, boost::asio::use_awaitable), ec));
+   co_return false;
+}
+
+boost::asio::awaitable<void> http_connection::stream_events(const parser_t::value_type &request) {
+   constexpr std::string_view header = "HTTP/1.1 200 OK\r\n"
+                                       "Server: ir-ctrl\r\n"
+                                       "Content-Type: text/event-stream\r\n"
+                                       "Cache-Control: no-cache\r\n"
+                                       "Connection: close\r\n\r\n";
+   constexpr std::string_view keep_alive = ": keep-alive\n\n";
+   constexpr std::size_t max_batch = 64;
+
+   const auto &opts = server_->get_options();
+   const auto &ring = server_->events();
+   auto &stats = server_->stats();
+   auto token = with_handler_memory(handler_memory_, boost::asio::use_awaitable);
+
+   // A reconnecting client resumes after the last record it got, as long as that one is still in the ring
+   auto position = ring.head();
+   if (auto it = request.find("Last-Event-ID"); it != request.end()) {
+      std::uint64_t last_id = 0;
+      const auto value = it->value();
+      const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), last_id);
+      if (ec == std::errc{} && ptr == value.data() + value.size() && last_id < position &&
+          position - last_id <= event_ring::capacity) {
+         position = last_id + 1;
+      }
+   }
+
+   beast::error_code ec;
+   stream_.expires_after(opts.write_timeout);
+   co_await boost::asio::async_write(stream_, boost::asio::buffer(header), boost::asio::redirect_error(token, ec));
+   if (ec) {
+      handle_error(ec);
+      co_return;
+   }
+
+   stream_.socket().non_blocking(true, ec);
+   if (ec) {
+      co_return;
+   }
+
+   auto &hub = pool_->events();
+   hub.subscribe(events_timer_);
+   stats.event_subscribers.add(1);
+
+   std::array<boost::asio::const_buffer, max_batch> buffers;
+   while (!ec) {
+      const auto head = ring.head();
+      if (position == head) {
+         events_timer_.expires_after(event_keep_alive_interval);
+         co_await events_timer_.async_wait(boost::asio::redirect_error(token, ec));
+         if (ec == boost::asio::error::operation_aborted) {
+            // Woken by the hub
+            ec = {};
+            continue;
+         }
+
+         // Nothing happened for a while: a comment keeps proxies from closing the stream and detects dead clients
+         stream_.expires_after(opts.write_timeout);
+         co_await boost::asio::async_write(stream_, boost::asio::buffer(keep_alive),
+                                           boost::asio::redirect_error(token, ec));
+         continue;
+      }
+
+      // The records are written straight from the ring, no copies
+      std::size_t count = 0;
+      const auto first = position;
+      for (; position != head && count < max_batch; ++position) {
+         const auto record = ring.record(position);
+         if (record.empty()) {
+            break;
+         }
+         buffers[count++] = boost::asio::buffer(record);
+      }
+
+      if (count) {
+         // The records nearly always fit into the socket buffer: try writing them right away, so that waking
+         // hundreds of subscribers doesn't arm (and allocate) hundreds of write deadlines
+         const std::span<const boost::asio::const_buffer> pending{buffers.data(), count};
+         const auto written = stream_.socket().write_some(pending, ec);
+         if (ec == boost::asio::error::would_block) {
+            ec = {};
+         }
+
+         beast::buffers_suffix<std::span<const boost::asio::const_buffer>> rest{pending};
+         rest.consume(written);
+         if (!ec && beast::buffer_bytes(rest)) {
+            stream_.expires_after(opts.write_timeout);
+            co_await boost::asio::async_write(stream_, rest, boost::asio::redirect_error(token, ec));
+         }
+      }
+
+      // Records are overwritten in order: if the oldest one survived the write, all of them did
+      if (!count || !ring.intact(first)) {
+         stats.event_subscribers_lapped.add();
+         break;
+      }
+   }
+
+   if (ec) {
+      handle_error(ec);
+   }
+
+   hub.unsubscribe(events_timer_);
+   stats.event_subscribers.add(-1);
+}
+
+/**
+ * Admission control for a command, before it is queued for the transmitter.
+ * A refused command gets its 429 right away. The canned response covers the usual one second Retry-After, longer
+ * waits get a prepared response.
+ */
+std::optional<http_connection::route_result> http_connection::admit(unsigned cost,
+                                                                    std::chrono::steady_clock::time_point now) {
+   const auto decision = server_->limits().acquire(client_, cost, now);
+   if (decision.admitted) {
+      return std::nullopt;
+   }
+
+   server_->stats().http_rate_limited.add();
+   if (decision.retry_after <= std::chrono::seconds{1}) {
+      return route_result{response::too_many_requests};
+   }
+
+   const auto &canned = canned_responses[static_cast<std::size_t>(response::too_many_requests)];
+   response_body_.assign(canned.body);
+   auto result = prepare_response("text/plain", response::too_many_requests);
+   response_header_ += "Retry-After: ";
+   response_header_ += std::to_string(decision.retry_after.count());
+   response_header_ += "\r\n";
+   return result;
+}
+
+std::optional<std::chrono::steady_clock::time_point>
+http_connection::deadline_of(const parser_t::value_type &request,
+                             std::optional<std::chrono::milliseconds> query,
+                             std::chrono::steady_clock::time_point received) {
+   auto budget = query.value_or(server_->get_options().http_deadline);
+   if (!query) {
+      if (auto it = request.find("X-Deadline-Ms"); it != request.end()) {
+         const auto value = it->value();
+         auto parsed = parse_deadline({value.data(), value.size()});
+         if (!parsed) {
+            return std::nullopt;
+         }
+         budget = *parsed;
+      }
+   }
+   return server::deadline_after(received, budget);
+}
+
+http_connection::route_result http_connection::route(parser_t::value_type &request) {
+   trace::span span{"http.route"};
+
+   switch (request.method()) {
+      case http::verb::post:
+         if (request.target() == "/batch") {
+            return handle_batch(request);
+         }
+         if (request.target() == "/schedule" || request.target().starts_with("/schedule?")) {
+            return handle_schedule(request);
+         }
+         if (request.target().starts_with("/send?")) {
+            return handle_send(request);
+         }
+         return refuse(request);
+
+      case http::verb::get:
+         if (request.target() == "/metrics") {
+            return handle_metrics(request);
+         }
+         if (request.target() == "/trace") {
+            return handle_trace(request);
+         }
+         if (request.target() == "/schedule") {
+            return handle_schedule(request);
+         }
+         return refuse(request);
+
+      case http::verb::delete_:
+         if (request.target().starts_with("/schedule/")) {
+            return handle_schedule(request);
+         }
+         return refuse(request);
+
+      default:
+         return refuse(request);
+   }
+}
+
+/**
+ * Response to a request none of the handlers took: 405 with the methods of its path if the path is served at all,
+ * 404 otherwise. The canned 405 covers the POST-only paths.
+ */
+http_connection::route_result http_connection::refuse(const parser_t::value_type &request) {
+   const auto target = request.target();
+   const auto allowed = allowed_methods({target.data(), std::min(target.find('?'), target.size())});
+   const auto method = request.method_string();
+   if (allowed.empty() || allows(allowed, {method.data(), method.size()})) {
+      return {response::not_found};
+   }
+   if (allowed == "POST") {
+      return {response::method_not_allowed};
+   }
+
+   const auto &canned = canned_responses[static_cast<std::size_t>(response::method_not_allowed)];
+   response_body_.assign(canned.body);
+   auto result = prepare_response("text/plain", response::method_not_allowed);
+   response_header_ += "Allow: ";
+   response_header_ += allowed;
+   response_header_ += "\r\n";
+   return result;
+}
+
+http_connection::route_result http_connection::handle_send(const parser_t::value_type &request) {
+   // Handle requests in the following forms: (http://192.168.0.100/send?code=529287)
+   //                                          (http://192.168.0.100/send?remote=tv&key=power)
+   // Either can be followed by &deadline=MS, the time the command may wait for the transmitter.
+   beast::string_view prefix = "/send?";
+   auto target = request.target();
+   if (!target.starts_with(prefix)) {
+      return {response::not_found};
+   }
+
+   auto params = uri::get_query_params({target.data() + prefix.size(), target.size() - prefix.size()});
+   // NECx only, like the transmitter: a remote key of any other protocol is not found
+   code_params codes;
+   std::optional<std::chrono::milliseconds> deadline;
+
+   for (const auto &p : params) {
+      if (!codes.parse(p)) {
+         return {response::bad_request};
+      } else if (p.key == "deadline") {
+         deadline = parse_deadline(p.value);
+         if (!deadline) {
+            return {response::bad_request};
+         }
+      }
+   }
+
+   if (codes.empty()) {
+      return {response::ok};
+   }
+
+   auto code = codes.resolve(server_->remotes());
+   if (!code) {
+      return {response::not_found};
+   }
+   return {response::ok, code, false, false, deadline};
+}
+
+http_connection::route_result http_connection::handle_schedule(const parser_t::value_type &request) {
+   // Delayed and periodic transmissions:
+   //    POST /schedule?code=529287&after=60000             (or remote=tv&key=power; at=UNIX_TIME for a wall time)
+   //    POST /schedule?code=529287&at=1640620800.5&every=3600000&precise=1&repeat=2&deadline=500
+   //    GET /schedule                                      (the jobs as JSON)
+   //    DELETE /schedule/ID
+   auto *jobs = server_->schedule();
+   if (!jobs) {
+      return {response::not_found};
+   }
+
+   const auto target = request.target();
+   if (request.method() == http::verb::get) {
+      response_body_.clear();
+      jobs->write_json(response_body_);
+      return prepare_response("application/json");
+   }
+
+   if (request.method() == http::verb::delete_) {
+      constexpr std::string_view prefix = "/schedule/";
+      auto id = parse_number<std::uint64_t>({target.data() + prefix.size(), target.size() - prefix.size()}, 0,
+                                            std::numeric_limits<std::uint64_t>::max());
+      return {id && jobs->cancel(*id) ? response::ok : response::not_found};
+   }
+
+   beast::string_view prefix = "/schedule?";
+   if (!target.starts_with(prefix)) {
+      return {response::bad_request};
+   }
+
+   const auto now = std::chrono::steady_clock::now();
+   code_params codes;
+   scheduler::job_spec spec{0, 1, now, {}, {}, false, client_};
+
+   for (const auto &p : uri::get_query_params({target.data() + prefix.size(), target.size() - prefix.size()})) {
+      if (!codes.parse(p)) {
+         return {response::bad_request};
+      } else if (p.key == "at") {
+         // Wall clock time, in seconds since the epoch: converted to the steady clock once, so a clock step later
+         // on doesn't move the job
+         auto at = parse_number<double>(p.value, 0, 1e11);
+         if (!at) {
+            return {response::bad_request};
+         }
+         const std::chrono::duration<double> wait =
+            std::chrono::duration<double>{*at} - std::chrono::system_clock::now().time_since_epoch();
+         if (wait.count() > 0) {
+            spec.first = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait);
+         }
+      } else if (p.key == "after" || p.key == "every" || p.key == "deadline") {
+         const auto min = p.key == "every" ? 1U : 0U;
+         auto number = parse_number<unsigned>(p.value, min, std::numeric_limits<unsigned>::max());
+         if (!number) {
+            return {response::bad_request};
+         }
+         const std::chrono::milliseconds value{*number};
+         if (p.key == "after") {
+            spec.first = now + value;
+         } else {
+            (p.key == "every" ? spec.period : spec.deadline) = value;
+         }
+      } else if (p.key == "repeat") {
+         auto number = parse_number<unsigned>(p.value, 1, batch::max_repeat);
+         if (!number) {
+            return {response::bad_request};
+         }
+         spec.count = *number;
+      } else if (p.key == "precise") {
+         spec.precise = p.value == "1" || p.value == "true";
+      }
+   }
+
+   if (codes.empty()) {
+      return {response::bad_request};
+   }
+   auto code = codes.resolve(server_->remotes());
+   if (!code) {
+      return {response::not_found};
+   }
+   spec.code = *code;
+
+   // Creating a job costs the client like sending its first run right away, so jobs can't be used to get around the
+   // rate limit. Nothing is queued yet, the pending command is given back right away.
+   if (auto refused = admit(spec.count, now)) {
+      return *refused;
+   }
+   server_->limits().release(client_);
+
+   auto id = jobs->add(spec);
+   if (!id) {
+      // Either the table or the client's share of it is full: a client can't wait that out like a rate limit
+      return {response::service_unavailable};
+   }
+
+   response_body_.assign(R"({"id":)");
+   response_body_ += std::to_string(id.value());
+   response_body_ += "}\n";
+   return prepare_response("application/json");
+}
+
+http_connection::route_result http_connection::handle_batch(parser_t::value_type &request) {
+   // The body is parsed in place, the commands refer to it until the response is written
+   auto body = request.body().data();
+   auto error = batch::parse({static_cast<char *>(body.data()), body.size()}, batch_commands_, batch_timings_);
+   if (error) {
+      response_body_.clear();
+      batch::write_error(response_body_, *error);
+      return prepare_response("application/json", response::bad_request);
+   }
+
+   const auto *db = server_->remotes();
+   for (auto &c : batch_commands_) {
+      if (!c.remote.empty()) {
+         auto code = db ? db->find(c.remote, c.key) : std::nullopt;
+         if (code) {
+            c.code = code->value;
+         }
+      }
+   }
+
+   batch_results_.assign(batch_commands_.size(), batch::result{});
+   return {response::ok, std::nullopt, false, true};
+}
+
+http_connection::route_result http_connection::handle_metrics(const parser_t::value_type & /*request*/) {
+   response_body_.clear();
+   server_->write_metrics(response_body_);
+   return prepare_response("text/plain; version=0.0.4");
+}
+
+http_connection::route_result http_connection::handle_trace(const parser_t::value_type & /*request*/) {
+   response_body_.clear();
+   trace::write_chrome_trace(response_body_);
+   return prepare_response("application/json");
+}
+
+/**
+ * Prepare the header for the response_body_.
+ * The Connection header is appended once the keep-alive decision is made.
+ */
+http_connection::route_result http_connection::prepare_response(std::string_view content_type, response result) {
+   const auto status = canned_responses[static_cast<std::size_t>(result)].status;
+
+   response_header_.clear();
+   response_header_ += "HTTP/1.1 ";
+   response_header_ += std::to_string(static_cast<unsigned>(status));
+   response_header_ += ' ';
+   const auto reason = http::obsolete_reason(status);
+   response_header_.append(reason.data(), reason.size());
+   response_header_ += "\r\nServer: ir-ctrl\r\nContent-Type: ";
+   response_header_ += content_type;
+   response_header_ += "\r\nContent-Length: ";
+   response_header_ += std::to_string(response_body_.size());
+   response_header_ += "\r\n";
+
+   return {result, std::nullopt, true};
+}
+
+void http_connection::handle_error(beast::error_code ec) {
+   if (ec == beast::error::timeout) {
+      ++pool_->stats().timed_out;
+   }
+}
+
+void http_connection::close() {
+   beast::error_code ec;
+   stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+   stream_.close();
+
+   parser_.reset();
+   --pool_->stats().active;
+   pool_->release(this, std::exchange(session_, false));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: http_connection_pool
+////////////////////////////////////////////////////////////////////////////////
+http_connection_pool::http_connection_pool(server &server,
+                                           boost::asio::io_context &io,
+                                           std::size_t max_requests,
+                                           std::size_t max_sessions,
+                                           release_handler_t on_release)
+   : on_release_{std::move(on_release)}
+   , max_requests_{max_requests}
+   , max_sessions_{max_sessions}
+   , events_{io, max_sessions} {
+   const auto size = max_requests + max_sessions;
+   storage_.reserve(size);
+   free_.reserve(size);
+
+   for (std::size_t i = 0; i < size; ++i) {
+      storage_.push_back(std::make_unique<http_connection>(server, *this, io));
+      free_.push_back(storage_.back().get());
+   }
+
+   // Build the response table before the first request comes in
+   (void)response_table::instance();
+}
+
+http_connection *http_connection_pool::acquire() {
+   // There always is a free object while a request slot is free: the sessions can't take more than their own slots
+   if (requests_ == max_requests_) {
+      return nullptr;
+   }
+
+   ++requests_;
+   auto result = free_.back();
+   free_.pop_back();
+   return result;
+}
+
+bool http_connection_pool::open_session() {
+   if (sessions_ == max_sessions_) {
+      return false;
+   }
+
+   ++sessions_;
+   --requests_;
+   on_release_();
+   return true;
+}
+
+void http_connection_pool::release(http_connection *connection, bool session) {
+   free_.push_back(connection);
+   --(session ? sessions_ : requests_);
+   on_release_();
+}
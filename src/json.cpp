@@ -0,0 +1,386 @@
+/**
+ * @file   json.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 19, 2021
+ */
+
+#include <ir/json.h>
+
+#include <charconv>
+#include <cstdint>
+
+using namespace ir;
+
+namespace {
+
+std::optional<std::uint32_t> parse_hex4(std::string_view text) {
+   std::uint32_t result = 0;
+   auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), result, 16);
+   if (text.size() != 4 || ec != std::errc{} || ptr != text.data() + text.size()) {
+      return std::nullopt;
+   }
+   return result;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: json_reader
+////////////////////////////////////////////////////////////////////////////////
+bool json_reader::begin(char open) {
+   if (failed()) {
+      return false;
+   }
+
+   if (peek() != open) {
+      fail(open == '[' ? "array expected" : "object expected");
+      return false;
+   }
+
+   ++pos_;
+   after_value_ = false;
+   return true;
+}
+
+bool json_reader::next(char close) {
+   if (failed()) {
+      return false;
+   }
+
+   char c = peek();
+   if (c == close) {
+      ++pos_;
+      // The array or object itself is a value of the enclosing one
+      after_value_ = true;
+      return false;
+   }
+
+   if (after_value_) {
+      if (c != ',') {
+         fail("comma expected");
+         return false;
+      }
+      ++pos_;
+
+      if (peek() == close) {
+         fail("trailing comma");
+         return false;
+      }
+      after_value_ = false;
+   } else if (c == 0) {
+      fail("unexpected end");
+      return false;
+   }
+
+   return true;
+}
+
+bool json_reader::next_member(std::string_view &key) {
+   if (!next('}')) {
+      return false;
+   }
+
+   auto name = string();
+   if (!name) {
+      return false;
+   }
+
+   if (peek() != ':') {
+      fail("colon expected");
+      return false;
+   }
+   ++pos_;
+
+   key = *name;
+   after_value_ = false;
+   return true;
+}
+
+json_reader::value_type json_reader::next_type() {
+   switch (peek()) {
+      case '"':
+         return value_type::string;
+      case '[':
+         return value_type::array;
+      case '{':
+         return value_type::object;
+      case 't':
+      case 'f':
+         return value_type::boolean;
+      case 'n':
+         return value_type::null;
+      case 0:
+         return value_type::none;
+      default:
+         return value_type::number;
+   }
+}
+
+std::optional<std::string_view> json_reader::string() {
+   return read_string(true);
+}
+
+std::optional<std::string_view> json_reader::read_string(bool decode) {
+   if (failed()) {
+      return std::nullopt;
+   }
+
+   if (peek() != '"') {
+      fail("string expected");
+      return std::nullopt;
+   }
+
+   const auto begin = ++pos_;
+   auto write = begin;
+   while (pos_ < text_.size() && text_[pos_] != '"') {
+      const char c = text_[pos_];
+      if (static_cast<unsigned char>(c) < 0x20) {
+         fail("control character in a string");
+         return std::nullopt;
+      }
+
+      if (c != '\\') {
+         if (decode) {
+            text_[write++] = c;
+         }
+         ++pos_;
+      } else if (decode) {
+         if (!decode_escape(write)) {
+            return std::nullopt;
+         }
+      } else {
+         // Only has to get past an escaped quote
+         pos_ += 2;
+      }
+   }
+
+   if (pos_ >= text_.size()) {
+      fail("unterminated string");
+      return std::nullopt;
+   }
+
+   const auto end = decode ? write : pos_;
+   ++pos_;
+   after_value_ = true;
+   return std::string_view{text_.data() + begin, end - begin};
+}
+
+/**
+ * Decode the escape sequence at pos_, writing UTF-8 at the write position.
+ * Never writes past pos_: the longest encoding (4 bytes for a surrogate pair) comes from 12 characters.
+ */
+bool json_reader::decode_escape(std::size_t &write) {
+   if (pos_ + 1 >= text_.size()) {
+      fail("unterminated string");
+      return false;
+   }
+
+   const char c = text_[pos_ + 1];
+   pos_ += 2;
+
+   char simple = 0;
+   switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+         simple = c;
+         break;
+      case 'b':
+         simple = '\b';
+         break;
+      case 'f':
+         simple = '\f';
+         break;
+      case 'n':
+         simple = '\n';
+         break;
+      case 'r':
+         simple = '\r';
+         break;
+      case 't':
+         simple = '\t';
+         break;
+      case 'u':
+         break;
+      default:
+         fail("invalid escape sequence");
+         return false;
+   }
+
+   if (simple) {
+      text_[write++] = simple;
+      return true;
+   }
+
+   auto hex = [this]() -> std::optional<std::uint32_t> {
+      if (pos_ + 4 > text_.size()) {
+         return std::nullopt;
+      }
+      auto result = parse_hex4({text_.data() + pos_, 4});
+      pos_ += 4;
+      return result;
+   };
+
+   auto code_point = hex();
+   if (!code_point || (*code_point >= 0xDC00 && *code_point <= 0xDFFF)) {
+      fail("invalid unicode escape");
+      return false;
+   }
+
+   if (*code_point >= 0xD800 && *code_point <= 0xDBFF) {
+      const bool escaped = pos_ + 2 <= text_.size() && text_[pos_] == '\\' && text_[pos_ + 1] == 'u';
+      pos_ += 2;
+      auto low = escaped ? hex() : std::nullopt;
+      if (!low || *low < 0xDC00 || *low > 0xDFFF) {
+         fail("invalid surrogate pair");
+         return false;
+      }
+      *code_point = 0x10000 + ((*code_point - 0xD800) << 10) + (*low - 0xDC00);
+   }
+
+   const auto cp = *code_point;
+   if (cp < 0x80) {
+      text_[write++] = static_cast<char>(cp);
+   } else if (cp < 0x800) {
+      text_[write++] = static_cast<char>(0xC0 | cp >> 6);
+      text_[write++] = static_cast<char>(0x80 | (cp & 0x3F));
+   } else if (cp < 0x10000) {
+      text_[write++] = static_cast<char>(0xE0 | cp >> 12);
+      text_[write++] = static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+      text_[write++] = static_cast<char>(0x80 | (cp & 0x3F));
+   } else {
+      text_[write++] = static_cast<char>(0xF0 | cp >> 18);
+      text_[write++] = static_cast<char>(0x80 | (cp >> 12 & 0x3F));
+      text_[write++] = static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+      text_[write++] = static_cast<char>(0x80 | (cp & 0x3F));
+   }
+   return true;
+}
+
+std::optional<double> json_reader::number() {
+   if (failed()) {
+      return std::nullopt;
+   }
+
+   const char c = peek();
+   if (c != '-' && (c < '0' || c > '9')) {
+      fail("number expected");
+      return std::nullopt;
+   }
+
+   auto end = pos_;
+   while (end < text_.size() && std::string_view{"+-.0123456789eE"}.find(text_[end]) != std::string_view::npos) {
+      ++end;
+   }
+
+   double result = 0;
+   auto [ptr, ec] = std::from_chars(text_.data() + pos_, text_.data() + end, result);
+   if (ec != std::errc{} || ptr != text_.data() + end) {
+      fail("invalid number");
+      return std::nullopt;
+   }
+
+   pos_ = end;
+   after_value_ = true;
+   return result;
+}
+
+std::optional<bool> json_reader::boolean() {
+   if (failed()) {
+      return std::nullopt;
+   }
+
+   const char c = peek();
+   if ((c == 't' && literal("true")) || (c == 'f' && literal("false"))) {
+      return c == 't';
+   }
+
+   fail("boolean expected");
+   return std::nullopt;
+}
+
+std::optional<std::string_view> json_reader::skip() {
+   if (failed()) {
+      return std::nullopt;
+   }
+
+   const char c = peek();
+   const auto begin = pos_;
+   bool ok = true;
+   std::string_view key;
+
+   switch (c) {
+      case '"':
+         ok = read_string(false).has_value();
+         break;
+
+      case '[':
+         for (begin_array(); next_item();) {
+            skip();
+         }
+         break;
+
+      case '{':
+         for (begin_object(); next_member(key);) {
+            skip();
+         }
+         break;
+
+      case 't':
+      case 'f':
+         ok = boolean().has_value();
+         break;
+
+      case 'n':
+         ok = literal("null");
+         if (!ok) {
+            fail("invalid literal");
+         }
+         break;
+
+      default:
+         ok = number().has_value();
+         break;
+   }
+
+   if (!ok || failed()) {
+      return std::nullopt;
+   }
+   return std::string_view{text_.data() + begin, pos_ - begin};
+}
+
+bool json_reader::finish() {
+   if (failed()) {
+      return false;
+   }
+
+   if (peek() != 0) {
+      fail("unexpected data after the document");
+      return false;
+   }
+   return true;
+}
+
+void json_reader::fail(const char *error) {
+   if (!error_) {
+      error_ = error;
+   }
+}
+
+char json_reader::peek() {
+   while (pos_ < text_.size() &&
+          (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+      ++pos_;
+   }
+   return pos_ < text_.size() ? text_[pos_] : 0;
+}
+
+bool json_reader::literal(std::string_view text) {
+   if (std::string_view{text_.data() + pos_, text_.size() - pos_}.substr(0, text.size()) != text) {
+      return false;
+   }
+
+   pos_ += text.size();
+   after_value_ = true;
+   return true;
+}
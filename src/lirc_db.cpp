@@ -0,0 +1,306 @@
+/**
+ * @file   lirc_db.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 18, 2021
+ */
+
+#include <ir/lirc_db.h>
+#include <ir/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+constexpr std::array<char, 8> file_magic{'I', 'R', 'L', 'I', 'R', 'C', 'D', 'B'};
+constexpr std::uint32_t file_version = 1;
+
+struct file_header {
+   std::array<char, 8> magic;
+   std::uint32_t version;
+   std::uint32_t num_entries;
+   std::uint32_t num_buckets;
+   std::uint32_t names_size;
+   std::uint64_t file_size;
+};
+
+static_assert(sizeof(file_header) == 32, "Unexpected database file layout");
+
+//! Average number of keys per bucket: more buckets - faster build, bigger file
+constexpr std::size_t keys_per_bucket = 4;
+
+//! Give up on building the perfect hash after that many seeds for a single bucket
+constexpr std::uint32_t max_seed = 1U << 24;
+
+//! FNV-1a of the name pair, computed once per lookup
+std::uint64_t name_hash(std::string_view remote, std::string_view key) {
+   std::uint64_t h = 14695981039346656037ULL;
+   auto add = [&h](std::string_view text) {
+      for (auto c : text) {
+         h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+      }
+   };
+
+   add(remote);
+   h = h * 1099511628211ULL; // Separator (a zero byte), "ab" + "c" and "a" + "bc" are different pairs
+   add(key);
+   return h;
+}
+
+//! MurmurHash3 finalizer
+std::uint64_t mix(std::uint64_t h) {
+   h ^= h >> 33;
+   h *= 0xFF51AFD7ED558CCDULL;
+   h ^= h >> 33;
+   h *= 0xC4CEB9FE1A85EC53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+std::size_t bucket_of(std::uint64_t h, std::size_t num_buckets) {
+   return static_cast<std::size_t>(mix(h) % num_buckets);
+}
+
+std::size_t slot_of(std::uint64_t h, std::uint32_t seed, std::size_t num_entries) {
+   return static_cast<std::size_t>(mix(h ^ ((seed + 1ULL) * 0x9E3779B97F4A7C15ULL)) % num_entries);
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: lirc_db
+////////////////////////////////////////////////////////////////////////////////
+lirc_db::lirc_db(std::string path)
+   : path_{std::move(path)} {
+   static_assert(sizeof(entry) == 20, "Unexpected database file layout");
+
+   auto res = load();
+   if (!res) {
+      log::warning("lirc_db.invalid", {log::text("path", path_), log::text("error", res.error().message())});
+      unmap();
+      seeds_ = {};
+      entries_ = {};
+      names_ = {};
+   }
+}
+
+lirc_db::~lirc_db() {
+   unmap();
+}
+
+result_t<void> lirc_db::load() {
+   const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      return std::error_code{errno, std::generic_category()};
+   }
+
+   struct stat st {};
+   if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(file_header)) {
+      ::close(fd);
+      return std::errc::invalid_argument;
+   }
+
+   mapping_size_ = static_cast<std::size_t>(st.st_size);
+   mapping_ = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (mapping_ == MAP_FAILED) {
+      mapping_ = nullptr;
+      return std::error_code{errno, std::generic_category()};
+   }
+
+   const auto base = static_cast<const char *>(mapping_);
+   file_header header{};
+   std::memcpy(&header, base, sizeof(header));
+
+   const auto seeds_offset = std::uint64_t{sizeof(file_header)};
+   const auto entries_offset = seeds_offset + std::uint64_t{header.num_buckets} * sizeof(std::uint32_t);
+   const auto names_offset = entries_offset + std::uint64_t{header.num_entries} * sizeof(entry);
+
+   if (header.magic != file_magic || header.version != file_version || header.file_size != mapping_size_ ||
+       names_offset + header.names_size != mapping_size_ || (header.num_entries && !header.num_buckets)) {
+      return std::errc::invalid_argument;
+   }
+
+   seeds_ = {reinterpret_cast<const std::uint32_t *>(base + seeds_offset), header.num_buckets};
+   entries_ = {reinterpret_cast<const entry *>(base + entries_offset), header.num_entries};
+   names_ = {base + names_offset, header.names_size};
+
+   // Validated once, so that the lookups do not have to
+   for (const auto &e : entries_) {
+      const bool valid = e.remote_offset <= names_.size() && e.remote_size <= names_.size() - e.remote_offset &&
+                         e.key_offset <= names_.size() && e.key_size <= names_.size() - e.key_offset &&
+                         e.proto == protocol::necx;
+      if (!valid) {
+         return std::errc::invalid_argument;
+      }
+   }
+
+   return outcome::success();
+}
+
+void lirc_db::unmap() {
+   if (mapping_) {
+      ::munmap(mapping_, mapping_size_);
+      mapping_ = nullptr;
+      mapping_size_ = 0;
+   }
+}
+
+std::optional<lirc_db::ir_code> lirc_db::find(std::string_view remote, std::string_view key) const {
+   if (entries_.empty()) {
+      return std::nullopt;
+   }
+
+   const auto h = name_hash(remote, key);
+   const auto &e = entries_[slot_of(h, seeds_[bucket_of(h, seeds_.size())], entries_.size())];
+
+   // Names that are not in the database still map to some entry
+   if (names_.substr(e.remote_offset, e.remote_size) != remote || names_.substr(e.key_offset, e.key_size) != key) {
+      return std::nullopt;
+   }
+
+   return ir_code{e.proto, e.code};
+}
+
+lirc_db::key_view lirc_db::at(std::size_t index) const {
+   const auto &e = entries_[index];
+   return key_view{names_.substr(e.remote_offset, e.remote_size), names_.substr(e.key_offset, e.key_size),
+                   ir_code{e.proto, e.code}};
+}
+
+result_t<void> lirc_db::write(const std::string &path, const std::vector<record> &records) {
+   const auto num_entries = records.size();
+   const auto num_buckets = (num_entries + keys_per_bucket - 1) / keys_per_bucket;
+
+   // Names: remote names are shared between their keys
+   std::string names;
+   std::unordered_map<std::string, std::uint32_t> remote_offsets;
+   std::unordered_set<std::string> pairs;
+   std::vector<entry> entries(num_entries);
+   std::vector<std::uint64_t> hashes(num_entries);
+
+   for (std::size_t i = 0; i < num_entries; ++i) {
+      const auto &r = records[i];
+      constexpr auto max_name = std::numeric_limits<std::uint16_t>::max();
+      if (r.remote.size() > max_name || r.key.size() > max_name || !pairs.insert(r.remote + '\0' + r.key).second) {
+         return std::errc::invalid_argument;
+      }
+
+      auto [it, inserted] = remote_offsets.try_emplace(r.remote, static_cast<std::uint32_t>(names.size()));
+      if (inserted) {
+         names += r.remote;
+      }
+
+      auto &e = entries[i];
+      e.remote_offset = it->second;
+      e.remote_size = static_cast<std::uint16_t>(r.remote.size());
+      e.key_offset = static_cast<std::uint32_t>(names.size());
+      e.key_size = static_cast<std::uint16_t>(r.key.size());
+      e.code = r.code.value;
+      e.proto = r.code.proto;
+      names += r.key;
+
+      hashes[i] = name_hash(r.remote, r.key);
+   }
+
+   if (names.size() > std::numeric_limits<std::uint32_t>::max()) {
+      return std::errc::file_too_large;
+   }
+
+   // Hash and displace: place the biggest buckets first, while most of the slots are still free
+   std::vector<std::vector<std::size_t>> buckets(num_buckets);
+   for (std::size_t i = 0; i < num_entries; ++i) {
+      buckets[bucket_of(hashes[i], num_buckets)].push_back(i);
+   }
+
+   std::vector<std::size_t> order(num_buckets);
+   for (std::size_t i = 0; i < num_buckets; ++i) {
+      order[i] = i;
+   }
+   std::stable_sort(order.begin(), order.end(),
+                    [&buckets](auto lhs, auto rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+   std::vector<std::uint32_t> seeds(num_buckets, 0);
+   std::vector<entry> table(num_entries);
+   std::vector<bool> taken(num_entries, false);
+   std::vector<std::size_t> slots;
+
+   for (auto b : order) {
+      const auto &members = buckets[b];
+      if (members.empty()) {
+         break;
+      }
+
+      for (std::uint32_t seed = 0;; ++seed) {
+         if (seed == max_seed) {
+            return std::errc::result_out_of_range;
+         }
+
+         slots.clear();
+         for (auto i : members) {
+            const auto slot = slot_of(hashes[i], seed, num_entries);
+            if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+               break;
+            }
+            slots.push_back(slot);
+         }
+
+         if (slots.size() == members.size()) {
+            seeds[b] = seed;
+            for (std::size_t k = 0; k < members.size(); ++k) {
+               taken[slots[k]] = true;
+               table[slots[k]] = entries[members[k]];
+            }
+            break;
+         }
+      }
+   }
+
+   file_header header{};
+   header.magic = file_magic;
+   header.version = file_version;
+   header.num_entries = static_cast<std::uint32_t>(num_entries);
+   header.num_buckets = static_cast<std::uint32_t>(num_buckets);
+   header.names_size = static_cast<std::uint32_t>(names.size());
+   header.file_size = sizeof(header) + seeds.size() * sizeof(std::uint32_t) + table.size() * sizeof(entry) +
+                      names.size();
+
+   // Written next to the original file and renamed over it: a running server keeps its mapping of the old one
+   const auto temp_path = path + ".tmp";
+   {
+      std::ofstream out{temp_path, std::ios::binary | std::ios::trunc};
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(seeds.data()),
+                static_cast<std::streamsize>(seeds.size() * sizeof(std::uint32_t)));
+      out.write(reinterpret_cast<const char *>(table.data()),
+                static_cast<std::streamsize>(table.size() * sizeof(entry)));
+      out.write(names.data(), static_cast<std::streamsize>(names.size()));
+      out.close();
+
+      if (!out) {
+         std::remove(temp_path.c_str());
+         return std::errc::io_error;
+      }
+   }
+
+   if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+      const auto ec = std::error_code{errno, std::generic_category()};
+      std::remove(temp_path.c_str());
+      return ec;
+   }
+
+   return outcome::success();
+}
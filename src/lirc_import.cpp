@@ -0,0 +1,288 @@
+/**
+ * @file   lirc_import.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 18, 2021
+ */
+
+#include <ir/lirc_import.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <sstream>
+
+using namespace ir;
+
+namespace {
+
+//! NEC timings, µs (see necx.cpp)
+constexpr std::uint64_t nec_frequency = 38000;
+constexpr std::uint64_t nec_header_pulse = 9000;
+constexpr std::uint64_t nec_header_space = 4500;
+constexpr std::uint64_t nec_bit_pulse = 562;
+constexpr std::uint64_t nec_one_space = 1686;
+constexpr std::uint64_t nec_zero_space = 562;
+constexpr std::uint64_t nec_bits = 32;
+
+//! Flags that do not change the encoding of a NEC remote
+constexpr std::array<std::string_view, 5> compatible_flags{"SPACE_ENC", "CONST_LENGTH", "NO_HEAD_REP", "NO_FOOT_REP",
+                                                          "REPEAT_HEADER"};
+
+//! Decimal or 0x-prefixed hexadecimal number
+std::optional<std::uint64_t> parse_number(std::string_view text) {
+   int base = 10;
+   if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+      base = 16;
+      text.remove_prefix(2);
+   }
+
+   std::uint64_t result = 0;
+   const auto end = text.data() + text.size();
+   auto [ptr, ec] = std::from_chars(text.data(), end, result, base);
+   if (text.empty() || ec != std::errc{} || ptr != end) {
+      return std::nullopt;
+   }
+   return result;
+}
+
+std::uint32_t reverse_byte(std::uint64_t byte) {
+   std::uint32_t result = 0;
+   for (unsigned i = 0; i < 8; ++i) {
+      if (byte & (1U << i)) {
+         result |= 0x80U >> i;
+      }
+   }
+   return result;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: lirc_import
+////////////////////////////////////////////////////////////////////////////////
+void lirc_import::parse(std::istream &in, std::string_view source) {
+   enum class section { none, remote, codes, raw_codes };
+
+   section current = section::none;
+   remote r;
+   std::string line;
+   std::uint64_t number = 0;
+
+   while (std::getline(in, line)) {
+      ++number;
+      if (const auto comment = line.find('#'); comment != std::string::npos) {
+         line.resize(comment);
+      }
+
+      std::istringstream fields{line};
+      std::string word, arg;
+      if (!(fields >> word)) {
+         continue;
+      }
+      fields >> arg;
+
+      if (word == "begin" || word == "end") {
+         const bool begin = word == "begin";
+         if (arg == "remote") {
+            if (begin) {
+               if (current != section::none) {
+                  warn(source, number, "nested remote, the previous one is dropped");
+               }
+               r = remote{};
+               r.line = number;
+               current = section::remote;
+            } else if (current == section::remote) {
+               finish(r, source);
+               current = section::none;
+            } else {
+               warn(source, number, "unexpected end of remote");
+               current = section::none;
+            }
+         } else if (arg == "codes") {
+            current = begin ? section::codes : section::remote;
+         } else if (arg == "raw_codes") {
+            r.unsupported = "raw codes";
+            current = begin ? section::raw_codes : section::remote;
+         }
+         continue;
+      }
+
+      switch (current) {
+         case section::none:
+         case section::raw_codes:
+            break;
+
+         case section::codes:
+            // Additional values (repeated codes) are ignored
+            if (auto code = parse_number(arg)) {
+               r.codes.emplace_back(std::move(word), *code);
+            } else {
+               warn(source, number, "invalid code for " + word);
+            }
+            break;
+
+         case section::remote: {
+            auto value = parse_number(arg);
+            auto set = [&](std::uint64_t &field) {
+               if (value) {
+                  field = *value;
+               } else {
+                  r.unsupported = "invalid " + word;
+               }
+            };
+            auto set_timing = [&](timing_t &field) {
+               std::string space;
+               fields >> space;
+               auto second = parse_number(space);
+               if (value && second) {
+                  field = {*value, *second};
+               } else {
+                  r.unsupported = "invalid " + word;
+               }
+            };
+
+            if (word == "name") {
+               r.name = arg;
+            } else if (word == "flags") {
+               r.flags = arg;
+            } else if (word == "bits") {
+               set(r.bits);
+            } else if (word == "pre_data_bits") {
+               set(r.pre_data_bits);
+            } else if (word == "pre_data") {
+               set(r.pre_data);
+            } else if (word == "post_data_bits") {
+               set(r.post_data_bits);
+            } else if (word == "post_data") {
+               set(r.post_data);
+            } else if (word == "eps") {
+               set(r.eps);
+            } else if (word == "aeps") {
+               set(r.aeps);
+            } else if (word == "frequency") {
+               set(r.frequency);
+            } else if (word == "ptrail") {
+               set(r.ptrail);
+            } else if (word == "header") {
+               set_timing(r.header);
+            } else if (word == "one") {
+               set_timing(r.one);
+            } else if (word == "zero") {
+               set_timing(r.zero);
+            } else if (word == "plead" || word == "pre" || word == "post" || word == "foot") {
+               r.unsupported = "unsupported " + word + " pulse";
+            }
+            // Everything else (gap, repeat, toggle masks, ...) does not change the encoding of a single frame
+            break;
+         }
+      }
+   }
+
+   if (current != section::none) {
+      warn(source, number, "unterminated remote " + r.name);
+   }
+}
+
+void lirc_import::finish(const remote &r, std::string_view source) {
+   if (r.name.empty()) {
+      warn(source, r.line, "remote without a name skipped");
+      ++skipped_remotes_;
+      return;
+   }
+
+   if (auto reason = check_protocol(r); !reason.empty()) {
+      warn(source, r.line, "remote " + r.name + " skipped: " + reason);
+      ++skipped_remotes_;
+      return;
+   }
+
+   for (const auto &[key, code] : r.codes) {
+      auto necx = to_necx(r, code);
+      if (!necx) {
+         warn(source, r.line, "remote " + r.name + ", key " + key + " skipped: not an address/command code");
+         continue;
+      }
+
+      if (!names_.insert(r.name + '\0' + key).second) {
+         warn(source, r.line, "remote " + r.name + ", key " + key + " skipped: defined already");
+         continue;
+      }
+
+      records_.push_back(lirc_db::record{r.name, key, {lirc_db::protocol::necx, *necx}});
+   }
+
+   ++imported_remotes_;
+}
+
+void lirc_import::warn(std::string_view source, std::uint64_t line, const std::string &text) {
+   std::string warning{source};
+   warning += ':';
+   warning += std::to_string(line);
+   warning += ": ";
+   warning += text;
+   warnings_.push_back(std::move(warning));
+}
+
+std::string lirc_import::check_protocol(const remote &r) {
+   if (!r.unsupported.empty()) {
+      return r.unsupported;
+   }
+
+   std::string_view flags = r.flags;
+   while (!flags.empty()) {
+      const auto separator = flags.find('|');
+      const auto flag = flags.substr(0, separator);
+      if (std::find(compatible_flags.begin(), compatible_flags.end(), flag) == compatible_flags.end()) {
+         return "unsupported flag " + std::string{flag};
+      }
+      flags.remove_prefix(separator == std::string_view::npos ? flags.size() : separator + 1);
+   }
+
+   if (r.pre_data_bits + r.bits + r.post_data_bits != nec_bits) {
+      return "not a 32 bit protocol";
+   }
+
+   // Same rule as lircd uses for decoding: relative or absolute tolerance, whichever is bigger
+   auto near = [&r](std::uint64_t actual, std::uint64_t expected) {
+      const auto diff = actual > expected ? actual - expected : expected - actual;
+      return diff <= std::max(r.aeps, expected * r.eps / 100);
+   };
+
+   const bool nec = near(r.header.first, nec_header_pulse) && near(r.header.second, nec_header_space) &&
+                    near(r.one.first, nec_bit_pulse) && near(r.one.second, nec_one_space) &&
+                    near(r.zero.first, nec_bit_pulse) && near(r.zero.second, nec_zero_space) &&
+                    near(r.ptrail, nec_bit_pulse);
+   if (!nec) {
+      return "timings do not match the NEC protocol";
+   }
+
+   // 0 is the lircd default
+   if (r.frequency != 0 && (r.frequency < nec_frequency * 95 / 100 || r.frequency > nec_frequency * 105 / 100)) {
+      return "carrier frequency " + std::to_string(r.frequency);
+   }
+
+   return {};
+}
+
+/**
+ * lircd sends the pre_data, code and post_data bits most significant bit first, NEC transmits each byte least
+ * significant bit first: the NECx bytes are the frame bytes with reversed bit order.
+ */
+std::optional<std::uint32_t> lirc_import::to_necx(const remote &r, std::uint64_t code) {
+   // check_protocol has limited the sum of the bit counts to 32
+   if (code >> r.bits || r.pre_data >> r.pre_data_bits || r.post_data >> r.post_data_bits) {
+      return std::nullopt;
+   }
+
+   const auto frame = (((r.pre_data << r.bits) | code) << r.post_data_bits) | r.post_data;
+   const auto address_high = reverse_byte(frame >> 24 & 0xFFU);
+   const auto address_low = reverse_byte(frame >> 16 & 0xFFU);
+   const auto command = reverse_byte(frame >> 8 & 0xFFU);
+   const auto inverse = reverse_byte(frame & 0xFFU);
+
+   if (inverse != (~command & 0xFFU)) {
+      return std::nullopt;
+   }
+
+   return address_high << 16 | address_low << 8 | command;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file   lirc_import_main.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 18, 2021
+ *
+ * Compiles lircd.conf files into a database for the --lirc-db option of ir-ctrl.
+ */
+
+#include <ir/lirc_db.h>
+#include <ir/lirc_import.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+int main(int argc, char **argv) {
+   namespace po = boost::program_options;
+
+   po::options_description all("Compile lircd.conf files into an ir-ctrl remote database");
+   all.add_options()
+      ("help,h", "Show help")
+      ("output,o", po::value<std::string>()->required(), "Database file to write")
+      ("input", po::value<std::vector<std::string>>()->required(), "lircd.conf files");
+
+   po::positional_options_description positional;
+   positional.add("input", -1);
+
+   std::string output;
+   std::vector<std::string> inputs;
+   try {
+      po::variables_map vm;
+      po::store(po::command_line_parser(argc, argv).options(all).positional(positional).run(), vm);
+
+      if (vm.count("help")) {
+         std::cout << "Usage: ir-lirc-import -o OUTPUT FILE...\n" << all << "\n";
+         return EXIT_SUCCESS;
+      }
+
+      po::notify(vm);
+      output = vm["output"].as<std::string>();
+      inputs = vm["input"].as<std::vector<std::string>>();
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      std::cerr << all << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   ir::lirc_import import;
+   for (const auto &path : inputs) {
+      std::ifstream file{path};
+      if (!file) {
+         std::cerr << "Error: unable to read " << path << std::endl;
+         return EXIT_FAILURE;
+      }
+      import.parse(file, path);
+   }
+
+   for (const auto &warning : import.warnings()) {
+      std::cerr << "Warning: " << warning << "\n";
+   }
+
+   auto res = ir::lirc_db::write(output, import.records());
+   if (!res) {
+      std::cerr << "Error: unable to write " << output << ": " << res.error().message() << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::cout << output << ": " << import.records().size() << " keys of " << import.imported_remotes() << " remotes, "
+             << import.skipped_remotes() << " remotes skipped" << std::endl;
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file   lircd_bench.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 22, 2021
+ *
+ * Replay client of the lircd socket: plays an irsend session, including the error cases, checking every reply, then
+ * measures SEND_ONCE with a new connection per command (the way irsend works) and over a single connection.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+namespace {
+
+using clock_t = std::chrono::steady_clock;
+
+//! Blocking lircd client connection
+class client {
+public:
+   explicit client(const std::string &path)
+      : fd_{::socket(AF_UNIX, SOCK_STREAM, 0)} {
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+      if (fd_ < 0 || ::connect(fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0) {
+         ::close(fd_);
+         throw std::runtime_error{"cannot connect to " + path};
+      }
+   }
+
+   client(const client &) = delete;
+   client &operator=(const client &) = delete;
+
+   ~client() { ::close(fd_); }
+
+   //! Send a directive and read its reply packet, up to and including END
+   std::string command(std::string_view line) {
+      std::string out{line};
+      out += '\n';
+      if (::send(fd_, out.data(), out.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(out.size())) {
+         throw std::runtime_error{"send failed"};
+      }
+
+      std::size_t end;
+      while ((end = in_.find("\nEND\n")) == std::string::npos) {
+         char buffer[4096];
+         const auto size = ::recv(fd_, buffer, sizeof(buffer), 0);
+         if (size <= 0) {
+            throw std::runtime_error{"connection closed"};
+         }
+         in_.append(buffer, static_cast<std::size_t>(size));
+      }
+
+      auto reply = in_.substr(0, end + 5);
+      in_.erase(0, end + 5);
+      return reply;
+   }
+
+private:
+   int fd_;
+   std::string in_{};
+};
+
+struct step {
+   std::string line;
+   bool success;
+   std::chrono::milliseconds pause{0}; //!< Wait after the reply
+};
+
+//! @return False if a reply is malformed, or its outcome is not the expected one
+bool replay(const std::string &path, const std::string &remote, const std::string &key) {
+   const auto rk = remote + " " + key;
+   const std::vector<step> session{
+      {"VERSION", true},
+      {"LIST", true},
+      {"LIST " + remote, true},
+      {"send_once " + rk, true},
+      {"SEND_ONCE " + rk + " 3", true},
+      {"SEND_ONCE " + remote + " ir-lircd-bench-no-such-key", false},
+      {"SEND_ONCE " + rk + " 99", false},
+      {"SEND_STOP " + rk, false},
+      {"SEND_START " + rk, true},
+      {"SEND_START " + rk, false, std::chrono::milliseconds{350}},
+      {"SEND_STOP " + rk, true},
+      {"LIST ir-lircd-bench-no-such-remote", false},
+      {"FOO", false},
+      {"SEND_ONCE " + remote, false},
+   };
+
+   client c{path};
+   bool ok = true;
+   for (const auto &s : session) {
+      const auto reply = c.command(s.line);
+      const auto begin = "BEGIN\n" + s.line + "\n";
+      const bool matches = reply.compare(0, begin.size(), begin) == 0 &&
+                           reply.compare(begin.size(), 8, s.success ? "SUCCESS\n" : "ERROR\nDA") == 0;
+      ok &= matches;
+
+      std::printf("%-50s %s\n", s.line.c_str(), matches ? "ok" : "FAILED");
+      if (!matches) {
+         std::printf("%s", reply.c_str());
+      }
+      std::this_thread::sleep_for(s.pause);
+   }
+   return ok;
+}
+
+template <class Send>
+bool measure(const char *name, std::size_t commands, Send &&send) {
+   std::vector<clock_t::duration> latencies;
+   latencies.reserve(commands);
+
+   for (std::size_t i = 0; i < commands; ++i) {
+      const auto started = clock_t::now();
+      if (send().find("\nSUCCESS\n") == std::string::npos) {
+         std::fprintf(stderr, "%s: command %zu failed\n", name, i);
+         return false;
+      }
+      latencies.push_back(clock_t::now() - started);
+   }
+
+   std::sort(latencies.begin(), latencies.end());
+   const auto us = [&](double p) {
+      const auto i = std::min(latencies.size() - 1, static_cast<std::size_t>(p * static_cast<double>(commands)));
+      return std::chrono::duration<double, std::micro>(latencies[i]).count();
+   };
+   std::printf("%s, %zu commands: p50 %.1f us, p99 %.1f us\n", name, commands, us(0.5), us(0.99));
+   return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+   namespace po = boost::program_options;
+
+   po::options_description all("Replay irsend sessions against the lircd socket of ir-ctrl");
+   all.add_options()
+      ("help,h", "Show help")
+      ("socket", po::value<std::string>()->default_value("/var/run/lirc/lircd"), "lircd socket of ir-ctrl (its --lircd-socket)")
+      ("remote", po::value<std::string>()->required(), "Remote in the database of ir-ctrl (its --lirc-db), with a NECx key")
+      ("key", po::value<std::string>()->required(), "NECx key of the remote")
+      ("commands", po::value<std::size_t>()->default_value(5000), "Number of commands of each latency test (0 - replay only)");
+
+   std::string path, remote, key;
+   std::size_t commands = 0;
+   try {
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, all), vm);
+
+      if (vm.count("help")) {
+         std::cout << all << "\n";
+         return EXIT_SUCCESS;
+      }
+
+      po::notify(vm);
+      path = vm["socket"].as<std::string>();
+      remote = vm["remote"].as<std::string>();
+      key = vm["key"].as<std::string>();
+      commands = vm["commands"].as<std::size_t>();
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      std::cerr << all << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   try {
+      bool ok = replay(path, remote, key);
+
+      const auto directive = "SEND_ONCE " + remote + " " + key;
+      if (ok && commands) {
+         ok &= measure("new connection per command (irsend)", commands, [&] {
+            client c{path};
+            return c.command(directive);
+         });
+
+         client persistent{path};
+         ok &= measure("persistent connection", commands, [&] { return persistent.command(directive); });
+      }
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+   }
+}
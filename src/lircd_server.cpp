@@ -0,0 +1,365 @@
+/**
+ * @file   lircd_server.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 22, 2021
+ */
+
+#include <ir/lirc_db.h>
+#include <ir/lircd_server.h>
+#include <ir/log.h>
+#include <ir/server.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+bool iequals(std::string_view lhs, std::string_view rhs) {
+   return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) {
+             return (a >= 'a' && a <= 'z' ? a - 'a' + 'A' : a) == (b >= 'a' && b <= 'z' ? b - 'a' + 'A' : b);
+          });
+}
+
+//! Whitespace-separated words of a directive, up to the array size. @return Number of words, or size + 1 if there
+//! are more.
+template <std::size_t N>
+std::size_t split(std::string_view line, std::array<std::string_view, N> &words) {
+   std::size_t count = 0;
+   for (;;) {
+      const auto begin = line.find_first_not_of(" \t");
+      if (begin == std::string_view::npos) {
+         return count;
+      }
+      if (count == N) {
+         return N + 1;
+      }
+
+      line.remove_prefix(begin);
+      const auto end = std::min(line.find_first_of(" \t"), line.size());
+      words[count++] = line.substr(0, end);
+      line.remove_prefix(end);
+   }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: lircd_server::reply
+////////////////////////////////////////////////////////////////////////////////
+lircd_server::reply::reply(std::string &out, std::string_view directive)
+   : out_{&out} {
+   out_->append("BEGIN\n");
+   out_->append(directive);
+   out_->append("\n");
+}
+
+void lircd_server::reply::error(std::string_view message) {
+   out_->append("ERROR\nDATA\n1\n");
+   out_->append(message);
+   out_->append("\n");
+}
+
+void lircd_server::reply::data(std::size_t lines, std::string_view text) {
+   std::array<char, 24> count{};
+   auto [ptr, ec] = std::to_chars(count.data(), count.data() + count.size(), lines);
+
+   out_->append("DATA\n");
+   out_->append(count.data(), static_cast<std::size_t>(ptr - count.data()));
+   out_->append("\n");
+   out_->append(text);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: lircd_server
+////////////////////////////////////////////////////////////////////////////////
+lircd_server::lircd_server(server &server, boost::asio::io_context &io, std::chrono::milliseconds repeat_interval)
+   : server_{&server}
+   , acceptor_{io.get_executor()}
+   , repeat_interval_{repeat_interval}
+   , repeat_timer_{io.get_executor()} {
+   // Nothing to do here
+}
+
+void lircd_server::listen(const std::string &path, unsigned mode) {
+   // A socket file left behind by a previous run would make the bind fail, a mistyped path to anything else must not
+   // be deleted
+   struct stat st {};
+   if (::lstat(path.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+         throw boost::system::system_error{boost::system::errc::make_error_code(boost::system::errc::file_exists),
+                                          "lircd socket " + path};
+      }
+      ::unlink(path.c_str());
+   }
+
+   acceptor_.open(protocol_t{});
+   acceptor_.bind(protocol_t::endpoint{path});
+   path_ = path;
+
+   // Before listening, so that no client connects under the umask's permissions
+   if (::chmod(path_.c_str(), static_cast<mode_t>(mode)) != 0) {
+      throw boost::system::system_error{boost::system::error_code{errno, boost::system::generic_category()},
+                                       "lircd socket " + path};
+   }
+   acceptor_.listen();
+
+   boost::asio::co_spawn(acceptor_.get_executor(), accept_loop(), boost::asio::detached);
+   log::info("lircd.listen", {log::text("path", path_)});
+}
+
+void lircd_server::stop() {
+   boost::system::error_code ec;
+   acceptor_.close(ec);
+   stop_repeat();
+
+   if (!path_.empty()) {
+      ::unlink(path_.c_str());
+   }
+}
+
+boost::asio::awaitable<void> lircd_server::accept_loop() {
+   boost::system::error_code ec;
+   for (;;) {
+      auto socket = co_await acceptor_.async_accept(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      if (ec == boost::asio::error::operation_aborted) {
+         co_return;
+      }
+
+      if (ec) {
+         log::warning("lircd.accept_error", {log::text("error", ec.message())});
+         continue;
+      }
+
+      boost::asio::co_spawn(acceptor_.get_executor(), serve(std::move(socket), next_client_++),
+                            [](std::exception_ptr e) {
+                               if (e) {
+                                  try {
+                                     std::rethrow_exception(e);
+                                  } catch (const std::exception &ex) {
+                                     log::error("lircd.client_error", {log::text("error", ex.what())});
+                                  }
+                               }
+                            });
+   }
+}
+
+boost::asio::awaitable<void> lircd_server::serve(socket_t socket, std::uint64_t client) {
+   auto &stats = server_->stats();
+   stats.lircd_clients.add(1);
+
+   std::string in;
+   std::string out;
+   in.reserve(max_line_size);
+
+   boost::system::error_code ec;
+   for (;;) {
+      // A line longer than max_line_size fails the read and closes the connection
+      const auto size = co_await boost::asio::async_read_until(
+         socket, boost::asio::dynamic_buffer(in, max_line_size), '\n',
+         boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      if (ec) {
+         break;
+      }
+
+      std::string_view line{in.data(), size - 1};
+      if (!line.empty() && line.back() == '\r') {
+         line.remove_suffix(1);
+      }
+
+      out.clear();
+      co_await handle(line, client, out);
+      in.erase(0, size);
+
+      co_await boost::asio::async_write(socket, boost::asio::buffer(out),
+                                        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      if (ec) {
+         break;
+      }
+   }
+
+   if (repeat_owner_ == client) {
+      stop_repeat();
+   }
+   stats.lircd_clients.add(-1);
+}
+
+boost::asio::awaitable<void> lircd_server::handle(std::string_view line, std::uint64_t client, std::string &out) {
+   std::array<std::string_view, 4> words{};
+   const auto count = split(line, words);
+   if (count == 0) {
+      // Empty lines are ignored by lircd as well
+      co_return;
+   }
+
+   server_->stats().lircd_commands.add();
+   reply r{out, line};
+   const auto directive = words[0];
+
+   if (count > words.size()) {
+      r.error("bad send packet");
+   } else if (iequals(directive, "VERSION") && count == 1) {
+      r.success();
+      r.data(1, "ir-ctrl\n");
+   } else if (iequals(directive, "LIST") && count <= 2) {
+      list(count == 2 ? words[1] : std::string_view{}, r);
+   } else if (iequals(directive, "SEND_ONCE") || iequals(directive, "SEND_START") || iequals(directive, "SEND_STOP")) {
+      const auto db = server_->remotes();
+      const auto code = count >= 3 && db ? db->find(words[1], words[2]) : std::nullopt;
+
+      unsigned repeats = 0;
+      if (count == 4) {
+         auto [ptr, ec] = std::from_chars(words[3].data(), words[3].data() + words[3].size(), repeats);
+         if (ec != std::errc{} || ptr != words[3].data() + words[3].size()) {
+            repeats = max_repeat + 1;
+         }
+      }
+
+      if (count < 3 || (count == 4 && !iequals(directive, "SEND_ONCE"))) {
+         r.error("bad send packet");
+      } else if (!code || code->proto != lirc_db::protocol::necx) {
+         r.error("unknown remote or key");
+      } else if (repeats > max_repeat) {
+         r.error("too many repeats");
+      } else if (iequals(directive, "SEND_ONCE") &&
+                 !server_->limits().acquire(client_key::local(), 1 + repeats, std::chrono::steady_clock::now())
+                     .admitted) {
+         server_->stats().lircd_rate_limited.add();
+         r.error("rate limited");
+      } else if (iequals(directive, "SEND_ONCE")) {
+         boost::system::error_code ec;
+         co_await server_->async_send_necx_wave(
+            client_key::local(), code->value, 1 + repeats,
+            server::deadline_after(std::chrono::steady_clock::now(), server_->get_options().lircd_deadline),
+            boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+         server_->limits().release(client_key::local());
+         if (ec == boost::asio::error::timed_out) {
+            server_->stats().lircd_expired.add();
+            r.error("deadline exceeded");
+         } else if (ec) {
+            r.error("transmission failed");
+         } else {
+            r.success();
+         }
+      } else if (iequals(directive, "SEND_START")) {
+         if (repeat_owner_) {
+            r.error("already repeating");
+         } else {
+            repeat_owner_ = client;
+            repeat_code_ = code->value;
+            repeat_remote_ = words[1];
+            repeat_key_ = words[2];
+            if (!repeat_running_) {
+               repeat_running_ = true;
+               boost::asio::co_spawn(acceptor_.get_executor(), repeat_loop(), boost::asio::detached);
+            }
+            r.success();
+         }
+      } else {
+         if (!repeat_owner_) {
+            r.error("not repeating");
+         } else if (repeat_remote_ != words[1] || repeat_key_ != words[2]) {
+            r.error("specified remote or key does not match");
+         } else {
+            stop_repeat();
+            r.success();
+         }
+      }
+   } else {
+      r.error("unknown directive");
+   }
+
+   r.end();
+}
+
+boost::asio::awaitable<void> lircd_server::repeat_loop() {
+   boost::system::error_code ec;
+
+   // A new SEND_START may take over while the loop is still finishing the previous key, so the code is re-read
+   // for every repeat
+   while (repeat_owner_) {
+      // A repeat over the share is skipped, the next one may fit again
+      const auto now = std::chrono::steady_clock::now();
+      if (server_->limits().acquire(client_key::local(), 1, now).admitted) {
+         co_await server_->async_send_necx_wave(client_key::local(), repeat_code_, 1,
+                                                server::deadline_after(now, server_->get_options().lircd_deadline),
+                                                boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+         server_->limits().release(client_key::local());
+         if (ec == boost::asio::error::timed_out) {
+            server_->stats().lircd_expired.add();
+         }
+      } else {
+         server_->stats().lircd_rate_limited.add();
+      }
+      if (!repeat_owner_) {
+         break;
+      }
+
+      repeat_timer_.expires_after(repeat_interval_);
+      co_await repeat_timer_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+   }
+
+   repeat_running_ = false;
+}
+
+void lircd_server::list(std::string_view remote, reply &r) {
+   const auto db = server_->remotes();
+   list_.clear();
+
+   if (remote.empty()) {
+      std::vector<std::string_view> remotes;
+      for (std::size_t i = 0; db && i < db->size(); ++i) {
+         remotes.push_back(db->at(i).remote);
+      }
+      std::sort(remotes.begin(), remotes.end());
+      remotes.erase(std::unique(remotes.begin(), remotes.end()), remotes.end());
+
+      for (auto name : remotes) {
+         list_.append(name);
+         list_.append("\n");
+      }
+
+      r.success();
+      if (!remotes.empty()) {
+         r.data(remotes.size(), list_);
+      }
+      return;
+   }
+
+   std::vector<lirc_db::key_view> keys;
+   for (std::size_t i = 0; db && i < db->size(); ++i) {
+      if (auto k = db->at(i); k.remote == remote) {
+         keys.push_back(k);
+      }
+   }
+
+   if (keys.empty()) {
+      r.error("unknown remote");
+      return;
+   }
+
+   std::sort(keys.begin(), keys.end(), [](const auto &lhs, const auto &rhs) { return lhs.key < rhs.key; });
+   for (const auto &k : keys) {
+      std::array<char, 20> code{};
+      std::snprintf(code.data(), code.size(), "%016x ", static_cast<unsigned>(k.code.value));
+      list_.append(code.data());
+      list_.append(k.key);
+      list_.append("\n");
+   }
+
+   r.success();
+   r.data(keys.size(), list_);
+}
+
+void lircd_server::stop_repeat() {
+   repeat_owner_ = 0;
+   repeat_timer_.cancel();
+}
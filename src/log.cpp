@@ -0,0 +1,497 @@
+/**
+ * @file   log.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 14, 2021
+ */
+
+#include <ir/log.h>
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Records
+////////////////////////////////////////////////////////////////////////////////
+constexpr std::size_t max_fields = 6;
+constexpr std::size_t max_text = 96;
+
+//! Fixed-size binary record, formatted by the background thread only
+struct record {
+   log::level level;
+   std::uint8_t num_fields;
+   std::uint8_t text_used;
+   std::uint32_t suppressed;
+   std::int64_t timestamp_ns;
+   const char *event;
+
+   struct stored_field {
+      const char *key;
+      log::field::kind type;
+      std::uint8_t text_offset;
+      std::uint8_t text_size;
+      union {
+         std::uint64_t u;
+         std::int64_t i;
+         double d;
+         const char *s;
+      };
+   };
+   std::array<stored_field, max_fields> fields;
+   std::array<char, max_text> text;
+};
+
+/**
+ * Bounded multi-producer/single-consumer ring (Dmitry Vyukov's bounded queue).
+ * Each cell carries a sequence number telling whether it is free for the producer with the matching position or
+ * holds a record for the consumer, so producers only contend on a single fetch-and-add like CAS.
+ */
+class record_ring {
+public:
+   static constexpr std::size_t capacity = 1024;
+
+public:
+   record_ring() {
+      for (std::size_t i = 0; i < capacity; ++i) {
+         cells_[i].seq.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   template <class Fill>
+   bool try_push(Fill &&fill) {
+      auto pos = enqueue_.load(std::memory_order_relaxed);
+      for (;;) {
+         auto &cell = cells_[pos & (capacity - 1)];
+         const auto seq = cell.seq.load(std::memory_order_acquire);
+         const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+         if (diff == 0) {
+            if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+               fill(cell.value);
+               cell.seq.store(pos + 1, std::memory_order_release);
+               return true;
+            }
+         } else if (diff < 0) {
+            return false;
+         } else {
+            pos = enqueue_.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   bool try_pop(record &result) {
+      auto &cell = cells_[dequeue_ & (capacity - 1)];
+      if (cell.seq.load(std::memory_order_acquire) != dequeue_ + 1) {
+         return false;
+      }
+
+      result = cell.value;
+      cell.seq.store(dequeue_ + capacity, std::memory_order_release);
+      ++dequeue_;
+      return true;
+   }
+
+private:
+   struct cell {
+      std::atomic<std::size_t> seq;
+      record value;
+   };
+
+   alignas(64) std::atomic<std::size_t> enqueue_{0};
+   alignas(64) std::size_t dequeue_{0}; //!< Consumer only
+   alignas(64) std::array<cell, capacity> cells_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Rate limiting
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Fixed window rate limiter, keyed by the event name pointer.
+ * Races between threads may let a few extra records through at the window boundary, which is fine for logging.
+ */
+class rate_limiter {
+public:
+   static constexpr std::size_t num_slots = 128;
+
+public:
+   //! @return false if the record should be suppressed, otherwise the number of previously suppressed records
+   bool allow(const char *event, std::int64_t now_ns, unsigned limit, std::uint32_t &suppressed) {
+      auto slot = find(event);
+      if (!slot) {
+         // Table is full: don't limit
+         suppressed = 0;
+         return true;
+      }
+
+      const auto window = now_ns / 1'000'000'000;
+      if (slot->window.load(std::memory_order_relaxed) != window) {
+         slot->window.store(window, std::memory_order_relaxed);
+         slot->count.store(0, std::memory_order_relaxed);
+      }
+
+      if (slot->count.fetch_add(1, std::memory_order_relaxed) >= limit) {
+         slot->suppressed.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+
+      suppressed = slot->suppressed.exchange(0, std::memory_order_relaxed);
+      return true;
+   }
+
+private:
+   struct slot {
+      std::atomic<const char *> event{nullptr};
+      std::atomic<std::int64_t> window{0};
+      std::atomic<std::uint32_t> count{0};
+      std::atomic<std::uint32_t> suppressed{0};
+   };
+
+   slot *find(const char *event) {
+      const auto hash = std::hash<const void *>{}(event);
+      for (std::size_t i = 0; i < num_slots; ++i) {
+         auto &s = slots_[(hash + i) % num_slots];
+         const char *current = s.event.load(std::memory_order_acquire);
+         if (current == event) {
+            return &s;
+         }
+
+         if (!current && s.event.compare_exchange_strong(current, event, std::memory_order_acq_rel)) {
+            return &s;
+         }
+
+         if (current == event) {
+            return &s;
+         }
+      }
+      return nullptr;
+   }
+
+   std::array<slot, num_slots> slots_{};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Formatting
+////////////////////////////////////////////////////////////////////////////////
+const char *level_name(log::level l) {
+   switch (l) {
+      case log::level::debug:
+         return "debug";
+      case log::level::info:
+         return "info";
+      case log::level::warning:
+         return "warning";
+      case log::level::error:
+         return "error";
+   }
+   return "unknown";
+}
+
+//! syslog(3) priority, understood by journald as a line prefix
+char syslog_priority(log::level l) {
+   switch (l) {
+      case log::level::debug:
+         return '7';
+      case log::level::info:
+         return '6';
+      case log::level::warning:
+         return '4';
+      case log::level::error:
+         return '3';
+   }
+   return '6';
+}
+
+template <class T>
+void append_number(std::string &out, T value) {
+   char buffer[32];
+   auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+   out.append(buffer, ptr);
+}
+
+//! logfmt value: quoted if it contains spaces, quotes or '='
+void append_value(std::string &out, std::string_view value) {
+   const bool quote = value.empty() || value.find_first_of(" \"=\\\n") != std::string_view::npos;
+   if (!quote) {
+      out += value;
+      return;
+   }
+
+   out += '"';
+   for (auto c : value) {
+      if (c == '"' || c == '\\') {
+         out += '\\';
+         out += c;
+      } else if (c == '\n') {
+         out += "\\n";
+      } else {
+         out += c;
+      }
+   }
+   out += '"';
+}
+
+void append_timestamp(std::string &out, std::int64_t ns) {
+   const std::time_t seconds = ns / 1'000'000'000;
+   std::tm tm{};
+   gmtime_r(&seconds, &tm);
+
+   char buffer[32];
+   const auto size = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+   out.append(buffer, size);
+
+   auto us = (ns / 1000) % 1'000'000;
+   char fraction[7] = {'.'};
+   for (int i = 6; i > 0; --i) {
+      fraction[i] = static_cast<char>('0' + us % 10);
+      us /= 10;
+   }
+   out.append(fraction, sizeof(fraction));
+   out += 'Z';
+}
+
+void format(std::string &out, const record &r, bool journal) {
+   if (journal) {
+      out += '<';
+      out += syslog_priority(r.level);
+      out += '>';
+   } else {
+      out += "ts=";
+      append_timestamp(out, r.timestamp_ns);
+      out += ' ';
+   }
+
+   out += "level=";
+   out += level_name(r.level);
+   out += " event=";
+   out += r.event;
+
+   for (std::size_t i = 0; i < r.num_fields; ++i) {
+      const auto &f = r.fields[i];
+      out += ' ';
+      out += f.key;
+      out += '=';
+
+      switch (f.type) {
+         case log::field::kind::unsigned_int:
+            append_number(out, f.u);
+            break;
+
+         case log::field::kind::signed_int:
+            append_number(out, f.i);
+            break;
+
+         case log::field::kind::hex: {
+            char buffer[24];
+            auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), f.u, 16);
+            out += "0x";
+            out.append(buffer, ptr);
+            break;
+         }
+
+         case log::field::kind::real:
+            append_number(out, f.d);
+            break;
+
+         case log::field::kind::literal:
+            append_value(out, f.s);
+            break;
+
+         case log::field::kind::text:
+            append_value(out, {r.text.data() + f.text_offset, f.text_size});
+            break;
+      }
+   }
+
+   if (r.suppressed) {
+      out += " suppressed=";
+      append_number(out, r.suppressed);
+   }
+
+   out += '\n';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Logger state
+////////////////////////////////////////////////////////////////////////////////
+struct logger {
+   record_ring ring{};
+   rate_limiter limiter{};
+
+   std::atomic<log::level> min_level{log::level::info};
+   std::atomic<unsigned> rate_limit{0};
+   std::atomic<std::uint64_t> dropped{0};
+
+   //! Incremented after each record, the background thread waits on it. Producers only issue the (system call
+   //! backed) notification if the background thread is actually asleep.
+   std::atomic<std::uint32_t> pending{0};
+   std::atomic<bool> sleeping{false};
+   std::atomic<bool> stopping{false};
+   std::thread thread{};
+
+   void drain(bool journal);
+};
+
+logger &instance() {
+   static logger l;
+   return l;
+}
+
+void logger::drain(bool journal) {
+   std::string out;
+   out.reserve(4096);
+
+   for (;;) {
+      const auto seen = pending.load(std::memory_order_acquire);
+
+      record r;
+      while (ring.try_pop(r)) {
+         format(out, r, journal);
+         if (out.size() >= 3072) {
+            [[maybe_unused]] auto res = ::write(STDOUT_FILENO, out.data(), out.size());
+            out.clear();
+         }
+      }
+
+      if (!out.empty()) {
+         [[maybe_unused]] auto res = ::write(STDOUT_FILENO, out.data(), out.size());
+         out.clear();
+      }
+
+      if (stopping.load(std::memory_order_acquire)) {
+         // Pick up anything pushed before the stop request
+         if (!ring.try_pop(r)) {
+            return;
+         }
+         format(out, r, journal);
+         continue;
+      }
+
+      sleeping.store(true);
+      if (pending.load() == seen) {
+         pending.wait(seen);
+      }
+      sleeping.store(false);
+
+      // Let a burst of records accumulate instead of waking up for each one of them
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Functions
+////////////////////////////////////////////////////////////////////////////////
+void log::start(level min_level, unsigned rate_limit) {
+   auto &l = instance();
+   l.min_level.store(min_level, std::memory_order_relaxed);
+   l.rate_limit.store(rate_limit, std::memory_order_relaxed);
+   l.stopping.store(false, std::memory_order_relaxed);
+
+   // systemd sets JOURNAL_STREAM for the services with their stdout connected to the journal
+   const bool journal = std::getenv("JOURNAL_STREAM") != nullptr;
+   l.thread = std::thread([&l, journal] { l.drain(journal); });
+}
+
+void log::stop() {
+   auto &l = instance();
+   if (!l.thread.joinable()) {
+      return;
+   }
+
+   l.stopping.store(true);
+   l.pending.fetch_add(1);
+   l.pending.notify_one();
+   l.thread.join();
+}
+
+bool log::enabled(level lvl) {
+   return lvl >= instance().min_level.load(std::memory_order_relaxed);
+}
+
+void log::write(level lvl, const char *event, std::initializer_list<field> fields) {
+   auto &l = instance();
+   if (lvl < l.min_level.load(std::memory_order_relaxed)) {
+      return;
+   }
+
+   const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+
+   std::uint32_t suppressed = 0;
+   const auto limit = l.rate_limit.load(std::memory_order_relaxed);
+   if (limit && !l.limiter.allow(event, now, limit, suppressed)) {
+      return;
+   }
+
+   const bool pushed = l.ring.try_push([&](record &r) {
+      r.level = lvl;
+      r.suppressed = suppressed;
+      r.timestamp_ns = now;
+      r.event = event;
+      r.num_fields = 0;
+      r.text_used = 0;
+
+      for (const auto &f : fields) {
+         if (r.num_fields == max_fields) {
+            break;
+         }
+
+         auto &stored = r.fields[r.num_fields++];
+         stored.key = f.key;
+         stored.type = f.type;
+         stored.u = f.u;
+
+         if (f.type == field::kind::text) {
+            const auto size = std::min(f.text.size(), max_text - r.text_used);
+            std::memcpy(r.text.data() + r.text_used, f.text.data(), size);
+            stored.text_offset = r.text_used;
+            stored.text_size = static_cast<std::uint8_t>(size);
+            r.text_used = static_cast<std::uint8_t>(r.text_used + size);
+         }
+      }
+   });
+
+   if (!pushed) {
+      l.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+
+   l.pending.fetch_add(1);
+   if (l.sleeping.load()) {
+      l.pending.notify_one();
+   }
+}
+
+std::uint64_t log::dropped() {
+   return instance().dropped.load(std::memory_order_relaxed);
+}
+
+bool log::parse_level(std::string_view text, level &result) {
+   constexpr std::array<std::pair<std::string_view, level>, 4> names{{
+      {"debug", level::debug},
+      {"info", level::info},
+      {"warning", level::warning},
+      {"error", level::error},
+   }};
+
+   for (const auto &[name, value] : names) {
+      if (name == text) {
+         result = value;
+         return true;
+      }
+   }
+   return false;
+}
@@ -28,6 +28,9 @@ struct gpio_setup {
 void main_unsafe(ir::server::options opts) {
    static gpio_setup s_gpio_setup;
 
+   // Outlives the server, so that all of its records get written
+   ir::log::session logging{opts.log_level, opts.log_rate_limit};
+
    ir::server server{opts};
    server.run();
 }
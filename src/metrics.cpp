@@ -0,0 +1,122 @@
+/**
+ * @file   metrics.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 12, 2021
+ */
+
+#include <ir/metrics.h>
+
+#include <charconv>
+
+using namespace ir::metrics;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: histogram
+////////////////////////////////////////////////////////////////////////////////
+histogram::snapshot histogram::read() const noexcept {
+   snapshot result;
+   for (const auto &s : shards_) {
+      for (std::size_t i = 0; i < result.counts.size(); ++i) {
+         result.counts[i] += s.counts[i].load(std::memory_order_relaxed);
+      }
+      result.sum += s.sum.load(std::memory_order_relaxed);
+   }
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: text_writer
+////////////////////////////////////////////////////////////////////////////////
+void text_writer::header(std::string_view name, std::string_view help, std::string_view type) {
+   auto &out = *out_;
+   out += "# HELP ";
+   out += name;
+   out += ' ';
+   out += help;
+   out += "\n# TYPE ";
+   out += name;
+   out += ' ';
+   out += type;
+   out += '\n';
+}
+
+void text_writer::sample(std::string_view name, std::string_view labels, std::uint64_t value) {
+   auto &out = *out_;
+   out += name;
+   if (!labels.empty()) {
+      out += '{';
+      out += labels;
+      out += '}';
+   }
+   out += ' ';
+   append(value);
+   out += '\n';
+}
+
+void text_writer::sample(std::string_view name, std::string_view labels, std::int64_t value) {
+   if (value < 0) {
+      // Gauges only, and these are not expected to go negative
+      value = 0;
+   }
+   sample(name, labels, static_cast<std::uint64_t>(value));
+}
+
+void text_writer::sample(std::string_view name, std::string_view labels, double value) {
+   auto &out = *out_;
+   out += name;
+   if (!labels.empty()) {
+      out += '{';
+      out += labels;
+      out += '}';
+   }
+   out += ' ';
+   append(value);
+   out += '\n';
+}
+
+void text_writer::counter(std::string_view name, std::string_view help, std::uint64_t value) {
+   header(name, help, "counter");
+   sample(name, {}, value);
+}
+
+void text_writer::gauge(std::string_view name, std::string_view help, std::int64_t value) {
+   header(name, help, "gauge");
+   sample(name, {}, value);
+}
+
+void text_writer::histogram(std::string_view name, std::string_view help, const metrics::histogram &h) {
+   header(name, help, "histogram");
+
+   const auto snapshot = h.read();
+   const std::string bucket = std::string(name) + "_bucket";
+
+   std::uint64_t cumulative = 0;
+   for (std::size_t i = 0; i < metrics::histogram::num_buckets; ++i) {
+      cumulative += snapshot.counts[i];
+
+      auto &out = *out_;
+      out += bucket;
+      out += "{le=\"";
+      append(static_cast<double>(metrics::histogram::bucket_upper_bound(i)) / 1e6);
+      out += "\"} ";
+      append(cumulative);
+      out += '\n';
+   }
+
+   cumulative += snapshot.counts[metrics::histogram::num_buckets];
+   sample(bucket, "le=\"+Inf\"", cumulative);
+   sample(std::string(name) + "_sum", {}, static_cast<double>(snapshot.sum) / 1e6);
+   sample(std::string(name) + "_count", {}, cumulative);
+}
+
+void text_writer::append(std::uint64_t value) {
+   char buffer[24];
+   auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+   out_->append(buffer, ptr);
+}
+
+void text_writer::append(double value) {
+   char buffer[32];
+   auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+   out_->append(buffer, ptr);
+}
@@ -30,14 +30,30 @@ constexpr wave::wave_parameters nec_parameters{
 /// Class: necx
 ////////////////////////////////////////////////////////////////////////////////
 /**
- * Construct an extended NEC wave.
+ * Construct (encode) an extended NEC wave. The wave has to be uploaded before it can be sent.
  * @param pin_number Raspberry Pi pin number for the IR LED.
  * @param code Binary NEC code (24 bits of address followed by 8 bits of code)
  */
 necx::necx(int pin_number, std::uint32_t code)
    : wave{pin_number, nec_parameters}
    , code_{code} {
-   build();
+   encode();
+}
+
+/**
+ * Construct an extended NEC wave from an already encoded pulse train.
+ * @param pin_number Raspberry Pi pin number for the IR LED.
+ * @param code Binary NEC code, the pulses were encoded from.
+ * @param pulses Pulse train, as returned by pulses() of a wave with the same key.
+ */
+necx::necx(int pin_number, std::uint32_t code, std::span<const gpioPulse_t> pulses)
+   : wave{pin_number, nec_parameters}
+   , code_{code} {
+   assign(pulses);
+}
+
+wave::key necx::make_key(int pin_number, std::uint32_t code) {
+   return wave::make_key("necx", nec_parameters, pin_number, code);
 }
 
 void necx::add_payload() {
@@ -0,0 +1,255 @@
+/**
+ * @file   pulse_cache.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 16, 2021
+ */
+
+#include <ir/log.h>
+#include <ir/pulse_cache.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+constexpr std::array<char, 8> file_magic{'I', 'R', 'P', 'U', 'L', 'S', 'E', 'S'};
+constexpr std::uint32_t file_version = 1;
+
+struct file_header {
+   std::array<char, 8> magic;
+   std::uint32_t version;
+   std::uint32_t num_entries;
+   std::uint64_t file_size;
+   std::uint32_t table_crc;
+   std::uint32_t reserved;
+};
+
+struct file_entry {
+   std::uint32_t protocol;
+   std::uint32_t parameters;
+   std::int32_t pin;
+   std::uint32_t code;
+   std::uint64_t hits;
+   std::uint64_t offset;
+   std::uint32_t num_pulses;
+   std::uint32_t pulses_crc;
+};
+
+static_assert(sizeof(gpioPulse_t) == 12, "Unexpected pulse layout");
+static_assert(sizeof(file_header) == 32 && sizeof(file_entry) == 40, "Unexpected cache file layout");
+
+constexpr std::array<std::uint32_t, 256> make_crc_table() {
+   std::array<std::uint32_t, 256> result{};
+   for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+         c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+      }
+      result[i] = c;
+   }
+   return result;
+}
+
+constexpr auto crc_table = make_crc_table();
+
+//! CRC-32 (IEEE 802.3)
+std::uint32_t crc32(const void *data, std::size_t size) {
+   std::uint32_t crc = 0xFFFFFFFFU;
+   auto bytes = static_cast<const unsigned char *>(data);
+   for (std::size_t i = 0; i < size; ++i) {
+      crc = crc_table[(crc ^ bytes[i]) & 0xFFU] ^ (crc >> 8);
+   }
+   return crc ^ 0xFFFFFFFFU;
+}
+
+bool write_all(int fd, const void *data, std::size_t size) {
+   auto bytes = static_cast<const char *>(data);
+   while (size) {
+      const auto res = ::write(fd, bytes, size);
+      if (res <= 0) {
+         return false;
+      }
+      bytes += res;
+      size -= static_cast<std::size_t>(res);
+   }
+   return true;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: pulse_cache
+////////////////////////////////////////////////////////////////////////////////
+pulse_cache::pulse_cache(std::string path)
+   : path_{std::move(path)} {
+   auto res = load();
+   if (!res) {
+      if (res.error() != std::errc::no_such_file_or_directory) {
+         log::warning("wave_cache.invalid", {log::text("path", path_), log::text("error", res.error().message())});
+      }
+      unmap();
+      index_.clear();
+   }
+}
+
+pulse_cache::~pulse_cache() {
+   unmap();
+}
+
+result_t<void> pulse_cache::load() {
+   const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      return std::error_code{errno, std::generic_category()};
+   }
+
+   struct stat st {};
+   if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(file_header)) {
+      ::close(fd);
+      return std::errc::invalid_argument;
+   }
+
+   mapping_size_ = static_cast<std::size_t>(st.st_size);
+   mapping_ = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (mapping_ == MAP_FAILED) {
+      mapping_ = nullptr;
+      return std::error_code{errno, std::generic_category()};
+   }
+
+   const auto base = static_cast<const char *>(mapping_);
+   file_header header{};
+   std::memcpy(&header, base, sizeof(header));
+
+   if (header.magic != file_magic || header.version != file_version || header.file_size != mapping_size_) {
+      return std::errc::invalid_argument;
+   }
+
+   const auto table_size = std::size_t{header.num_entries} * sizeof(file_entry);
+   if (table_size > mapping_size_ - sizeof(file_header)) {
+      return std::errc::invalid_argument;
+   }
+
+   const auto table = base + sizeof(file_header);
+   if (crc32(table, table_size) != header.table_crc) {
+      return std::errc::bad_message;
+   }
+
+   for (std::uint32_t i = 0; i < header.num_entries; ++i) {
+      file_entry e{};
+      std::memcpy(&e, table + i * sizeof(file_entry), sizeof(e));
+
+      const auto size = std::size_t{e.num_pulses} * sizeof(gpioPulse_t);
+      const bool in_bounds = e.offset <= mapping_size_ && size <= mapping_size_ - e.offset;
+      if (!in_bounds || e.offset % alignof(gpioPulse_t) != 0 || crc32(base + e.offset, size) != e.pulses_crc) {
+         log::warning("wave_cache.bad_entry", {log::hex("code", e.code), log::kv("pin", std::int64_t{e.pin})});
+         continue;
+      }
+
+      const auto pulses = reinterpret_cast<const gpioPulse_t *>(base + e.offset);
+      index_[wave::key{e.protocol, e.parameters, e.pin, e.code}] = entry{e.hits, {pulses, e.num_pulses}};
+   }
+
+   return outcome::success();
+}
+
+void pulse_cache::unmap() {
+   if (mapping_) {
+      ::munmap(mapping_, mapping_size_);
+      mapping_ = nullptr;
+      mapping_size_ = 0;
+   }
+}
+
+std::optional<std::span<const gpioPulse_t>> pulse_cache::find(const wave::key &key) const {
+   auto it = index_.find(key);
+   if (it == std::end(index_)) {
+      return std::nullopt;
+   }
+   return it->second.pulses;
+}
+
+std::uint64_t pulse_cache::hits(const wave::key &key) const {
+   auto it = index_.find(key);
+   return it == std::end(index_) ? 0 : it->second.hits;
+}
+
+std::vector<wave::key> pulse_cache::hottest(std::size_t count) const {
+   std::vector<std::pair<std::uint64_t, wave::key>> all;
+   all.reserve(index_.size());
+   for (const auto &[key, e] : index_) {
+      all.emplace_back(e.hits, key);
+   }
+
+   count = std::min(count, all.size());
+   std::partial_sort(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(count), all.end(),
+                     [](const auto &lhs, const auto &rhs) { return lhs.first > rhs.first; });
+
+   std::vector<wave::key> result;
+   result.reserve(count);
+   for (std::size_t i = 0; i < count; ++i) {
+      result.push_back(all[i].second);
+   }
+   return result;
+}
+
+result_t<void> pulse_cache::save(const std::vector<record> &records) const {
+   // New records first, then everything else from the current file
+   std::vector<record> all = records;
+   for (const auto &[key, e] : index_) {
+      const bool updated =
+         std::any_of(records.begin(), records.end(), [&key = key](const record &r) { return r.key == key; });
+      if (!updated) {
+         all.push_back(record{key, e.hits, e.pulses});
+      }
+   }
+
+   file_header header{};
+   header.magic = file_magic;
+   header.version = file_version;
+   header.num_entries = static_cast<std::uint32_t>(all.size());
+
+   std::vector<file_entry> table;
+   table.reserve(all.size());
+
+   std::uint64_t offset = sizeof(file_header) + all.size() * sizeof(file_entry);
+   for (const auto &r : all) {
+      const auto size = r.pulses.size_bytes();
+      table.push_back(file_entry{r.key.protocol, r.key.parameters, r.key.pin, r.key.code, r.hits, offset,
+                                 static_cast<std::uint32_t>(r.pulses.size()), crc32(r.pulses.data(), size)});
+      offset += size;
+   }
+
+   header.file_size = offset;
+   header.table_crc = crc32(table.data(), table.size() * sizeof(file_entry));
+
+   const auto temp_path = path_ + ".tmp";
+   const int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      return std::error_code{errno, std::generic_category()};
+   }
+
+   bool ok = write_all(fd, &header, sizeof(header)) && write_all(fd, table.data(), table.size() * sizeof(file_entry));
+   for (const auto &r : all) {
+      ok = ok && write_all(fd, r.pulses.data(), r.pulses.size_bytes());
+   }
+   ok = ok && ::fsync(fd) == 0;
+
+   const auto error = errno;
+   ::close(fd);
+
+   if (!ok || ::rename(temp_path.c_str(), path_.c_str()) != 0) {
+      const auto ec = std::error_code{ok ? errno : error, std::generic_category()};
+      ::unlink(temp_path.c_str());
+      return ec;
+   }
+
+   return outcome::success();
+}
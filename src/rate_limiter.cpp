@@ -0,0 +1,90 @@
+/**
+ * @file   rate_limiter.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 26, 2021
+ */
+
+#include <ir/rate_limiter.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ir;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: rate_limiter
+////////////////////////////////////////////////////////////////////////////////
+rate_limiter::rate_limiter(const config &cfg)
+   : config_{cfg} {
+   buckets_.reserve(config_.max_clients);
+}
+
+rate_limiter::decision rate_limiter::acquire(const client_key &client, unsigned cost, clock_t::time_point now) {
+   if (!enabled()) {
+      return {true};
+   }
+
+   const double burst = std::max(1U, config_.burst);
+   // A batch larger than the bucket would never get through otherwise
+   const double needed = std::min(static_cast<double>(std::max(1U, cost)), burst);
+
+   std::lock_guard lock{mutex_};
+
+   auto it = buckets_.find(client);
+   if (it == std::end(buckets_)) {
+      if (buckets_.size() >= config_.max_clients) {
+         sweep(now);
+         if (buckets_.size() >= config_.max_clients) {
+            // Every known client is busy: too many of them to keep track of, so nobody new gets in
+            return {false, std::chrono::seconds{1}};
+         }
+      }
+      it = buckets_.emplace(client, bucket{burst, now}).first;
+   }
+
+   auto &b = it->second;
+   if (config_.rate > 0) {
+      const auto elapsed = std::chrono::duration<double>(now - b.updated).count();
+      b.tokens = std::min(burst, b.tokens + elapsed * config_.rate);
+      b.updated = now;
+
+      if (b.tokens < needed) {
+         const auto wait = std::ceil((needed - b.tokens) / config_.rate);
+         return {false, std::chrono::seconds{std::max(1L, static_cast<long>(wait))}};
+      }
+   }
+
+   if (config_.max_pending && b.pending >= config_.max_pending) {
+      // The queue drains at the speed of the transmitter, a second is a reasonable guess
+      return {false, std::chrono::seconds{1}};
+   }
+
+   if (config_.rate > 0) {
+      b.tokens -= needed;
+   }
+   ++b.pending;
+   return {true};
+}
+
+void rate_limiter::release(const client_key &client) {
+   if (!enabled()) {
+      return;
+   }
+
+   std::lock_guard lock{mutex_};
+   auto it = buckets_.find(client);
+   if (it != std::end(buckets_) && it->second.pending) {
+      --it->second.pending;
+   }
+}
+
+void rate_limiter::sweep(clock_t::time_point now) {
+   const double burst = std::max(1U, config_.burst);
+   std::erase_if(buckets_, [&](const auto &entry) {
+      const auto &b = entry.second;
+      const auto tokens = config_.rate > 0
+                             ? b.tokens + std::chrono::duration<double>(now - b.updated).count() * config_.rate
+                             : burst;
+      return b.pending == 0 && tokens >= burst;
+   });
+}
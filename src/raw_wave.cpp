@@ -0,0 +1,46 @@
+/**
+ * @file   raw_wave.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 19, 2021
+ */
+
+#include <ir/raw_wave.h>
+
+using namespace ir;
+
+namespace {
+
+wave::wave_parameters raw_parameters(double frequency_hz) {
+   // Everything but the carrier comes from the timings
+   constexpr wave::bit_encoding unused{.burst_duration = {}, .gap_duration = {}, .burst_first = true};
+   return wave::wave_parameters{.frequency_hz = frequency_hz,
+                                .duty_cycle = 0.5,
+                                .leading_pulse = {},
+                                .leading_gap = {},
+                                .logical_one = unused,
+                                .logical_zero = unused,
+                                .trailing_pulse = std::nullopt};
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: raw_wave
+////////////////////////////////////////////////////////////////////////////////
+raw_wave::raw_wave(int pin_number, double frequency_hz, std::span<const std::uint32_t> timings)
+   : wave{pin_number, raw_parameters(frequency_hz)}
+   , timings_{timings} {
+   encode();
+   timings_ = {};
+}
+
+void raw_wave::add_payload() {
+   for (std::size_t i = 0; i < timings_.size(); ++i) {
+      const duration_t duration{timings_[i]};
+      if (i % 2 == 0) {
+         add_carrier_frequency(duration);
+      } else {
+         add_gap(duration);
+      }
+   }
+}
@@ -0,0 +1,246 @@
+/**
+ * @file   scheduler.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 27, 2021
+ */
+
+#include <ir/scheduler.h>
+#include <ir/server.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <limits>
+
+using namespace ir;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: scheduler
+////////////////////////////////////////////////////////////////////////////////
+scheduler::scheduler(server &server,
+                     boost::asio::io_context &io,
+                     std::size_t max_jobs,
+                     std::size_t max_jobs_per_client)
+   : server_{&server}
+   , max_jobs_{max_jobs}
+   , max_jobs_per_client_{max_jobs_per_client}
+   , origin_{clock_t::now()}
+   , timer_{io} {
+   // Nothing to do here
+}
+
+void scheduler::start() {
+   boost::asio::co_spawn(timer_.get_executor(), run(), boost::asio::detached);
+}
+
+void scheduler::stop() {
+   stopped_ = true;
+   timer_.cancel();
+}
+
+result_t<std::uint64_t> scheduler::add(const job_spec &spec) {
+   std::lock_guard lock{mutex_};
+   if (num_jobs_.load(std::memory_order_relaxed) >= max_jobs_) {
+      return std::errc::no_buffer_space;
+   }
+
+   // Creating the jobs is rate limited, but a client must not fill the table with them over time either
+   auto &client_jobs = jobs_per_client_[spec.client];
+   if (client_jobs >= max_jobs_per_client_) {
+      return std::errc::resource_unavailable_try_again;
+   }
+   ++client_jobs;
+
+   std::uint32_t index;
+   if (free_.empty()) {
+      index = static_cast<std::uint32_t>(jobs_.size());
+      jobs_.push_back(std::make_unique<job>());
+   } else {
+      index = free_.back();
+      free_.pop_back();
+   }
+
+   auto &j = *jobs_[index];
+   j.index = index;
+   j.used = true;
+   j.running = false;
+   j.spec = spec;
+   j.next = spec.first;
+   j.runs = j.skipped = j.expired = j.failed = 0;
+   schedule(j);
+
+   num_jobs_.fetch_add(1, std::memory_order_relaxed);
+   server_->stats().scheduled_jobs.add(1);
+
+   // The timer sleeps until the earliest job it knows about, an earlier one has to wake it up
+   if (j.expiry < wake_tick_.load(std::memory_order_relaxed)) {
+      wake_tick_.store(j.expiry, std::memory_order_relaxed);
+      boost::asio::post(timer_.get_executor(), [this] { timer_.cancel(); });
+   }
+   return id_of(j);
+}
+
+bool scheduler::cancel(std::uint64_t id) {
+   std::lock_guard lock{mutex_};
+   auto j = find(id);
+   if (!j) {
+      return false;
+   }
+
+   // A run already queued for the transmitter still goes out, its completion finds the job gone
+   release(*j);
+   return true;
+}
+
+void scheduler::write_json(std::string &out) const {
+   // Steady time is only meaningful to the process, the clients get the wall clock time of the next run
+   const auto steady_now = clock_t::now();
+   const auto system_now = std::chrono::system_clock::now();
+
+   std::lock_guard lock{mutex_};
+   out += R"({"jobs":[)";
+   bool first = true;
+   for (const auto &j : jobs_) {
+      if (!j->used) {
+         continue;
+      }
+
+      const auto next =
+         system_now + std::chrono::duration_cast<std::chrono::system_clock::duration>(j->next - steady_now);
+      const auto next_ms = std::chrono::duration_cast<std::chrono::milliseconds>(next.time_since_epoch()).count();
+
+      char buffer[384];
+      const auto size = std::snprintf(
+         buffer, sizeof(buffer),
+         R"(%s{"id":%)" PRIu64 R"(,"code":%)" PRIu32 R"(,"count":%u,"next":%lld.%03lld,"period_ms":%lld,)"
+         R"("deadline_ms":%lld,"precise":%s,"running":%s,"runs":%)" PRIu64 R"(,"skipped":%)" PRIu64
+         R"(,"expired":%)" PRIu64 R"(,"failed":%)" PRIu64 "}",
+         first ? "" : ",", id_of(*j), j->spec.code, j->spec.count, static_cast<long long>(next_ms / 1000),
+         static_cast<long long>(next_ms % 1000), static_cast<long long>(j->spec.period.count()),
+         static_cast<long long>(j->spec.deadline.count()), j->spec.precise ? "true" : "false",
+         j->running ? "true" : "false", j->runs, j->skipped, j->expired, j->failed);
+      out.append(buffer, static_cast<std::size_t>(size));
+      first = false;
+   }
+   out += "]}\n";
+}
+
+boost::asio::awaitable<void> scheduler::run() {
+   boost::system::error_code ec;
+   while (!stopped_) {
+      {
+         std::lock_guard lock{mutex_};
+         const auto next = wheel_.next_expiry();
+         wake_tick_.store(next.value_or(std::numeric_limits<std::uint64_t>::max()), std::memory_order_relaxed);
+         timer_.expires_at(next ? origin_ + std::chrono::milliseconds{*next} : clock_t::time_point::max());
+      }
+
+      // Cancelled by stop, or by a job added for an earlier time than the timer is set to
+      co_await timer_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      if (stopped_) {
+         break;
+      }
+      fire(clock_t::now());
+   }
+}
+
+void scheduler::fire(clock_t::time_point now) {
+   auto &stats = server_->stats();
+   const auto tick = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::max(now, origin_) - origin_).count());
+
+   std::lock_guard lock{mutex_};
+   wheel_.advance(tick, [&](timer_wheel::entry &e) {
+      auto &j = static_cast<job &>(e);
+
+      if (j.running) {
+         ++j.skipped;
+         stats.schedule_skipped.add();
+      } else {
+         // The transmitter waits for the start of a precise job, the others are due already
+         j.running = true;
+         server_->async_send_necx_wave_at(j.spec.client, j.spec.code, j.spec.count, j.next,
+                                          server::deadline_after(j.next, j.spec.deadline),
+                                          [this, id = id_of(j)](boost::system::error_code ec) { complete(id, ec); });
+      }
+
+      if (j.spec.period.count() == 0) {
+         return;
+      }
+
+      // The phase is kept: the runs missed while the control context was busy are skipped, not caught up on
+      j.next += j.spec.period;
+      while (j.next < now) {
+         j.next += j.spec.period;
+         ++j.skipped;
+         stats.schedule_skipped.add();
+      }
+      schedule(j);
+   });
+}
+
+void scheduler::complete(std::uint64_t id, boost::system::error_code ec) {
+   auto &stats = server_->stats();
+   if (ec == boost::asio::error::timed_out) {
+      stats.schedule_expired.add();
+   } else if (!ec) {
+      stats.schedule_runs.add();
+   }
+
+   std::lock_guard lock{mutex_};
+   auto j = find(id);
+   if (!j) {
+      return;
+   }
+
+   j->running = false;
+   if (ec == boost::asio::error::timed_out) {
+      ++j->expired;
+   } else if (ec) {
+      ++j->failed;
+   } else {
+      ++j->runs;
+   }
+
+   if (j->spec.period.count() == 0) {
+      release(*j);
+   }
+}
+
+void scheduler::schedule(job &j) {
+   wheel_.insert(j, tick_of(j.spec.precise ? j.next - precise_lead : j.next));
+}
+
+scheduler::job *scheduler::find(std::uint64_t id) const {
+   const auto index = static_cast<std::uint32_t>(id);
+   if (index >= jobs_.size()) {
+      return nullptr;
+   }
+
+   auto j = jobs_[index].get();
+   return j->used && j->generation == static_cast<std::uint32_t>(id >> 32) ? j : nullptr;
+}
+
+void scheduler::release(job &j) {
+   if (j.linked()) {
+      wheel_.remove(j);
+   }
+
+   if (auto it = jobs_per_client_.find(j.spec.client); it != std::end(jobs_per_client_) && --it->second == 0) {
+      jobs_per_client_.erase(it);
+   }
+
+   // Identifiers of the job in its previous use no longer match
+   j.used = false;
+   ++j.generation;
+   free_.push_back(j.index);
+
+   num_jobs_.fetch_sub(1, std::memory_order_relaxed);
+   server_->stats().scheduled_jobs.add(-1);
+}
+
+std::uint64_t scheduler::tick_of(clock_t::time_point time) const {
+   if (time <= origin_) {
+      return 0;
+   }
+   return static_cast<std::uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(time - origin_).count());
+}
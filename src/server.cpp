@@ -4,153 +4,113 @@
  * @date   Nov. 16, 2021
  */
 
+#include <ir/catalog.h>
+#include <ir/log.h>
 #include <ir/necx.h>
+#include <ir/pulse_cache.h>
+#include <ir/raw_wave.h>
 #include <ir/server.h>
+#include <ir/uri.h>
 
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
 #include <memory>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include <boost/asio/signal_set.hpp>
-#include <boost/beast/core.hpp>
-#include <boost/beast/http.hpp>
-#include <boost/regex.hpp>
+#include <boost/asio/thread_pool.hpp>
 
 #include <pigpio.h>
 
+#include <grp.h>
+
 using tcp = boost::asio::ip::tcp;
-namespace beast = boost::beast;
-namespace http = beast::http;
 
 using namespace ir;
 
 namespace {
 
-// https://github.com/facebook/folly/blob/main/folly/Uri.cpp
-class uri {
-public:
-   using param_list_t = std::vector<std::pair<std::string, std::string>>;
+//! A scheduled transmission busy-waits this last stretch before its start, the sleep before it is not that precise
+constexpr std::chrono::milliseconds start_spin{2};
 
-public:
-   static param_list_t get_query_params(beast::string_view text) {
-      static const boost::regex query_param_regex(
-              "(^|&)" /*start of query or start of parameter "&"*/
-              "([^=&]*)=?" /*parameter name and "=" if value is expected*/
-              "([^=&]*)" /*parameter value*/
-              "(?=(&|$))" /*forward reference, next should be end of query or
-                            start of next parameter*/);
-
-      param_list_t result{};
-      const boost::cregex_iterator begin(text.data(), text.data() + text.size(), query_param_regex);
-      boost::cregex_iterator end;
-      for (auto it = begin; it != end; ++it) {
-         if (it->length(2) == 0) {
-            // key is empty, ignore it
-            continue;
-         }
-         result.emplace_back(std::string((*it)[2].first, (*it)[2].second), // parameter name
-                             std::string((*it)[3].first, (*it)[3].second)  // parameter value
-         );
-      }
-      return result;
-   }
-};
+std::uint64_t elapsed_us(std::chrono::steady_clock::time_point started) {
+   return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+}
 
-class http_connection : public std::enable_shared_from_this<http_connection> {
+//! Event data, formatted on the stack
+class event_data {
 public:
-   http_connection(server &server, tcp::socket socket)
-      : server_{&server}
-      , socket_(std::move(socket)) {
-      // Nothing to do here
+   template <class... Args>
+   explicit event_data(const char *format, Args... args) {
+      const auto res = std::snprintf(buffer_.data(), buffer_.size(), format, args...);
+      size_ = std::min(static_cast<std::size_t>(std::max(res, 0)), buffer_.size() - 1);
    }
 
-public:
-   void start() { read_request(); }
+   [[nodiscard]] std::string_view view() const { return {buffer_.data(), size_}; }
 
-   void read_request() {
-      auto self = shared_from_this();
+private:
+   std::array<char, 128> buffer_{};
+   std::size_t size_{0};
+};
 
-      http::async_read(socket_, buffer_, request_, [self](auto ec, std::size_t) {
-         if (!ec) {
-            self->process_request();
-         }
-      });
+//! Parse a "PIN:CODE" panel button definition
+result_t<server::panel_button> parse_panel_button(std::string_view text) {
+   const auto separator = text.find(':');
+   if (separator == std::string_view::npos) {
+      return std::make_error_code(std::errc::invalid_argument);
    }
 
-   void process_request() {
-      response_.version(request_.version());
-      response_.keep_alive(false);
-
-      switch (request_.method()) {
-         case http::verb::post:
-            response_.result(http::status::ok);
-            response_.set(http::field::server, "ir-ctrl");
-            create_response();
-            break;
+   const auto pin_text = text.substr(0, separator);
+   int pin = 0;
+   auto [ptr, ec] = std::from_chars(pin_text.data(), pin_text.data() + pin_text.size(), pin);
+   if (ec != std::errc{} || ptr != pin_text.data() + pin_text.size()) {
+      return std::make_error_code(std::errc::invalid_argument);
+   }
 
-         default:
-            response_.result(http::status::bad_request);
-            response_.set(http::field::content_type, "text/plain");
-            beast::ostream(response_.body())
-               << "Invalid request-method '" << std::string(request_.method_string()) << "'";
-            break;
-      }
+   OUTCOME_TRY(auto code, uri::parse_code(text.substr(separator + 1)));
+   return server::panel_button{pin, code};
+}
 
-      write_response();
-   }
-
-   void create_response() {
-      // Handle requests in the following form: (http://192.168.0.100/send?code=529287)
-      beast::string_view prefix = "/send?";
-      auto target = request_.target();
-      if (!target.starts_with(prefix)) {
-         response_.result(http::status::not_found);
-         response_.set(http::field::content_type, "text/plain");
-         beast::ostream(response_.body()) << "Unexpected request\r\n";
-         return;
-      }
-
-      auto params = uri::get_query_params({target.data() + prefix.size(), target.size() - prefix.size()});
-      // TODO: Handle different protocols
-      for (const auto &p : params) {
-         if (p.first == "code") {
-            try {
-               std::size_t pos = 0;
-               auto code = std::stoi(p.second, &pos);
-               if (pos != p.second.size()) {
-                  throw std::invalid_argument("extra symbols");
-               }
-
-               server_->send_necx_wave(code);
-            } catch (const std::invalid_argument &e) {
-               response_.result(http::status::bad_request);
-               response_.set(http::field::content_type, "text/plain");
-               beast::ostream(response_.body()) << "Invalid IR code: " << e.what() << "\r\n";
-            }
-            break;
-         }
-      }
+//! Parse an "ADDRESS=WEIGHT" client weight (the address may be IPv6, hence no colon)
+result_t<server::client_weight> parse_client_weight(std::string_view text) {
+   const auto separator = text.find('=');
+   if (separator == std::string_view::npos) {
+      return std::make_error_code(std::errc::invalid_argument);
    }
 
-   void write_response() {
-      auto self = shared_from_this();
-
-      response_.content_length(response_.body().size());
+   boost::system::error_code address_ec;
+   auto address = boost::asio::ip::make_address(std::string{text.substr(0, separator)}, address_ec);
+   if (address_ec) {
+      return std::make_error_code(std::errc::invalid_argument);
+   }
 
-      http::async_write(socket_, response_,
-                        [self](auto ec, std::size_t) { self->socket_.shutdown(tcp::socket::shutdown_send, ec); });
+   const auto weight_text = text.substr(separator + 1);
+   unsigned weight = 0;
+   auto [ptr, ec] = std::from_chars(weight_text.data(), weight_text.data() + weight_text.size(), weight);
+   if (ec != std::errc{} || ptr != weight_text.data() + weight_text.size() || weight == 0 || weight > 1000) {
+      return std::make_error_code(std::errc::invalid_argument);
    }
 
-private:
-   server *server_;
-   tcp::socket socket_;
+   return server::client_weight{address, weight};
+}
 
-   beast::flat_buffer buffer_{8192};
-   http::request<http::dynamic_body> request_;
-   http::response<http::dynamic_body> response_;
-};
+//! Parse the octal permission bits of a Unix socket file
+result_t<unsigned> parse_socket_mode(std::string_view text) {
+   unsigned mode = 0;
+   auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), mode, 8);
+   if (text.empty() || ec != std::errc{} || ptr != text.data() + text.size() || mode > 0777) {
+      return std::make_error_code(std::errc::invalid_argument);
+   }
+   return mode;
+}
 
 } // namespace
 
@@ -170,7 +130,51 @@ result_t<server::options> server::options::load(int argc, char **argv) {
       ("button-pin", po::value<int>()->default_value(23), "Input button pin")
       ("led-pin", po::value<int>()->default_value(25), "LED button pin")
       ("button-code", po::value<std::uint32_t>()->default_value(0x81387), "IR code associated with a button press")
-      ("listen-port", po::value<std::uint16_t>()->default_value(80), "HTTP-Server listen port");
+      ("button-double-code", po::value<std::uint32_t>(), "IR code associated with a double button press")
+      ("button-long-code", po::value<std::uint32_t>(), "IR code associated with a long button press")
+      ("button-debounce", po::value<unsigned>()->default_value(50), "Button debounce interval, ms")
+      ("button-glitch-filter", po::value<unsigned>()->default_value(0), "pigpio glitch filter for the button pin, µs (0 - off)")
+      ("button-double-press-window", po::value<unsigned>()->default_value(300), "Maximal interval between the two presses of a double press, ms")
+      ("button-long-press", po::value<unsigned>()->default_value(800), "Minimal hold duration for a long press, ms")
+      ("button-hold-repeat", po::value<unsigned>()->default_value(0), "Repeat the long press code with this interval while the button is held, ms (0 - off)")
+      ("panel-button", po::value<std::vector<std::string>>()->multitoken(), "Panel button as PIN:CODE (GPIO 0-31), not shared with the other pins, can be repeated")
+      ("listen-port", po::value<std::uint16_t>()->default_value(80), "HTTP-Server listen port")
+      ("keep-alive-timeout", po::value<unsigned>()->default_value(5), "Idle timeout for persistent connections, s")
+      ("read-timeout", po::value<unsigned>()->default_value(10), "Deadline for receiving the first request on a new connection, s")
+      ("write-timeout", po::value<unsigned>()->default_value(10), "Deadline for sending a response, s")
+      ("max-keep-alive-requests", po::value<unsigned>()->default_value(100), "Maximal number of requests served over a single connection")
+      ("max-connections", po::value<unsigned>()->default_value(32), "Maximal number of concurrent HTTP connections, split between the network threads: each thread pauses accepting once its own share is in use")
+      ("threads", po::value<unsigned>()->default_value(0), "Number of network threads, at most --max-connections (0 - one per CPU core)")
+      ("max-subscribers", po::value<unsigned>()->default_value(16), "Maximal number of concurrent WebSocket sessions and GET /events streams, on top of --max-connections and split between the network threads the same way (0 - none)")
+      ("log-level", po::value<std::string>()->default_value("info"), "Minimal log level: debug, info, warning or error")
+      ("log-rate-limit", po::value<unsigned>()->default_value(50), "Maximal number of log records per second for each event (0 - unlimited)")
+      ("trace", po::bool_switch(), "Record tracing spans (exported over GET /trace and dumped on crashes)")
+      ("trace-file", po::value<std::string>()->default_value("/run/ir-ctrl-trace.json"), "Crash dump file for the recorded spans")
+      ("wave-cache", po::value<std::string>()->default_value(""), "Persistent cache file for the encoded waves (empty - no cache)")
+      ("wave-cache-preload", po::value<unsigned>()->default_value(32), "Number of the most used cached waves to upload at startup")
+      ("catalog", po::value<std::string>()->default_value(""), "Code catalog file, encoded and uploaded at startup (empty - no catalog)")
+      ("catalog-threads", po::value<unsigned>()->default_value(0), "Number of threads encoding the catalog (0 - one per CPU core)")
+      ("lirc-db", po::value<std::string>()->default_value(""), "Remote database compiled by ir-lirc-import, for /send?remote=&key= (empty - none)")
+      ("ws-hold-interval", po::value<unsigned>()->default_value(110), "Repeat interval of a held WebSocket command, ms")
+      ("udp-port", po::value<std::uint16_t>()->default_value(0), "UDP command listener port (0 - off)")
+      ("lircd-socket", po::value<std::string>()->default_value(""), "Unix socket path for lircd clients, e.g. /var/run/lirc/lircd (empty - off)")
+      ("lircd-socket-mode", po::value<std::string>()->default_value("0666"), "Octal permissions of the lircd socket (0666 - any local user may send codes, like lircd)")
+      ("lircd-repeat-interval", po::value<unsigned>()->default_value(110), "Repeat interval of SEND_START on the lircd socket, ms")
+      ("shm-socket", po::value<std::string>()->default_value(""), "Unix socket handing out the shared-memory command ring to local clients (empty - off)")
+      ("shm-capacity", po::value<std::uint32_t>()->default_value(256), "Number of commands in the shared-memory ring (power of two)")
+      ("shm-socket-mode", po::value<std::string>()->default_value("0660"), "Octal permissions of the shared-memory socket, any user allowed to connect may submit commands")
+      ("shm-socket-group", po::value<std::string>()->default_value(""), "Group of the shared-memory socket (empty - the group of ir-ctrl)")
+      ("rate-limit", po::value<double>()->default_value(0), "Transmissions per second allowed for each client address (0 - unlimited)")
+      ("rate-burst", po::value<unsigned>()->default_value(10), "Transmissions a client address may send at once before the rate limit applies")
+      ("max-pending-per-client", po::value<unsigned>()->default_value(16), "Maximal number of queued commands for each client address (0 - unlimited)")
+      ("client-weight", po::value<std::vector<std::string>>()->multitoken(), "Transmit queue share of a client as ADDRESS=WEIGHT (1-1000, default 1), can be repeated")
+      ("http-deadline", po::value<unsigned>()->default_value(0), "Time an HTTP command may wait for the transmitter before it is dropped with 504, ms (0 - forever)")
+      ("ws-deadline", po::value<unsigned>()->default_value(0), "Time a WebSocket command may wait for the transmitter before it is dropped, ms (0 - forever)")
+      ("udp-deadline", po::value<unsigned>()->default_value(0), "Time a UDP command may wait for the transmitter before it is dropped, ms (0 - forever)")
+      ("lircd-deadline", po::value<unsigned>()->default_value(0), "Time a lircd command may wait for the transmitter before it is dropped, ms (0 - forever)")
+      ("shm-deadline", po::value<unsigned>()->default_value(0), "Time a shared-memory command may wait (since its submission) before it is dropped, ms (0 - forever)")
+      ("max-scheduled-jobs", po::value<unsigned>()->default_value(4096), "Maximal number of delayed and periodic jobs managed over /schedule (0 - no scheduler)")
+      ("max-scheduled-jobs-per-client", po::value<unsigned>()->default_value(64), "Maximal number of scheduled jobs created by each client address");
 
    all.add(general);
 
@@ -189,9 +193,198 @@ result_t<server::options> server::options::load(int argc, char **argv) {
       auto button_pin = vm["button-pin"].as<int>();
       auto led_pin = vm["led-pin"].as<int>();
       auto button_code = vm["button-code"].as<std::uint32_t>();
+
+      std::optional<code_t> button_double_code;
+      if (vm.count("button-double-code")) {
+         button_double_code = vm["button-double-code"].as<std::uint32_t>();
+      }
+
+      std::optional<code_t> button_long_code;
+      if (vm.count("button-long-code")) {
+         button_long_code = vm["button-long-code"].as<std::uint32_t>();
+      }
+
+      // Gestures are only detected if there is something to do about them, a plain press is reported right away
+      using ms = std::chrono::milliseconds;
+      button::config button_config;
+      button_config.debounce_interval = ms(vm["button-debounce"].as<unsigned>());
+      button_config.glitch_filter_us = vm["button-glitch-filter"].as<unsigned>();
+      button_config.repeat_interval = ms(vm["button-hold-repeat"].as<unsigned>());
+      if (button_double_code) {
+         button_config.double_press_window = ms(vm["button-double-press-window"].as<unsigned>());
+      }
+      if (button_long_code || button_config.repeat_interval.count()) {
+         button_config.long_press_duration = ms(vm["button-long-press"].as<unsigned>());
+      }
+
+      std::vector<panel_button> panel_buttons;
+      if (vm.count("panel-button")) {
+         for (const auto &text : vm["panel-button"].as<std::vector<std::string>>()) {
+            auto res = parse_panel_button(text);
+            if (!res || res.value().pin < 0 || res.value().pin > 31) {
+               std::cerr << "Error: invalid panel button: " << text << std::endl;
+               return std::errc::invalid_argument;
+            }
+
+            const auto pin = res.value().pin;
+            const bool taken = pin == ir_pin || pin == button_pin || pin == led_pin ||
+                               std::any_of(panel_buttons.begin(), panel_buttons.end(),
+                                           [pin](const panel_button &b) { return b.pin == pin; });
+            if (taken) {
+               std::cerr << "Error: panel button pin " << pin << " is already in use: " << text << std::endl;
+               return std::errc::invalid_argument;
+            }
+            panel_buttons.push_back(res.value());
+         }
+      }
+
       auto listen_port = vm["listen-port"].as<std::uint16_t>();
+      auto keep_alive_timeout = std::chrono::seconds(vm["keep-alive-timeout"].as<unsigned>());
+      auto read_timeout = std::chrono::seconds(vm["read-timeout"].as<unsigned>());
+      auto write_timeout = std::chrono::seconds(vm["write-timeout"].as<unsigned>());
+      auto max_keep_alive_requests = vm["max-keep-alive-requests"].as<unsigned>();
+      auto max_connections = vm["max-connections"].as<unsigned>();
+      auto threads = vm["threads"].as<unsigned>();
+      if (max_connections == 0) {
+         std::cerr << "Error: --max-connections has to be at least 1" << std::endl;
+         return std::errc::invalid_argument;
+      }
+      auto max_subscribers = vm["max-subscribers"].as<unsigned>();
+      if (threads > max_connections) {
+         std::cerr << "Error: more network threads than connections: " << threads << " > " << max_connections
+                   << std::endl;
+         return std::errc::invalid_argument;
+      }
+      if (threads == 0) {
+         // Every thread needs at least one connection (and one subscriber, if there are any)
+         threads = std::clamp(std::thread::hardware_concurrency(), 1U,
+                              max_subscribers ? std::min(max_connections, max_subscribers) : max_connections);
+      }
+      if (max_subscribers && threads > max_subscribers) {
+         std::cerr << "Error: more network threads than subscribers: " << threads << " > " << max_subscribers
+                   << std::endl;
+         return std::errc::invalid_argument;
+      }
+      log::level log_level;
+      if (!log::parse_level(vm["log-level"].as<std::string>(), log_level)) {
+         std::cerr << "Error: invalid log level: " << vm["log-level"].as<std::string>() << std::endl;
+         return std::errc::invalid_argument;
+      }
+      auto log_rate_limit = vm["log-rate-limit"].as<unsigned>();
+      auto trace = vm["trace"].as<bool>();
+      auto trace_file = vm["trace-file"].as<std::string>();
+      auto wave_cache = vm["wave-cache"].as<std::string>();
+      auto wave_cache_preload = vm["wave-cache-preload"].as<unsigned>();
+      auto catalog = vm["catalog"].as<std::string>();
+      auto catalog_threads = vm["catalog-threads"].as<unsigned>();
+      if (catalog_threads == 0) {
+         catalog_threads = std::max(1U, std::thread::hardware_concurrency());
+      }
+      auto lirc_db = vm["lirc-db"].as<std::string>();
+      auto ws_hold_interval = ms(vm["ws-hold-interval"].as<unsigned>());
+      auto udp_port = vm["udp-port"].as<std::uint16_t>();
+      auto lircd_socket = vm["lircd-socket"].as<std::string>();
+      auto lircd_repeat_interval = ms(vm["lircd-repeat-interval"].as<unsigned>());
+      const auto lircd_socket_mode_text = vm["lircd-socket-mode"].as<std::string>();
+      auto lircd_socket_mode = parse_socket_mode(lircd_socket_mode_text);
+      if (!lircd_socket_mode) {
+         std::cerr << "Error: invalid lircd socket mode: " << lircd_socket_mode_text << std::endl;
+         return std::errc::invalid_argument;
+      }
+      auto shm_socket = vm["shm-socket"].as<std::string>();
+      auto shm_capacity = vm["shm-capacity"].as<std::uint32_t>();
+      if (shm_capacity < 2 || shm_capacity > shm_ring::max_capacity || (shm_capacity & (shm_capacity - 1))) {
+         std::cerr << "Error: invalid shared-memory ring capacity: " << shm_capacity << std::endl;
+         return std::errc::invalid_argument;
+      }
+      const auto shm_socket_mode_text = vm["shm-socket-mode"].as<std::string>();
+      auto shm_socket_mode = parse_socket_mode(shm_socket_mode_text);
+      if (!shm_socket_mode) {
+         std::cerr << "Error: invalid shared-memory socket mode: " << shm_socket_mode_text << std::endl;
+         return std::errc::invalid_argument;
+      }
+      const auto shm_socket_group_name = vm["shm-socket-group"].as<std::string>();
+      int shm_socket_group = -1;
+      if (!shm_socket_group_name.empty()) {
+         const auto group = ::getgrnam(shm_socket_group_name.c_str());
+         if (!group) {
+            std::cerr << "Error: unknown shared-memory socket group: " << shm_socket_group_name << std::endl;
+            return std::errc::invalid_argument;
+         }
+         shm_socket_group = static_cast<int>(group->gr_gid);
+      }
+      auto rate_limit = vm["rate-limit"].as<double>();
+      if (rate_limit < 0) {
+         std::cerr << "Error: invalid rate limit: " << rate_limit << std::endl;
+         return std::errc::invalid_argument;
+      }
+      auto rate_burst = vm["rate-burst"].as<unsigned>();
+      auto max_pending_per_client = vm["max-pending-per-client"].as<unsigned>();
+      auto http_deadline = ms(vm["http-deadline"].as<unsigned>());
+      auto ws_deadline = ms(vm["ws-deadline"].as<unsigned>());
+      auto udp_deadline = ms(vm["udp-deadline"].as<unsigned>());
+      auto lircd_deadline = ms(vm["lircd-deadline"].as<unsigned>());
+      auto shm_deadline = ms(vm["shm-deadline"].as<unsigned>());
+      auto max_scheduled_jobs = vm["max-scheduled-jobs"].as<unsigned>();
+      auto max_scheduled_jobs_per_client = vm["max-scheduled-jobs-per-client"].as<unsigned>();
 
-      return options {ir_pin, button_pin, led_pin, button_code, listen_port};
+      std::vector<client_weight> client_weights;
+      if (vm.count("client-weight")) {
+         for (const auto &text : vm["client-weight"].as<std::vector<std::string>>()) {
+            auto res = parse_client_weight(text);
+            if (!res) {
+               std::cerr << "Error: invalid client weight: " << text << std::endl;
+               return std::errc::invalid_argument;
+            }
+            client_weights.push_back(res.value());
+         }
+      }
+
+      return options {ir_pin,
+                      button_pin,
+                      led_pin,
+                      button_code,
+                      button_double_code,
+                      button_long_code,
+                      button_config,
+                      std::move(panel_buttons),
+                      listen_port,
+                      keep_alive_timeout,
+                      read_timeout,
+                      write_timeout,
+                      max_keep_alive_requests,
+                      max_connections,
+                      threads,
+                      log_level,
+                      log_rate_limit,
+                      trace,
+                      std::move(trace_file),
+                      std::move(wave_cache),
+                      wave_cache_preload,
+                      std::move(catalog),
+                      catalog_threads,
+                      std::move(lirc_db),
+                      ws_hold_interval,
+                      udp_port,
+                      std::move(lircd_socket),
+                      lircd_repeat_interval,
+                      std::move(shm_socket),
+                      shm_capacity,
+                      rate_limit,
+                      rate_burst,
+                      max_pending_per_client,
+                      std::move(client_weights),
+                      http_deadline,
+                      ws_deadline,
+                      udp_deadline,
+                      lircd_deadline,
+                      shm_deadline,
+                      max_scheduled_jobs,
+                      max_subscribers,
+                      lircd_socket_mode.value(),
+                      shm_socket_mode.value(),
+                      shm_socket_group,
+                      max_scheduled_jobs_per_client};
 
    } catch (std::exception const &e) {
       std::cerr << "Error: " << e.what() << std::endl;
@@ -205,63 +398,812 @@ result_t<server::options> server::options::load(int argc, char **argv) {
 ////////////////////////////////////////////////////////////////////////////////
 server::server(const options &options)
    : options_{options}
-   , button_{options_.button_pin, [this] { handle_button_press(); }}
+   , limits_{rate_limiter::config{options_.rate_limit, options_.rate_burst, options_.max_pending_per_client,
+                                  std::max<std::size_t>(1024, options_.max_connections)}}
    , led_{options_.led_pin}
+   , button_{io_,
+             options_.button_pin,
+             [this](button::gesture g) {
+                // Repeats queued behind a busy transmitter would pile up and go on after the release
+                if (g == button::gesture::hold_repeat && hold_pending_.exchange(true)) {
+                   return;
+                }
+                post_transmit([this, g] {
+                   handle_button(g);
+                   if (g == button::gesture::hold_repeat) {
+                      hold_pending_ = false;
+                   }
+                });
+             },
+             options_.button_config}
    , waves_{} {
+   for (const auto &w : options_.client_weights) {
+      client_weights_[client_key::from(w.address)] = w.weight;
+   }
+
+   if (options_.trace) {
+      // pigpio installs its own signal handlers in gpioInitialise, so this has to come after it
+      trace::enable(true);
+      trace::install_crash_handler(options_.trace_file);
+   }
+
    gpioSetMode(options_.ir_pin, PI_OUTPUT);
 
-   add_necx_wave(options_.button_code);
+   if (!options_.lirc_db.empty()) {
+      const auto started = std::chrono::steady_clock::now();
+      remotes_ = std::make_unique<lirc_db>(options_.lirc_db);
+      log::info("lirc_db.loaded",
+                {log::text("path", remotes_->path()), log::kv("keys", std::uint64_t{remotes_->size()}),
+                 log::kv("duration_us", elapsed_us(started))});
+   }
+
+   if (!options_.wave_cache.empty()) {
+      preload_waves();
+   }
+
+   if (!waves_.count(options_.button_code)) {
+      add_necx_wave(options_.button_code);
+   }
+   for (auto code : {options_.button_double_code, options_.button_long_code}) {
+      if (code && !waves_.count(*code)) {
+         add_necx_wave(*code);
+      }
+   }
+
+   if (!options_.catalog.empty()) {
+      load_catalog();
+   }
+
+   if (!options_.panel_buttons.empty()) {
+      std::vector<int> pins;
+      for (const auto &b : options_.panel_buttons) {
+         pins.push_back(b.pin);
+         if (!waves_.count(b.code)) {
+            add_necx_wave(b.code);
+         }
+      }
+
+      panel_ = std::make_unique<button_bank>(
+         io_, pins, [this](int pin) { post_transmit([this, pin] { handle_panel_button(pin); }); },
+         options_.button_config.debounce_interval);
+   }
 }
 
 void server::run() {
-   tcp::acceptor acc{io_, {tcp::v4(), options_.listen_port}};
-   tcp::socket sock{io_};
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+   const char *backend = "io_uring";
+#else
+   const char *backend = "epoll";
+#endif
+   log::info("server.start",
+             {log::kv("backend", backend), log::kv("port", std::uint32_t{options_.listen_port}),
+              log::kv("threads", options_.threads)});
+
+   // The kernel balances the connections between the SO_REUSEPORT sockets by a hash of the addresses, not by the load:
+   // the limit (and the back-pressure) is per worker, one of them may pause accepting while another one has room left
+   const auto share = [this](unsigned total, unsigned i) {
+      return total / options_.threads + (i < total % options_.threads ? 1 : 0);
+   };
+   for (unsigned i = 0; i < options_.threads; ++i) {
+      workers_.push_back(
+         std::make_unique<worker>(*this, share(options_.max_connections, i), share(options_.max_subscribers, i)));
+      workers_.back()->listen(options_.listen_port);
+   }
+
+   if (options_.udp_port) {
+      udp_ = std::make_unique<udp_listener>(*this, io_);
+      udp_->listen(options_.udp_port);
+   }
+
+   if (!options_.lircd_socket.empty()) {
+      lircd_ = std::make_unique<lircd_server>(*this, io_, options_.lircd_repeat_interval);
+      lircd_->listen(options_.lircd_socket, options_.lircd_socket_mode);
+   }
+
+   if (!options_.shm_socket.empty()) {
+      shm_ = std::make_unique<shm_listener>(*this, io_, options_.shm_capacity);
+      shm_->listen(options_.shm_socket, options_.shm_socket_mode, options_.shm_socket_group);
+   }
+
+   if (options_.max_scheduled_jobs) {
+      scheduler_ = std::make_unique<scheduler>(*this, io_, options_.max_scheduled_jobs,
+                                               options_.max_scheduled_jobs_per_client);
+      scheduler_->start();
+   }
 
    // Handle signals
    boost::asio::signal_set signals(io_);
    signals.add(SIGINT);
    signals.add(SIGTERM);
-   signals.async_wait([this](auto &ec, int signal) {
+   signals.async_wait([this](const boost::system::error_code &ec, int signal) {
       if (ec) {
-         std::cout << "Signal received:" << ec.message() << ", " << signal << std::endl;
+         log::error("server.signal_error", {log::text("error", ec.message())});
+      } else {
+         log::info("server.stop", {log::kv("signal", signal)});
+      }
+
+      for (auto &w : workers_) {
+         w->stop();
+      }
+      if (udp_) {
+         udp_->stop();
+      }
+      if (lircd_) {
+         lircd_->stop();
+      }
+      if (shm_) {
+         shm_->stop();
+      }
+      if (scheduler_) {
+         scheduler_->stop();
       }
       io_.stop();
    });
 
-   do_accept(acc, sock);
+   std::vector<std::thread> threads;
+   for (auto &w : workers_) {
+      threads.emplace_back([this, &w] {
+         if (options_.trace) {
+            trace::install_signal_stack();
+         }
+         w->run();
+      });
+   }
+
+   // Keep the control context alive even if there is nothing to send at the moment
+   auto work = boost::asio::make_work_guard(io_);
    io_.run();
+
+   for (auto &t : threads) {
+      t.join();
+   }
+   std::uint64_t accepted = 0, timed_out = 0, accept_paused = 0;
+   for (auto &w : workers_) {
+      const auto &stats = w->connections().stats();
+      accepted += stats.accepted;
+      timed_out += stats.timed_out;
+      accept_paused += stats.accept_paused;
+   }
+
+   log::info("server.connections",
+             {log::kv("accepted", accepted), log::kv("timed_out", timed_out), log::kv("accept_paused", accept_paused)});
+
+   if (cache_) {
+      save_waves();
+   }
+
+   if (const auto dropped = log::dropped()) {
+      log::warning("log.dropped", {log::kv("records", dropped)});
+   }
 }
 
-void server::do_accept(boost::asio::ip::tcp::acceptor &acceptor, boost::asio::ip::tcp::socket &socket) {
-   acceptor.async_accept(socket, [&](auto ec) {
-      if (!ec) {
-         std::make_shared<http_connection>(*this, std::move(socket))->start();
+void server::write_metrics(std::string &out) const {
+   metrics::text_writer w{out};
+
+   w.histogram("ir_http_request_duration_seconds", "HTTP request handling time, including the IR transmission",
+               stats_.request_duration);
+
+   w.header("ir_http_responses_total", "HTTP responses by status code", "counter");
+   char labels[32] = R"(code=")";
+   constexpr std::size_t prefix = sizeof(R"(code=")") - 1;
+   for (std::size_t i = 0; i < stats_.responses.size(); ++i) {
+      const auto code = http_connection::status_code(static_cast<http_connection::response>(i));
+      auto end = std::to_chars(labels + prefix, std::end(labels) - 1, code).ptr;
+      *end++ = '"';
+      w.sample("ir_http_responses_total", std::string_view(labels, static_cast<std::size_t>(end - labels)),
+               stats_.responses[i].value());
+   }
+
+#ifdef IR_CTRL_COUNT_ALLOCATIONS
+   w.counter("ir_heap_allocations_total", "Allocations with the global operator new", metrics::heap_allocations());
+#endif
+
+   w.histogram("ir_transmit_queue_wait_seconds", "Time spent waiting for the transmitter", stats_.queue_wait);
+   w.histogram("ir_wave_build_seconds", "Time to encode and upload a wave", stats_.wave_build);
+   w.histogram("ir_wave_on_air_seconds", "Time to transmit a wave", stats_.on_air);
+
+   w.counter("ir_wave_cache_hits_total", "Transmissions of an already uploaded wave", stats_.cache_hits.value());
+   w.counter("ir_wave_cache_misses_total", "Transmissions that had to build the wave first",
+             stats_.cache_misses.value());
+   w.gauge("ir_wave_cached", "Number of encoded waves", stats_.cached_waves.value());
+   w.gauge("ir_wave_uploaded", "Number of waves uploaded to pigpio", stats_.uploaded_waves.value());
+   w.counter("ir_wave_evictions_total", "Waves released from pigpio to make room for another wave",
+             stats_.wave_evictions.value());
+   w.counter("ir_wave_disk_cache_hits_total", "Waves uploaded from the persistent wave cache",
+             stats_.disk_cache_hits.value());
+   w.counter("ir_wave_disk_cache_misses_total", "Waves that had to be encoded, because they were not in the wave cache",
+             stats_.disk_cache_misses.value());
+   w.gauge("ir_wave_dma_control_blocks", "DMA control blocks used by the uploaded waves",
+           stats_.dma_control_blocks.value());
+   w.gauge("ir_wave_dma_control_blocks_max", "DMA control blocks available for waves", gpioWaveGetMaxCbs());
+
+   w.gauge("ir_ws_sessions", "Open WebSocket sessions", stats_.ws_sessions.value());
+   w.counter("ir_ws_commands_total", "Commands received over WebSocket sessions", stats_.ws_commands.value());
+   w.counter("ir_ws_events_dropped_total", "WebSocket events dropped because the client was not reading",
+             stats_.ws_events_dropped.value());
+   w.histogram("ir_ws_command_duration_seconds", "From a received WebSocket send command to the end of its transmission",
+               stats_.ws_command_duration);
+
+   w.counter("ir_udp_datagrams_total", "Datagrams received by the UDP listener", stats_.udp_datagrams.value());
+   w.counter("ir_udp_invalid_total", "Invalid UDP commands", stats_.udp_invalid.value());
+   w.counter("ir_udp_duplicates_total", "UDP commands dropped as retransmissions of a recent command",
+             stats_.udp_duplicates.value());
+   w.counter("ir_udp_ack_errors_total", "UDP acks that could not be sent", stats_.udp_ack_errors.value());
+   w.histogram("ir_udp_dispatch_seconds", "From a received UDP command to the end of its transmission",
+               stats_.udp_dispatch);
+
+   w.gauge("ir_lircd_clients", "Clients connected to the lircd socket", stats_.lircd_clients.value());
+   w.counter("ir_lircd_commands_total", "Directives received on the lircd socket", stats_.lircd_commands.value());
+
+   w.counter("ir_shm_clients_total", "Clients that received the shared-memory ring", stats_.shm_clients.value());
+   w.counter("ir_shm_commands_total", "Commands taken from the shared-memory ring", stats_.shm_commands.value());
+   w.counter("ir_shm_invalid_total", "Invalid commands in the shared-memory ring", stats_.shm_invalid.value());
+   w.counter("ir_shm_stalled_total", "Shared-memory ring slots skipped, claimed by a producer but never published",
+             stats_.shm_stalled.value());
+   w.histogram("ir_shm_dispatch_seconds", "From a submission to the shared-memory ring to the start of its transmission",
+               stats_.shm_dispatch);
+
+   w.counter("ir_events_published_total", "Records published to the GET /events stream",
+             stats_.events_published.value());
+   w.gauge("ir_event_subscribers", "Connected GET /events subscribers", stats_.event_subscribers.value());
+   w.counter("ir_event_subscribers_lapped_total", "GET /events subscribers dropped for falling a whole ring behind",
+             stats_.event_subscribers_lapped.value());
+
+   w.header("ir_rate_limited_total", "Commands refused because the client exceeded its rate or queue share", "counter");
+   w.sample("ir_rate_limited_total", "protocol=\"http\"", stats_.http_rate_limited.value());
+   w.sample("ir_rate_limited_total", "protocol=\"ws\"", stats_.ws_rate_limited.value());
+   w.sample("ir_rate_limited_total", "protocol=\"udp\"", stats_.udp_rate_limited.value());
+   w.sample("ir_rate_limited_total", "protocol=\"lircd\"", stats_.lircd_rate_limited.value());
+   w.sample("ir_rate_limited_total", "protocol=\"shm\"", stats_.shm_rate_limited.value());
+   w.gauge("ir_transmit_queued", "Commands waiting in the fair transmit queue", stats_.transmit_queued.value());
+   w.gauge("ir_transmit_queued_clients", "Clients with commands waiting in the fair transmit queue",
+           stats_.transmit_clients.value());
+
+   w.header("ir_commands_expired_total", "Commands dropped because they could not start before their deadline",
+            "counter");
+   w.sample("ir_commands_expired_total", "protocol=\"http\"", stats_.http_expired.value());
+   w.sample("ir_commands_expired_total", "protocol=\"ws\"", stats_.ws_expired.value());
+   w.sample("ir_commands_expired_total", "protocol=\"udp\"", stats_.udp_expired.value());
+   w.sample("ir_commands_expired_total", "protocol=\"lircd\"", stats_.lircd_expired.value());
+   w.sample("ir_commands_expired_total", "protocol=\"shm\"", stats_.shm_expired.value());
+   w.sample("ir_commands_expired_total", "protocol=\"schedule\"", stats_.schedule_expired.value());
+
+   w.gauge("ir_scheduled_jobs", "Delayed and periodic jobs", stats_.scheduled_jobs.value());
+   w.counter("ir_schedule_runs_total", "Scheduled runs that were sent", stats_.schedule_runs.value());
+   w.counter("ir_schedule_skipped_total", "Scheduled runs skipped because the previous run was still queued",
+             stats_.schedule_skipped.value());
+   w.histogram("ir_schedule_start_error_seconds", "From the scheduled time of a run to the actual start of its wave",
+               stats_.schedule_start_error);
+
+   w.header("ir_button_presses_total", "Button presses (all gestures)", "counter");
+   w.sample("ir_button_presses_total", "source=\"button\"", stats_.button_presses.value());
+   w.sample("ir_button_presses_total", "source=\"panel\"", stats_.panel_presses.value());
+
+   std::uint64_t accepted = 0, timed_out = 0, accept_paused = 0, sessions_refused = 0;
+   std::int64_t active = 0;
+   for (auto &worker : workers_) {
+      const auto &stats = worker->connections().stats();
+      accepted += stats.accepted;
+      timed_out += stats.timed_out;
+      accept_paused += stats.accept_paused;
+      sessions_refused += stats.sessions_refused;
+      active += stats.active;
+   }
+
+   w.counter("ir_http_connections_accepted_total", "Accepted HTTP connections", accepted);
+   w.counter("ir_http_connections_timed_out_total", "HTTP connections closed because of a deadline", timed_out);
+   w.counter("ir_http_accept_paused_total", "Times accepting was suspended because of the connection limit",
+             accept_paused);
+   w.gauge("ir_http_connections_active", "HTTP connections currently being served", active);
+   w.counter("ir_http_sessions_refused_total", "Long-lived sessions refused because --max-subscribers was reached",
+             sessions_refused);
+}
+
+void server::add_necx_wave(code_t code) {
+   if (!build_wave(code, true)) {
+      throw std::runtime_error("Out of pigpio wave resources");
+   }
+}
+
+bool server::build_wave(code_t code, bool evict) {
+   trace::span span{"server.add_wave", code};
+   const auto started = std::chrono::steady_clock::now();
+
+   std::unique_ptr<ir::necx> wave;
+   auto cached = cache_ ? cache_->find(necx::make_key(options_.ir_pin, code)) : std::nullopt;
+   if (cached) {
+      stats_.disk_cache_hits.add();
+      wave = std::make_unique<ir::necx>(options_.ir_pin, code, *cached);
+   } else {
+      if (cache_) {
+         stats_.disk_cache_misses.add();
+      }
+      wave = std::make_unique<ir::necx>(options_.ir_pin, code);
+   }
+
+   const bool uploaded = upload_wave(*wave, evict);
+   stats_.wave_build.record(std::chrono::steady_clock::now() - started);
+
+   waves_.insert({code, cached_wave{std::move(wave), ++use_clock_}});
+   stats_.cached_waves.set(static_cast<std::int64_t>(waves_.size()));
+   return uploaded;
+}
+
+bool server::upload_wave(wave &w, bool evict) {
+   while (!w.try_upload()) {
+      if (!evict || !evict_wave(&w)) {
+         return false;
+      }
+   }
+
+   stats_.uploaded_waves.add(1);
+   stats_.dma_control_blocks.add(w.control_blocks());
+   return true;
+}
+
+void server::release_wave(wave &w) {
+   if (w.uploaded()) {
+      stats_.uploaded_waves.add(-1);
+      stats_.dma_control_blocks.add(-w.control_blocks());
+      w.release();
+   }
+}
+
+bool server::evict_wave(const wave *keep) {
+   cached_wave *victim = nullptr;
+   code_t victim_code = 0;
+   for (auto &[code, entry] : waves_) {
+      if (entry.wave.get() != keep && entry.wave->uploaded() && (!victim || entry.last_used < victim->last_used)) {
+         victim = &entry;
+         victim_code = code;
+      }
+   }
+
+   if (!victim) {
+      return false;
+   }
+
+   stats_.wave_evictions.add();
+   release_wave(*victim->wave);
+   log::debug("wave.evicted", {log::hex("code", victim_code)});
+   publish_event("eviction", event_data{R"({"code":%u})", victim_code}.view());
+   return true;
+}
+
+/**
+ * Open the wave cache and upload the most used waves from it, before any requests are accepted.
+ */
+void server::preload_waves() {
+   const auto started = std::chrono::steady_clock::now();
+   cache_ = std::make_unique<pulse_cache>(options_.wave_cache);
+
+   std::size_t preloaded = 0;
+   for (const auto &key : cache_->hottest(options_.wave_cache_preload)) {
+      // Only waves this instance could have built itself: same protocol, parameters and pin
+      if (key != necx::make_key(options_.ir_pin, key.code) || waves_.count(key.code)) {
+         continue;
+      }
+
+      try {
+         // Hottest first: once pigpio is full, the rest would only evict the waves preloaded so far
+         if (!build_wave(key.code, false)) {
+            break;
+         }
+         ++preloaded;
+      } catch (const std::exception &e) {
+         log::warning("wave_cache.preload_failed", {log::hex("code", key.code), log::text("error", e.what())});
+      }
+   }
+
+   log::info("wave_cache.preloaded",
+             {log::text("path", cache_->path()), log::kv("entries", std::uint64_t{cache_->size()}),
+              log::kv("preloaded", std::uint64_t{preloaded}), log::kv("duration_us", elapsed_us(started))});
+}
+
+//! Store all the uploaded waves (and their use counts) in the wave cache
+void server::save_waves() {
+   std::vector<pulse_cache::record> records;
+   records.reserve(waves_.size());
+   for (const auto &[code, entry] : waves_) {
+      const auto key = necx::make_key(options_.ir_pin, code);
+      records.push_back(pulse_cache::record{key, cache_->hits(key) + entry.wave->sent_count(), entry.wave->pulses()});
+   }
+
+   auto res = cache_->save(records);
+   if (res) {
+      log::info("wave_cache.saved", {log::text("path", cache_->path()), log::kv("waves", std::uint64_t{records.size()})});
+   } else {
+      log::error("wave_cache.save_failed", {log::text("path", cache_->path()), log::text("error", res.error().message())});
+   }
+}
+
+/**
+ * Encode all the catalog codes on a thread pool, then upload them serially (pigpio is not thread safe), before any
+ * requests are accepted. Waves that do not fit into the DMA control blocks stay encoded and are uploaded on first use.
+ */
+void server::load_catalog() {
+   const auto started = std::chrono::steady_clock::now();
+
+   auto res = catalog::load(options_.catalog);
+   if (!res) {
+      throw std::runtime_error("Unable to read the code catalog " + options_.catalog + ": " + res.error().message());
+   }
+
+   std::vector<code_t> codes;
+   for (auto code : res.value().codes()) {
+      if (!waves_.count(code)) {
+         codes.push_back(code);
+      }
+   }
+
+   // Encoding is CPU-bound and independent for each code, pulse trains from the wave cache only have to be copied
+   std::vector<std::unique_ptr<ir::necx>> encoded(codes.size());
+   std::vector<std::size_t> to_encode;
+   for (std::size_t i = 0; i < codes.size(); ++i) {
+      auto cached = cache_ ? cache_->find(necx::make_key(options_.ir_pin, codes[i])) : std::nullopt;
+      if (cached) {
+         stats_.disk_cache_hits.add();
+         encoded[i] = std::make_unique<ir::necx>(options_.ir_pin, codes[i], *cached);
       } else {
-         std::cerr << "Accept error: " << ec << std::endl;
+         if (cache_) {
+            stats_.disk_cache_misses.add();
+         }
+         to_encode.push_back(i);
       }
-      do_accept(acceptor, socket);
-   });
+   }
+
+   const std::size_t progress_step = std::max<std::size_t>(1, to_encode.size() / 10);
+   std::atomic<std::size_t> done{0};
+   {
+      boost::asio::thread_pool pool{options_.catalog_threads};
+      for (auto i : to_encode) {
+         boost::asio::post(pool, [this, i, &codes, &encoded, &done, progress_step, total = to_encode.size()] {
+            encoded[i] = std::make_unique<ir::necx>(options_.ir_pin, codes[i]);
+
+            const auto count = done.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (count % progress_step == 0 || count == total) {
+               log::info("catalog.progress",
+                         {log::kv("encoded", std::uint64_t{count}), log::kv("total", std::uint64_t{total})});
+            }
+         });
+      }
+      pool.join();
+   }
+   log::info("catalog.encoded",
+             {log::kv("waves", std::uint64_t{codes.size()}), log::kv("encoded", std::uint64_t{to_encode.size()}),
+              log::kv("threads", options_.catalog_threads), log::kv("duration_us", elapsed_us(started))});
+
+   // Catalog waves are the least recently used ones: nothing gets evicted for them at startup, and once pigpio is
+   // full the rest are not even tried
+   const auto upload_started = std::chrono::steady_clock::now();
+   std::size_t uploaded = 0;
+   for (std::size_t i = 0; i < codes.size(); ++i) {
+      if (uploaded == i && upload_wave(*encoded[i], false)) {
+         ++uploaded;
+      }
+      waves_.insert({codes[i], cached_wave{std::move(encoded[i]), 0}});
+   }
+   stats_.cached_waves.set(static_cast<std::int64_t>(waves_.size()));
+
+   log::info("catalog.loaded",
+             {log::text("path", options_.catalog), log::kv("entries", std::uint64_t{res.value().entries().size()}),
+              log::kv("waves", std::uint64_t{codes.size()}), log::kv("uploaded", std::uint64_t{uploaded}),
+              log::kv("upload_us", elapsed_us(upload_started)), log::kv("duration_us", elapsed_us(started))});
 }
 
-void server::add_necx_wave(code_t code) {
-   waves_.insert({code, std::make_unique<ir::necx>(options_.ir_pin, code)});
+boost::system::error_code server::try_send_necx_wave(code_t code,
+                                                     unsigned count,
+                                                     std::optional<std::chrono::steady_clock::time_point> start) {
+   try {
+      // Only the first transmission is scheduled, the others follow it right away
+      for (unsigned i = 0; i < count; ++i) {
+         send_necx_wave(code, i ? std::nullopt : start);
+      }
+      return {};
+   } catch (const std::exception &e) {
+      log::error("transmit.send_failed", {log::hex("code", code), log::text("error", e.what())});
+      return boost::asio::error::fault;
+   }
+}
+
+void server::send_necx_wave(code_t code, std::optional<std::chrono::steady_clock::time_point> start) {
+   trace::span span{"server.send", code};
+   const auto started = std::chrono::steady_clock::now();
+   transmit(code, start);
+   log::info("transmit.send", {log::hex("code", code), log::kv("duration_us", elapsed_us(started))});
 }
 
-void server::send_necx_wave(code_t code) {
+std::size_t server::send_batch(std::span<const batch::command> commands,
+                               std::span<const std::uint32_t> timings,
+                               std::span<batch::result> results,
+                               std::size_t first) {
+   trace::span span{"server.batch", commands.size() - first};
+
+   for (std::size_t i = first; i < commands.size(); ++i) {
+      const auto &c = commands[i];
+      auto &result = results[i];
+      const auto command_started = std::chrono::steady_clock::now();
+
+      try {
+         if (c.code) {
+            for (unsigned r = 0; r < c.repeat; ++r) {
+               transmit(*c.code);
+            }
+            result.state = batch::status::ok;
+         } else if (c.timings_count) {
+            result.state = transmit_raw(c, timings.subspan(c.timings_offset, c.timings_count), i);
+         } else {
+            // Remote key, that could not be resolved
+            result.state = batch::status::unknown_key;
+         }
+      } catch (const std::exception &e) {
+         log::error("batch.send_failed", {log::kv("command", std::uint64_t{i}), log::text("error", e.what())});
+         result.state = batch::status::failed;
+      }
+
+      result.duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                              command_started);
+
+      if (c.delay.count() && i + 1 < commands.size()) {
+         return i + 1;
+      }
+   }
+   return commands.size();
+}
+
+batch::status server::transmit_raw(const batch::command &c, std::span<const std::uint32_t> timings, std::size_t index) {
+   // Raw waves are one-off: uploaded for the command only, and released afterwards
+   raw_wave wave{options_.ir_pin, c.frequency_hz, timings};
+
+   // Evicting the cached waves can't make room for a wave longer than all of pigpio's control blocks
+   const auto blocks = wave.min_control_blocks();
+   if (blocks > static_cast<std::size_t>(gpioWaveGetMaxCbs())) {
+      log::warning("batch.raw_too_long",
+                   {log::kv("command", std::uint64_t{index}), log::kv("control_blocks", std::uint64_t{blocks})});
+      return batch::status::too_long;
+   }
+
+   if (!upload_wave(wave, true)) {
+      throw std::runtime_error("Out of pigpio wave resources");
+   }
+
+   publish_event("transmit_start", event_data{R"({"raw":%zu})", timings.size()}.view());
+   const auto air_started = std::chrono::steady_clock::now();
+   try {
+      ir::led_raii raii(led_);
+      for (unsigned r = 0; r < c.repeat; ++r) {
+         wave.send();
+      }
+      stats_.on_air.record(std::chrono::steady_clock::now() - air_started);
+   } catch (...) {
+      release_wave(wave);
+      publish_event("transmit_finish", event_data{R"({"raw":%zu,"duration_us":%llu,"status":"failed"})", timings.size(),
+                                                  static_cast<unsigned long long>(elapsed_us(air_started))}
+                                          .view());
+      throw;
+   }
+   release_wave(wave);
+   publish_event("transmit_finish", event_data{R"({"raw":%zu,"duration_us":%llu,"status":"ok"})", timings.size(),
+                                               static_cast<unsigned long long>(elapsed_us(air_started))}
+                                       .view());
+   return batch::status::ok;
+}
+
+void server::finish_batch(std::span<const batch::command> commands,
+                          std::span<const batch::result> results,
+                          std::chrono::steady_clock::time_point started) {
+   const auto failed = std::count_if(results.begin(), results.end(),
+                                     [](const batch::result &r) { return r.state != batch::status::ok; });
+   log::info("http.batch",
+             {log::kv("commands", std::uint64_t{commands.size()}), log::kv("failed", static_cast<std::uint64_t>(failed)),
+              log::kv("duration_us", elapsed_us(started))});
+
+   transmitter_held_ = false;
+   if (std::exchange(dispatch_deferred_, false)) {
+      boost::asio::post(transmit_strand_, [this] { dispatch_transmit(); });
+   }
+}
+
+void server::handle_button(button::gesture g) {
+   stats_.button_presses.add();
+
+   code_t code = options_.button_code;
+   const char *name = "short_press";
+
+   switch (g) {
+      case button::gesture::short_press:
+         break;
+
+      case button::gesture::double_press:
+         code = options_.button_double_code.value_or(code);
+         name = "double_press";
+         break;
+
+      case button::gesture::long_press:
+         code = options_.button_long_code.value_or(code);
+         name = "long_press";
+         break;
+
+      case button::gesture::hold_repeat:
+         code = options_.button_long_code.value_or(code);
+         name = "hold";
+         break;
+   }
+
+   send_button_code(name, code);
+}
+
+void server::handle_panel_button(int pin) {
+   stats_.panel_presses.add();
+
+   for (const auto &b : options_.panel_buttons) {
+      if (b.pin == pin) {
+         send_button_code("panel_press", b.code);
+      }
+   }
+}
+
+void server::send_button_code(const char *name, code_t code) {
+   trace::span span{"server.button", code};
+   const auto started = std::chrono::steady_clock::now();
+   publish_event("button", event_data{R"({"gesture":"%s","code":%u})", name, code}.view());
+   try {
+      transmit(code);
+      log::info("button.send",
+                {log::kv("gesture", name), log::hex("code", code), log::kv("duration_us", elapsed_us(started))});
+   } catch (const std::exception &e) {
+      log::error("button.send_failed", {log::kv("gesture", name), log::hex("code", code), log::text("error", e.what())});
+   }
+}
+
+void server::transmit(code_t code, std::optional<std::chrono::steady_clock::time_point> start) {
+   publish_event("transmit_start", event_data{R"({"code":%u})", code}.view());
+   const auto started = std::chrono::steady_clock::now();
+   try {
+      transmit_wave(code, start);
+   } catch (...) {
+      publish_event("transmit_finish", event_data{R"({"code":%u,"duration_us":%llu,"status":"failed"})", code,
+                                                  static_cast<unsigned long long>(elapsed_us(started))}
+                                          .view());
+      throw;
+   }
+   publish_event("transmit_finish", event_data{R"({"code":%u,"duration_us":%llu,"status":"ok"})", code,
+                                               static_cast<unsigned long long>(elapsed_us(started))}
+                                       .view());
+}
+
+void server::transmit_wave(code_t code, std::optional<std::chrono::steady_clock::time_point> start) {
    auto it = waves_.find(code);
    if (it == std::end(waves_)) {
+      stats_.cache_misses.add();
       add_necx_wave(code);
+      it = waves_.find(code);
+   } else {
+      stats_.cache_hits.add();
+      if (!it->second.wave->uploaded() && !upload_wave(*it->second.wave, true)) {
+         throw std::runtime_error("Out of pigpio wave resources");
+      }
+   }
+   it->second.last_used = ++use_clock_;
+
+   // The wave is ready by now: sleep through most of the wait for the start, spin on gpioTick for the rest
+   std::optional<std::uint32_t> start_tick;
+   std::uint64_t late_us = 0;
+   if (start) {
+      auto now = std::chrono::steady_clock::now();
+      if (*start - now > start_spin) {
+         std::this_thread::sleep_for(*start - now - start_spin);
+         now = std::chrono::steady_clock::now();
+      }
+
+      const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(*start - now).count();
+      start_tick = gpioTick() + static_cast<std::uint32_t>(std::max<std::int64_t>(wait, 0));
+      late_us = static_cast<std::uint64_t>(std::max<std::int64_t>(-wait, 0));
    }
 
-   std::cout << "HTTP send: 0x" << std::hex << code << "...";
    ir::led_raii raii(led_);
-   waves_[code]->send();
-   std::cout << "sent" << std::endl;
+   if (start_tick) {
+      const auto tick = it->second.wave->send_at(*start_tick);
+      stats_.on_air.record(std::uint64_t{gpioTick() - tick});
+      stats_.schedule_start_error.record(late_us + (tick - *start_tick));
+   } else {
+      const auto started = std::chrono::steady_clock::now();
+      it->second.wave->send();
+      stats_.on_air.record(std::chrono::steady_clock::now() - started);
+   }
 }
 
-void server::handle_button_press() {
-   std::cout << "Button press: 0x" << std::hex << options_.button_code << "...";
-   ir::led_raii raii(led_);
-   waves_[options_.button_code]->send();
-   std::cout << "sent" << std::endl;
+void server::dispatch_transmit() {
+   if (transmitter_held_) {
+      // Picked up again by finish_batch
+      dispatch_deferred_ = true;
+      return;
+   }
+
+   const auto queued = transmit_queue_.size();
+   stats_.transmit_queued.set(static_cast<std::int64_t>(queued.jobs));
+   stats_.transmit_clients.set(static_cast<std::int64_t>(queued.clients));
+
+   if (!transmit_queue_.run_next(std::chrono::steady_clock::now())) {
+      stats_.transmit_queued.set(0);
+      stats_.transmit_clients.set(0);
+      return;
+   }
+
+   // One job per handler: the rest of the control context gets to run between the transmissions
+   boost::asio::post(transmit_strand_, [this] { dispatch_transmit(); });
+}
+
+unsigned server::client_weight_of(const client_key &client) const {
+   if (client_weights_.empty()) {
+      return 1;
+   }
+
+   auto it = client_weights_.find(client);
+   return it == std::end(client_weights_) ? 1 : it->second;
+}
+
+void server::publish_event(std::string_view event, std::string_view data) {
+   events_.publish(event, data);
+   stats_.events_published.add();
+
+   for (auto &w : workers_) {
+      w->events().notify();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: server::worker
+////////////////////////////////////////////////////////////////////////////////
+server::worker::worker(server &server, std::size_t max_connections, std::size_t max_sessions)
+   : connections_{server, io_, max_connections, max_sessions, [this] { resume_.cancel(); }} {
+   // Nothing to do here
+}
+
+server::worker::~worker() {
+   // Handlers left in the context at shutdown (e.g. completions of transmissions that were still queued) are allocated
+   // from the handler memory of the connection objects, so they have to go before the connection pool does. The
+   // sockets and timers are fine with being destroyed after their services were shut down.
+   io_.shutdown();
+}
+
+void server::worker::listen(std::uint16_t port) {
+   // Every worker binds its own socket to the same port, the kernel distributes incoming connections between them
+   acceptor_.open(tcp::v4());
+   acceptor_.set_option(tcp::acceptor::reuse_address(true));
+   acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+   acceptor_.bind({tcp::v4(), port});
+   acceptor_.listen();
+
+   boost::asio::co_spawn(io_, accept_loop(), boost::asio::detached);
+}
+
+boost::asio::awaitable<void> server::worker::accept_loop() {
+   using boost::asio::redirect_error;
+   using boost::asio::use_awaitable;
+
+   boost::system::error_code ec;
+   for (;;) {
+      if (connections_.available() == 0) {
+         // Back-pressure: leave pending connections in the listen backlog until a connection object is released
+         ++connections_.stats().accept_paused;
+         resume_.expires_at(std::chrono::steady_clock::time_point::max());
+         co_await resume_.async_wait(redirect_error(use_awaitable, ec));
+         continue;
+      }
+
+      auto socket = co_await acceptor_.async_accept(redirect_error(use_awaitable, ec));
+      if (ec == boost::asio::error::operation_aborted) {
+         co_return;
+      }
+
+      if (ec) {
+         log::warning("http.accept_error", {log::text("error", ec.message())});
+         continue;
+      }
+
+      // Accepting is paused while the request slots are taken, so there always is a free connection object here
+      ++connections_.stats().accepted;
+      connections_.acquire()->start(std::move(socket));
+   }
 }
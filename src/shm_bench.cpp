@@ -0,0 +1,125 @@
+/**
+ * @file   shm_bench.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ *
+ * Benchmark client of the shared-memory command ring: the time from a submission to its completion, with an idle
+ * server (every command rings the doorbell) and back to back, then the throughput with the ring kept full.
+ */
+
+#include <ir/shm_client.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+namespace {
+
+using clock_t = std::chrono::steady_clock;
+
+//! Submit the code and spin until it is done, pausing between the commands
+void measure(ir::shm_client &client, const char *name, std::uint32_t code, std::size_t commands,
+             std::chrono::microseconds pause) {
+   std::vector<clock_t::duration> latencies;
+   latencies.reserve(commands);
+
+   while (latencies.size() < commands) {
+      const auto started = clock_t::now();
+      const auto ticket = client.submit(code);
+      if (!ticket) {
+         std::this_thread::yield();
+         continue;
+      }
+
+      while (!client.done(*ticket)) {
+      }
+      latencies.push_back(clock_t::now() - started);
+      std::this_thread::sleep_for(pause);
+   }
+
+   std::sort(latencies.begin(), latencies.end());
+   const auto us = [&](double p) {
+      const auto i = std::min(latencies.size() - 1, static_cast<std::size_t>(p * static_cast<double>(commands)));
+      return std::chrono::duration<double, std::micro>(latencies[i]).count();
+   };
+   std::printf("submit -> done, %s, %zu commands: p50 %.1f us, p99 %.1f us\n", name, commands, us(0.5), us(0.99));
+}
+
+void throughput(ir::shm_client &client, std::uint32_t code, std::size_t commands) {
+   const auto started = clock_t::now();
+   std::uint32_t last = 0;
+   for (std::size_t sent = 0; sent < commands;) {
+      if (const auto ticket = client.submit(code)) {
+         last = *ticket;
+         ++sent;
+      } else {
+         std::this_thread::yield();
+      }
+   }
+
+   while (!client.done(last)) {
+      std::this_thread::yield();
+   }
+
+   const auto elapsed = std::chrono::duration<double>(clock_t::now() - started).count();
+   std::printf("throughput, %zu commands: %.0f commands/s\n", commands, static_cast<double>(commands) / elapsed);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+   namespace po = boost::program_options;
+
+   po::options_description all("Benchmark the shared-memory command ring of ir-ctrl");
+   all.add_options()
+      ("help,h", "Show help")
+      ("socket", po::value<std::string>()->required(), "Shared-memory socket of ir-ctrl (its --shm-socket)")
+      ("code", po::value<std::uint32_t>()->default_value(0x81387), "NECx code to send")
+      ("commands", po::value<std::size_t>()->default_value(5000), "Number of commands of each latency test")
+      ("throughput-commands", po::value<std::size_t>()->default_value(200000), "Number of commands of the throughput test (0 - skip)");
+
+   std::string path;
+   std::uint32_t code = 0;
+   std::size_t commands = 0, throughput_commands = 0;
+   try {
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, all), vm);
+
+      if (vm.count("help")) {
+         std::cout << all << "\n";
+         return EXIT_SUCCESS;
+      }
+
+      po::notify(vm);
+      path = vm["socket"].as<std::string>();
+      code = vm["code"].as<std::uint32_t>();
+      commands = std::max<std::size_t>(1, vm["commands"].as<std::size_t>());
+      throughput_commands = vm["throughput-commands"].as<std::size_t>();
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      std::cerr << all << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   auto client = ir::shm_client::connect(path);
+   if (!client) {
+      std::cerr << "Error: cannot connect to " << path << ": " << client.error().message() << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   // Long enough a pause for the server to go to sleep on the doorbell
+   measure(client.value(), "idle server", code, commands, std::chrono::microseconds{50});
+   measure(client.value(), "back to back", code, commands, std::chrono::microseconds{0});
+   if (throughput_commands) {
+      throughput(client.value(), code, throughput_commands);
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file   shm_client.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ */
+
+#include <ir/shm_client.h>
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+std::error_code last_error() {
+   return {errno, std::generic_category()};
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: shm_client
+////////////////////////////////////////////////////////////////////////////////
+result_t<shm_client> shm_client::connect(const std::string &socket_path) {
+   sockaddr_un address{};
+   address.sun_family = AF_UNIX;
+   if (socket_path.size() >= sizeof(address.sun_path)) {
+      return std::errc::filename_too_long;
+   }
+   std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+   const int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (sock < 0) {
+      return last_error();
+   }
+
+   if (::connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+      const auto ec = last_error();
+      ::close(sock);
+      return ec;
+   }
+
+   // The server sends its ring version along with the memfd and the eventfd, then closes the connection
+   std::uint32_t version = 0;
+   iovec data{&version, sizeof(version)};
+   alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(int))> control{};
+
+   msghdr message{};
+   message.msg_iov = &data;
+   message.msg_iovlen = 1;
+   message.msg_control = control.data();
+   message.msg_controllen = control.size();
+
+   const auto received = ::recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+   const auto ec = last_error();
+   ::close(sock);
+
+   const auto cmsg = received > 0 ? CMSG_FIRSTHDR(&message) : nullptr;
+   if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+      return received < 0 ? ec : std::make_error_code(std::errc::protocol_error);
+   }
+
+   std::array<int, 2> fds{};
+   std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(fds));
+
+   if (received != sizeof(version) || version != shm_ring::version) {
+      ::close(fds[0]);
+      ::close(fds[1]);
+      return std::errc::protocol_error;
+   }
+
+   auto ring = shm_ring::attach(fds[0]);
+   if (!ring) {
+      ::close(fds[1]);
+      return ring.error();
+   }
+
+   return shm_client{std::move(ring.value()), fds[1]};
+}
+
+shm_client::shm_client(shm_ring ring, int doorbell)
+   : ring_{std::move(ring)}
+   , doorbell_{doorbell} {
+   // Nothing to do here
+}
+
+shm_client::shm_client(shm_client &&other) noexcept
+   : ring_{std::move(other.ring_)}
+   , doorbell_{std::exchange(other.doorbell_, -1)} {
+   // Nothing to do here
+}
+
+shm_client &shm_client::operator=(shm_client &&other) noexcept {
+   std::swap(ring_, other.ring_);
+   std::swap(doorbell_, other.doorbell_);
+   return *this;
+}
+
+shm_client::~shm_client() {
+   if (doorbell_ >= 0) {
+      ::close(doorbell_);
+   }
+}
+
+std::optional<std::uint32_t> shm_client::submit(std::uint32_t code, std::uint8_t repeat) {
+   const auto now = std::chrono::steady_clock::now().time_since_epoch();
+   const shm_command command{
+      static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), code, 0, repeat,
+      0};
+
+   auto ticket = ring_.try_push(command);
+   if (ticket && ring_.consumer_sleeping()) {
+      const std::uint64_t one = 1;
+      [[maybe_unused]] auto res = ::write(doorbell_, &one, sizeof(one));
+   }
+   return ticket;
+}
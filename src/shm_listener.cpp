@@ -0,0 +1,220 @@
+/**
+ * @file   shm_listener.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ */
+
+#include <ir/log.h>
+#include <ir/server.h>
+#include <ir/shm_listener.h>
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <system_error>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+shm_ring create_ring(std::uint32_t capacity) {
+   auto ring = shm_ring::create(capacity);
+   if (!ring) {
+      throw std::system_error(ring.error(), "Failed to create the shared-memory ring");
+   }
+   return std::move(ring.value());
+}
+
+int create_doorbell() {
+   const int fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "Failed to create the doorbell");
+   }
+   return fd;
+}
+
+//! Hand the descriptors to a client, the message is tiny enough to never block
+bool send_fds(int sock, int ring, int doorbell) {
+   std::uint32_t version = shm_ring::version;
+   iovec data{&version, sizeof(version)};
+
+   alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(int))> control{};
+   msghdr message{};
+   message.msg_iov = &data;
+   message.msg_iovlen = 1;
+   message.msg_control = control.data();
+   message.msg_controllen = control.size();
+
+   auto cmsg = CMSG_FIRSTHDR(&message);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+   const std::array<int, 2> fds{ring, doorbell};
+   std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+
+   return ::sendmsg(sock, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(version));
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: shm_listener
+////////////////////////////////////////////////////////////////////////////////
+shm_listener::shm_listener(server &server, boost::asio::io_context &io, std::uint32_t capacity)
+   : server_{&server}
+   , ring_{create_ring(capacity)}
+   , doorbell_{io.get_executor(), create_doorbell()}
+   , stall_timer_{io.get_executor()}
+   , acceptor_{io.get_executor()} {
+   // Nothing to do here
+}
+
+void shm_listener::listen(const std::string &path, unsigned mode, int group) {
+   // A socket file left behind by a previous run would make the bind fail, a mistyped path to anything else must not
+   // be deleted
+   struct stat st {};
+   if (::lstat(path.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+         throw boost::system::system_error{boost::system::errc::make_error_code(boost::system::errc::file_exists),
+                                          "shm socket " + path};
+      }
+      ::unlink(path.c_str());
+   }
+
+   acceptor_.open(protocol_t{});
+   acceptor_.bind(protocol_t::endpoint{path});
+   path_ = path;
+
+   // Access to the ring is access to the socket: set up before listening, instead of leaving it to the umask
+   if ((group >= 0 && ::chown(path_.c_str(), static_cast<uid_t>(-1), static_cast<gid_t>(group)) != 0) ||
+       ::chmod(path_.c_str(), static_cast<mode_t>(mode)) != 0) {
+      throw boost::system::system_error{boost::system::error_code{errno, boost::system::generic_category()},
+                                       "shm socket " + path};
+   }
+   acceptor_.listen();
+
+   boost::asio::co_spawn(acceptor_.get_executor(), accept_loop(), boost::asio::detached);
+   boost::asio::co_spawn(acceptor_.get_executor(), consume_loop(), boost::asio::detached);
+   log::info("shm.listen", {log::text("path", path_), log::kv("capacity", ring_.capacity())});
+}
+
+void shm_listener::stop() {
+   boost::system::error_code ec;
+   acceptor_.close(ec);
+   doorbell_.cancel(ec);
+   stall_timer_.cancel();
+
+   if (!path_.empty()) {
+      ::unlink(path_.c_str());
+   }
+}
+
+boost::asio::awaitable<void> shm_listener::accept_loop() {
+   boost::system::error_code ec;
+   for (;;) {
+      auto socket = co_await acceptor_.async_accept(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      if (ec == boost::asio::error::operation_aborted) {
+         co_return;
+      }
+
+      if (ec) {
+         log::warning("shm.accept_error", {log::text("error", ec.message())});
+         continue;
+      }
+
+      if (!send_fds(socket.native_handle(), ring_.fd(), doorbell_.native_handle())) {
+         log::warning("shm.handshake_failed", {log::text("error", std::strerror(errno))});
+         continue;
+      }
+
+      server_->stats().shm_clients.add();
+      log::debug("shm.client");
+   }
+}
+
+boost::asio::awaitable<void> shm_listener::consume_loop() {
+   auto &stats = server_->stats();
+   boost::system::error_code ec;
+   shm_command c{};
+
+   // Since when the next position is claimed, but not published
+   std::optional<std::chrono::steady_clock::time_point> claimed_since;
+
+   for (;;) {
+      while (ring_.try_pop(c)) {
+         const auto now = std::chrono::steady_clock::now();
+         claimed_since.reset();
+         stats.shm_commands.add();
+
+         if (c.protocol != 0 || c.repeat > max_repeat) {
+            stats.shm_invalid.add();
+            ring_.complete();
+            continue;
+         }
+
+         // The clock is shared with the clients, but a garbage (or missing) timestamp must not spoil the histogram, or
+         // expire the command right away
+         auto submitted = std::chrono::steady_clock::time_point{std::chrono::nanoseconds{c.submitted_ns}};
+         if (c.submitted_ns && submitted <= now) {
+            stats.shm_dispatch.record(now - submitted);
+         } else {
+            submitted = now;
+         }
+
+         // The ring has no way to report a refusal, the command is done without a transmission then
+         if (!server_->limits().acquire(client_key::local(), 1U + c.repeat, now).admitted) {
+            stats.shm_rate_limited.add();
+            ring_.complete();
+            continue;
+         }
+
+         co_await server_->async_send_necx_wave(client_key::local(), c.code, 1U + c.repeat,
+                                                server::deadline_after(submitted, server_->get_options().shm_deadline),
+                                                boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+         server_->limits().release(client_key::local());
+         if (ec == boost::asio::error::timed_out) {
+            stats.shm_expired.add();
+         }
+         ring_.complete();
+      }
+
+      if (ring_.claimed()) {
+         // Usually a producer in the middle of its push, which rings the doorbell only if the consumer sleeps. Polled
+         // instead, so that a producer that died there is noticed.
+         const auto now = std::chrono::steady_clock::now();
+         if (!claimed_since) {
+            claimed_since = now;
+         } else if (now - *claimed_since >= stall_timeout && ring_.skip()) {
+            stats.shm_stalled.add();
+            log::warning("shm.stalled_slot");
+            ring_.complete();
+            claimed_since.reset();
+            continue;
+         }
+
+         stall_timer_.expires_after(stall_poll_interval);
+         co_await stall_timer_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+         if (ec == boost::asio::error::operation_aborted) {
+            co_return;
+         }
+         continue;
+      }
+
+      if (!ring_.prepare_sleep()) {
+         continue;
+      }
+
+      co_await doorbell_.async_read_some(boost::asio::buffer(&doorbell_value_, sizeof(doorbell_value_)),
+                                         boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      ring_.wake_up();
+      if (ec == boost::asio::error::operation_aborted) {
+         co_return;
+      }
+   }
+}
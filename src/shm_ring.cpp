@@ -0,0 +1,266 @@
+/**
+ * @file   shm_ring.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ */
+
+#include <ir/shm_ring.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+constexpr std::array<char, 8> ring_magic{'I', 'R', 'S', 'H', 'M', 'R', 'N', 'G'};
+constexpr std::size_t cache_line = 64;
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "Shared atomics have to be lock-free");
+static_assert(sizeof(shm_command) == 16, "Unexpected command layout");
+
+//! Wrap-around comparison of the positions
+bool before(std::uint32_t lhs, std::uint32_t rhs) {
+   return static_cast<std::int32_t>(lhs - rhs) < 0;
+}
+
+std::error_code last_error() {
+   return {errno, std::generic_category()};
+}
+
+} // namespace
+
+struct shm_ring::header {
+   std::array<char, 8> magic;
+   std::uint32_t version;
+   std::uint32_t capacity;
+
+   alignas(cache_line) std::atomic<std::uint32_t> tail;      //!< Next position to be claimed by a producer
+   alignas(cache_line) std::atomic<std::uint32_t> completed; //!< Number of handled commands
+   alignas(cache_line) std::atomic<std::uint32_t> sleeping;  //!< Consumer waits for the doorbell
+};
+
+struct shm_ring::slot {
+   //! position: free for the producer of this position, position + 1: ready for the consumer
+   std::atomic<std::uint32_t> sequence;
+   std::uint32_t reserved;
+   shm_command command;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: shm_ring
+////////////////////////////////////////////////////////////////////////////////
+result_t<shm_ring> shm_ring::create(std::uint32_t capacity) {
+   if (capacity < 2 || capacity > max_capacity || (capacity & (capacity - 1)) != 0) {
+      return std::errc::invalid_argument;
+   }
+
+   const int fd = ::memfd_create("ir-ctrl-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+   if (fd < 0) {
+      return last_error();
+   }
+
+   const auto size = mapping_size(capacity);
+   if (::ftruncate(fd, static_cast<off_t>(size)) != 0 ||
+       ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+      const auto ec = last_error();
+      ::close(fd);
+      return ec;
+   }
+
+   void *mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (mapping == MAP_FAILED) {
+      const auto ec = last_error();
+      ::close(fd);
+      return ec;
+   }
+
+   auto h = new (mapping) header{ring_magic, version, capacity, {0}, {0}, {0}};
+   auto slots = reinterpret_cast<slot *>(h + 1);
+   for (std::uint32_t i = 0; i < capacity; ++i) {
+      new (slots + i) slot{{i}, 0, {}};
+   }
+
+   return shm_ring{fd, mapping, size};
+}
+
+result_t<shm_ring> shm_ring::attach(int fd) {
+   struct stat st {};
+   if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+      ::close(fd);
+      return std::errc::invalid_argument;
+   }
+
+   const auto size = static_cast<std::size_t>(st.st_size);
+   void *mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (mapping == MAP_FAILED) {
+      const auto ec = last_error();
+      ::close(fd);
+      return ec;
+   }
+
+   // The ring owns the mapping from here on, and cleans up if it is invalid
+   shm_ring ring{fd, mapping, size};
+   const auto &h = ring.get_header();
+   if (h.magic != ring_magic || h.version != version || h.capacity < 2 || h.capacity > max_capacity ||
+       (h.capacity & (h.capacity - 1)) != 0 || mapping_size(h.capacity) != size) {
+      return std::errc::invalid_argument;
+   }
+
+   return ring;
+}
+
+shm_ring::shm_ring(int fd, void *mapping, std::size_t size)
+   : fd_{fd}
+   , mapping_{mapping}
+   , mapping_size_{size}
+   , capacity_{static_cast<header *>(mapping)->capacity} {
+   // Nothing to do here
+}
+
+shm_ring::shm_ring(shm_ring &&other) noexcept
+   : fd_{std::exchange(other.fd_, -1)}
+   , mapping_{std::exchange(other.mapping_, nullptr)}
+   , mapping_size_{std::exchange(other.mapping_size_, 0)}
+   , capacity_{std::exchange(other.capacity_, 0)}
+   , head_{other.head_} {
+   // Nothing to do here
+}
+
+shm_ring &shm_ring::operator=(shm_ring &&other) noexcept {
+   // The other ring releases the previous mapping
+   std::swap(fd_, other.fd_);
+   std::swap(mapping_, other.mapping_);
+   std::swap(mapping_size_, other.mapping_size_);
+   std::swap(capacity_, other.capacity_);
+   std::swap(head_, other.head_);
+   return *this;
+}
+
+shm_ring::~shm_ring() {
+   if (mapping_) {
+      ::munmap(mapping_, mapping_size_);
+   }
+   if (fd_ >= 0) {
+      ::close(fd_);
+   }
+}
+
+std::size_t shm_ring::mapping_size(std::uint32_t capacity) {
+   return sizeof(header) + std::size_t{capacity} * sizeof(slot);
+}
+
+shm_ring::header &shm_ring::get_header() const {
+   return *static_cast<header *>(mapping_);
+}
+
+shm_ring::slot &shm_ring::get_slot(std::uint32_t position) const {
+   return reinterpret_cast<slot *>(static_cast<header *>(mapping_) + 1)[position & (capacity_ - 1)];
+}
+
+std::optional<std::uint32_t> shm_ring::try_push(const shm_command &command) {
+   for (;;) {
+      auto ticket = claim();
+      if (!ticket || publish(*ticket, command)) {
+         return ticket;
+      }
+   }
+}
+
+std::optional<std::uint32_t> shm_ring::claim() {
+   auto &tail = get_header().tail;
+   auto position = tail.load(std::memory_order_relaxed);
+
+   for (;;) {
+      const auto sequence = get_slot(position).sequence.load(std::memory_order_acquire);
+
+      if (sequence == position) {
+         if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            return position;
+         }
+      } else if (before(sequence, position)) {
+         // The slot still holds the command of the previous round
+         return std::nullopt;
+      } else {
+         // Another producer got there first
+         position = tail.load(std::memory_order_relaxed);
+      }
+   }
+}
+
+bool shm_ring::publish(std::uint32_t ticket, const shm_command &command) {
+   auto &s = get_slot(ticket);
+   s.command = command;
+
+   // Skipped slots already belong to the next round. If a producer of that round claimed it meanwhile, the command
+   // written above may garble its one: the consumer copes with garbage commands anyway.
+   auto expected = ticket;
+   return s.sequence.compare_exchange_strong(expected, ticket + 1, std::memory_order_release,
+                                             std::memory_order_relaxed);
+}
+
+bool shm_ring::consumer_sleeping() const {
+   // Pairs with the fence in prepare_sleep: either the consumer sees the new command, or the producer sees it sleeping
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   return get_header().sleeping.load(std::memory_order_relaxed) != 0;
+}
+
+bool shm_ring::done(std::uint32_t ticket) const {
+   return before(ticket, get_header().completed.load(std::memory_order_acquire));
+}
+
+bool shm_ring::try_pop(shm_command &command) {
+   auto &s = get_slot(head_);
+   if (s.sequence.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+   }
+
+   command = s.command;
+   s.sequence.store(head_ + capacity_, std::memory_order_release);
+   ++head_;
+   return true;
+}
+
+void shm_ring::complete() {
+   auto &completed = get_header().completed;
+   completed.store(completed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool shm_ring::claimed() const {
+   return before(head_, get_header().tail.load(std::memory_order_acquire)) &&
+          get_slot(head_).sequence.load(std::memory_order_acquire) == head_;
+}
+
+bool shm_ring::skip() {
+   auto expected = head_;
+   if (!get_slot(head_).sequence.compare_exchange_strong(expected, head_ + capacity_, std::memory_order_acq_rel)) {
+      return false;
+   }
+
+   ++head_;
+   return true;
+}
+
+bool shm_ring::prepare_sleep() {
+   auto &sleeping = get_header().sleeping;
+   sleeping.store(1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+
+   if (get_slot(head_).sequence.load(std::memory_order_acquire) == head_ + 1) {
+      sleeping.store(0, std::memory_order_relaxed);
+      return false;
+   }
+   return true;
+}
+
+void shm_ring::wake_up() {
+   get_header().sleeping.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,165 @@
+/**
+ * @file   timer_wheel.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 27, 2021
+ */
+
+#include <ir/timer_wheel.h>
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+using namespace ir;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: timer_wheel
+////////////////////////////////////////////////////////////////////////////////
+timer_wheel::timer_wheel(std::uint64_t now)
+   : now_{now} {
+   for (auto &h : heads_) {
+      h.prev = h.next = &h;
+   }
+}
+
+void timer_wheel::insert(entry &e, std::uint64_t expiry) {
+   e.expiry = expiry;
+   place(e);
+   ++size_;
+}
+
+void timer_wheel::remove(entry &e) {
+   unlink(e);
+}
+
+std::optional<std::uint64_t> timer_wheel::next_expiry() const {
+   if (!size_) {
+      return std::nullopt;
+   }
+   return next_event();
+}
+
+std::uint64_t timer_wheel::next_event() const {
+   constexpr std::uint64_t mask = num_slots - 1;
+   auto result = std::numeric_limits<std::uint64_t>::max();
+
+   // Level 0 holds the timers of the current 256 ticks, the current slot included (timers that were inserted due).
+   // A higher level slot is processed once the time reaches its start, its own digit is always ahead of the current
+   // one: timers with the same digit would have been placed on a lower level.
+   for (unsigned level = 0; level < num_levels; ++level) {
+      const auto shift = level * level_bits;
+      const auto digit = (now_ >> shift) & mask;
+      const auto slot = find_occupied(level, level ? digit + 1 : digit);
+      if (slot == num_slots) {
+         continue;
+      }
+
+      const auto base = (now_ >> (shift + level_bits)) << (shift + level_bits);
+      result = std::min(result, base | (slot << shift));
+   }
+
+   if (heads_[overflow_slot].next != &heads_[overflow_slot]) {
+      constexpr auto top = num_levels * level_bits;
+      result = std::min(result, ((now_ >> top) + 1) << top);
+   }
+   return result;
+}
+
+std::size_t timer_wheel::find_occupied(unsigned level, std::size_t from) const {
+   const auto &words = occupied_[level];
+   for (auto w = from / 64; w < words_per_level; ++w) {
+      auto bits = words[w];
+      if (w == from / 64) {
+         bits &= ~std::uint64_t{0} << (from % 64);
+      }
+      if (bits) {
+         return w * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+      }
+   }
+   return num_slots;
+}
+
+void timer_wheel::place(entry &e) {
+   // A due timer goes to the current slot
+   const auto expiry = std::max(e.expiry, now_);
+   const auto diff = expiry ^ now_;
+   const auto level = diff ? static_cast<unsigned>(63 - std::countl_zero(diff)) / level_bits : 0U;
+   if (level >= num_levels) {
+      link(e, overflow_slot);
+      return;
+   }
+
+   const auto digit = (expiry >> (level * level_bits)) & (num_slots - 1);
+   link(e, static_cast<std::uint32_t>(level * num_slots + digit));
+}
+
+void timer_wheel::link(entry &e, std::uint32_t slot) {
+   auto &head = heads_[slot];
+   e.slot = slot;
+   e.prev = head.prev;
+   e.next = &head;
+   head.prev->next = &e;
+   head.prev = &e;
+
+   if (slot != overflow_slot) {
+      occupied_[slot / num_slots][(slot % num_slots) / 64] |= std::uint64_t{1} << (slot % 64);
+   }
+}
+
+void timer_wheel::unlink(entry &e) {
+   e.prev->next = e.next;
+   e.next->prev = e.prev;
+   e.prev = e.next = nullptr;
+   --size_;
+
+   const auto slot = e.slot;
+   if (slot != overflow_slot && heads_[slot].next == &heads_[slot]) {
+      occupied_[slot / num_slots][(slot % num_slots) / 64] &= ~(std::uint64_t{1} << (slot % 64));
+   }
+}
+
+void timer_wheel::take_slot(std::uint32_t slot, entry &list) {
+   auto &head = heads_[slot];
+   if (head.next == &head) {
+      list.prev = list.next = &list;
+      return;
+   }
+
+   list.next = head.next;
+   list.prev = head.prev;
+   list.next->prev = &list;
+   list.prev->next = &list;
+   head.prev = head.next = &head;
+
+   if (slot != overflow_slot) {
+      occupied_[slot / num_slots][(slot % num_slots) / 64] &= ~(std::uint64_t{1} << (slot % 64));
+   }
+}
+
+void timer_wheel::cascade() {
+   constexpr std::uint64_t mask = num_slots - 1;
+
+   auto redistribute = [this](std::uint32_t slot) {
+      entry list;
+      take_slot(slot, list);
+      while (list.next != &list) {
+         auto &e = *list.next;
+         e.prev->next = e.next;
+         e.next->prev = e.prev;
+         place(e);
+      }
+   };
+
+   // From the top down: a timer cascaded from a higher level may land in a lower level slot reached by the same tick
+   if ((now_ & ((std::uint64_t{1} << (num_levels * level_bits)) - 1)) == 0) {
+      redistribute(overflow_slot);
+   }
+
+   for (unsigned level = num_levels - 1; level > 0; --level) {
+      const auto shift = level * level_bits;
+      if (now_ & ((std::uint64_t{1} << shift) - 1)) {
+         continue;
+      }
+      redistribute(static_cast<std::uint32_t>(level * num_slots + ((now_ >> shift) & mask)));
+   }
+}
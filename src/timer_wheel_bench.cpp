@@ -0,0 +1,248 @@
+/**
+ * @file   timer_wheel_bench.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 27, 2021
+ *
+ * Benchmark of the scheduler's timing wheel against an ordered multimap (the usual timer queue), checking on the way
+ * that every timer fires exactly once, in order, and never early.
+ */
+
+#include <ir/timer_wheel.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+namespace {
+
+using clock_t = std::chrono::steady_clock;
+
+struct wheel_timer : ir::timer_wheel::entry {
+   std::uint64_t due{0};
+   std::uint64_t period{0};
+   std::uint64_t fired{0};
+};
+
+struct map_timer {
+   std::multimap<std::uint64_t, map_timer *>::iterator it{};
+   std::uint64_t due{0};
+   std::uint64_t period{0};
+   std::uint64_t fired{0};
+};
+
+double ns_per_op(clock_t::time_point started, std::size_t ops) {
+   const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - started).count();
+   return ops ? static_cast<double>(ns) / static_cast<double>(ops) : 0.0;
+}
+
+struct result {
+   double insert;
+   double cancel;
+   double fire;
+   bool ok;
+};
+
+/**
+ * One-shot timers, expiring within the range (in ticks): insert them all, cancel every other one, then fire the rest.
+ */
+result one_shot_wheel(const std::vector<std::uint64_t> &expiries, const std::vector<std::size_t> &cancel_order) {
+   std::vector<wheel_timer> timers(expiries.size());
+   ir::timer_wheel wheel;
+   result r{0, 0, 0, true};
+
+   auto started = clock_t::now();
+   for (std::size_t i = 0; i < timers.size(); ++i) {
+      timers[i].due = expiries[i];
+      wheel.insert(timers[i], expiries[i]);
+   }
+   r.insert = ns_per_op(started, timers.size());
+
+   started = clock_t::now();
+   for (auto i : cancel_order) {
+      wheel.remove(timers[i]);
+   }
+   r.cancel = ns_per_op(started, cancel_order.size());
+
+   std::size_t fired = 0;
+   std::uint64_t last = 0;
+   started = clock_t::now();
+   while (auto next = wheel.next_expiry()) {
+      wheel.advance(*next, [&](ir::timer_wheel::entry &e) {
+         auto &t = static_cast<wheel_timer &>(e);
+         // Fired at its own tick: neither early nor late, and never before an earlier one
+         r.ok &= t.due == wheel.now() && t.due >= last && t.fired++ == 0;
+         last = t.due;
+         ++fired;
+      });
+   }
+   r.fire = ns_per_op(started, fired);
+   r.ok &= fired == timers.size() - cancel_order.size();
+   return r;
+}
+
+result one_shot_map(const std::vector<std::uint64_t> &expiries, const std::vector<std::size_t> &cancel_order) {
+   std::vector<map_timer> timers(expiries.size());
+   std::multimap<std::uint64_t, map_timer *> queue;
+   result r{0, 0, 0, true};
+
+   auto started = clock_t::now();
+   for (std::size_t i = 0; i < timers.size(); ++i) {
+      timers[i].due = expiries[i];
+      timers[i].it = queue.emplace(expiries[i], &timers[i]);
+   }
+   r.insert = ns_per_op(started, timers.size());
+
+   started = clock_t::now();
+   for (auto i : cancel_order) {
+      queue.erase(timers[i].it);
+   }
+   r.cancel = ns_per_op(started, cancel_order.size());
+
+   std::size_t fired = 0;
+   started = clock_t::now();
+   while (!queue.empty()) {
+      auto &t = *queue.begin()->second;
+      queue.erase(queue.begin());
+      ++t.fired;
+      ++fired;
+   }
+   r.fire = ns_per_op(started, fired);
+   return r;
+}
+
+/**
+ * Periodic timers, rescheduled from their handlers, simulated over the duration (in ticks).
+ * @return Time per fired timer, in ns
+ */
+double periodic_wheel(const std::vector<std::uint64_t> &periods, std::uint64_t duration, std::size_t &fired, bool &ok) {
+   std::vector<wheel_timer> timers(periods.size());
+   ir::timer_wheel wheel;
+   for (std::size_t i = 0; i < timers.size(); ++i) {
+      timers[i].period = periods[i];
+      timers[i].due = periods[i];
+      wheel.insert(timers[i], timers[i].due);
+   }
+
+   fired = 0;
+   const auto started = clock_t::now();
+   for (auto next = wheel.next_expiry(); next && *next <= duration; next = wheel.next_expiry()) {
+      wheel.advance(*next, [&](ir::timer_wheel::entry &e) {
+         auto &t = static_cast<wheel_timer &>(e);
+         ok &= t.due == wheel.now();
+         t.due += t.period;
+         wheel.insert(t, t.due);
+         ++fired;
+      });
+   }
+   return ns_per_op(started, fired);
+}
+
+double periodic_map(const std::vector<std::uint64_t> &periods, std::uint64_t duration, std::size_t &fired) {
+   std::vector<map_timer> timers(periods.size());
+   std::multimap<std::uint64_t, map_timer *> queue;
+   for (std::size_t i = 0; i < timers.size(); ++i) {
+      timers[i].period = periods[i];
+      timers[i].due = periods[i];
+      timers[i].it = queue.emplace(timers[i].due, &timers[i]);
+   }
+
+   fired = 0;
+   const auto started = clock_t::now();
+   while (!queue.empty() && queue.begin()->first <= duration) {
+      auto &t = *queue.begin()->second;
+      queue.erase(queue.begin());
+      t.due += t.period;
+      t.it = queue.emplace(t.due, &t);
+      ++fired;
+   }
+   return ns_per_op(started, fired);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+   namespace po = boost::program_options;
+
+   po::options_description all("Benchmark the scheduler's timing wheel against an ordered multimap");
+   all.add_options()
+      ("help,h", "Show help")
+      ("timers", po::value<std::vector<std::size_t>>()->multitoken()->default_value({1000, 10000, 100000}, "1000 10000 100000"), "Numbers of timers to run with")
+      ("range", po::value<std::uint64_t>()->default_value(24 * 3600 * 1000), "One-shot timers expire within this many ticks (ms)")
+      ("duration", po::value<std::uint64_t>()->default_value(60 * 1000), "Simulated time of the periodic timers, ticks (ms)")
+      ("seed", po::value<unsigned>()->default_value(1), "Random seed");
+
+   std::vector<std::size_t> counts;
+   std::uint64_t range = 0, duration = 0;
+   unsigned seed = 0;
+   try {
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, all), vm);
+
+      if (vm.count("help")) {
+         std::cout << all << "\n";
+         return EXIT_SUCCESS;
+      }
+
+      po::notify(vm);
+      counts = vm["timers"].as<std::vector<std::size_t>>();
+      range = std::max<std::uint64_t>(1, vm["range"].as<std::uint64_t>());
+      duration = vm["duration"].as<std::uint64_t>();
+      seed = vm["seed"].as<unsigned>();
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      std::cerr << all << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   bool ok = true;
+   std::mt19937_64 random{seed};
+
+   std::printf("one-shot timers within %llu ticks, every other one cancelled (ns per operation)\n",
+               static_cast<unsigned long long>(range));
+   std::printf("%10s %8s %10s %10s %10s\n", "timers", "queue", "insert", "cancel", "fire");
+   for (auto count : counts) {
+      std::uniform_int_distribution<std::uint64_t> expiry{0, range - 1};
+      std::vector<std::uint64_t> expiries(count);
+      std::generate(expiries.begin(), expiries.end(), [&] { return expiry(random); });
+
+      std::vector<std::size_t> cancel_order;
+      for (std::size_t i = 0; i < count; i += 2) {
+         cancel_order.push_back(i);
+      }
+      std::shuffle(cancel_order.begin(), cancel_order.end(), random);
+
+      const auto wheel = one_shot_wheel(expiries, cancel_order);
+      const auto map = one_shot_map(expiries, cancel_order);
+      ok &= wheel.ok;
+      std::printf("%10zu %8s %10.1f %10.1f %10.1f%s\n", count, "wheel", wheel.insert, wheel.cancel, wheel.fire,
+                  wheel.ok ? "" : "  FAILED");
+      std::printf("%10zu %8s %10.1f %10.1f %10.1f\n", count, "multimap", map.insert, map.cancel, map.fire);
+   }
+
+   std::printf("\nperiodic timers (100 ms - 10 s) over %llu ticks (ns per fired timer)\n",
+               static_cast<unsigned long long>(duration));
+   std::printf("%10s %12s %10s %10s\n", "timers", "fired", "wheel", "multimap");
+   for (auto count : counts) {
+      std::uniform_int_distribution<std::uint64_t> period{100, 10000};
+      std::vector<std::uint64_t> periods(count);
+      std::generate(periods.begin(), periods.end(), [&] { return period(random); });
+
+      std::size_t wheel_fired = 0, map_fired = 0;
+      bool wheel_ok = true;
+      const auto wheel = periodic_wheel(periods, duration, wheel_fired, wheel_ok);
+      const auto map = periodic_map(periods, duration, map_fired);
+      wheel_ok &= wheel_fired == map_fired;
+      ok &= wheel_ok;
+      std::printf("%10zu %12zu %10.1f %10.1f%s\n", count, wheel_fired, wheel, map, wheel_ok ? "" : "  FAILED");
+   }
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
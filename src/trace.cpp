@@ -0,0 +1,311 @@
+/**
+ * @file   trace.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 13, 2021
+ */
+
+#include <ir/trace.h>
+
+#include <array>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Flight recorder
+////////////////////////////////////////////////////////////////////////////////
+constexpr std::size_t ring_size = 4096;
+
+/**
+ * Each slot is guarded by a sequence number (seqlock): odd while the slot is being written, even once the event is
+ * complete. Readers skip the slots that are being written or got overwritten while being read.
+ */
+struct alignas(64) slot {
+   std::atomic<std::uint64_t> seq{0};
+   std::atomic<const char *> name{nullptr};
+   std::atomic<std::uint64_t> begin_ns{0};
+   std::atomic<std::uint64_t> duration_ns{0};
+   std::atomic<std::uint64_t> arg{0};
+   std::atomic<std::uint32_t> tid{0};
+};
+
+struct event {
+   const char *name;
+   std::uint64_t begin_ns;
+   std::uint64_t duration_ns;
+   std::uint64_t arg;
+   std::uint32_t tid;
+};
+
+// Static storage: no allocations, and the crash handler can read it at any time
+std::array<slot, ring_size> ring{};
+std::atomic<std::uint64_t> next_index{0};
+
+std::uint32_t this_thread_id() {
+   static thread_local const auto tid = static_cast<std::uint32_t>(::syscall(SYS_gettid));
+   return tid;
+}
+
+std::uint64_t to_ns(trace::clock_t::duration d) {
+   return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+bool read_slot(std::uint64_t index, event &e) {
+   const auto &s = ring[index % ring_size];
+
+   const auto seq = s.seq.load(std::memory_order_acquire);
+   if (seq != 2 * index + 2) {
+      // Being written, never written or overwritten already
+      return false;
+   }
+
+   e.name = s.name.load(std::memory_order_relaxed);
+   e.begin_ns = s.begin_ns.load(std::memory_order_relaxed);
+   e.duration_ns = s.duration_ns.load(std::memory_order_relaxed);
+   e.arg = s.arg.load(std::memory_order_relaxed);
+   e.tid = s.tid.load(std::memory_order_relaxed);
+
+   std::atomic_thread_fence(std::memory_order_acquire);
+   return s.seq.load(std::memory_order_relaxed) == seq && e.name;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Chrome trace JSON
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Writes the recorded events into the sink, only using async-signal-safe operations.
+ * Sink has to provide a put(const char *, std::size_t) member.
+ */
+template <class Sink>
+class json_writer {
+public:
+   explicit json_writer(Sink &sink)
+      : sink_{&sink} {}
+
+public:
+   void write() {
+      const auto pid = static_cast<std::uint64_t>(::getpid());
+      const auto last = next_index.load(std::memory_order_acquire);
+      const auto first = last > ring_size ? last - ring_size : 0;
+
+      put("{\"traceEvents\":[");
+
+      bool first_event = true;
+      event e{};
+      for (auto i = first; i < last; ++i) {
+         if (!read_slot(i, e)) {
+            continue;
+         }
+
+         put(first_event ? "\n" : ",\n");
+         first_event = false;
+
+         put("{\"name\":\"");
+         put(e.name);
+         put("\",\"ph\":\"X\",\"pid\":");
+         put_integer(pid);
+         put(",\"tid\":");
+         put_integer(e.tid);
+         put(",\"ts\":");
+         put_microseconds(e.begin_ns);
+         put(",\"dur\":");
+         put_microseconds(e.duration_ns);
+         put(",\"args\":{\"arg\":");
+         put_integer(e.arg);
+         put("}}");
+      }
+
+      put("\n],\"displayTimeUnit\":\"ms\"}\n");
+   }
+
+private:
+   void put(const char *text) { sink_->put(text, std::strlen(text)); }
+
+   void put_integer(std::uint64_t value) {
+      char buffer[24];
+      auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+      sink_->put(buffer, static_cast<std::size_t>(ptr - buffer));
+   }
+
+   //! Chrome expects microseconds, keep the nanosecond precision as a fraction
+   void put_microseconds(std::uint64_t ns) {
+      put_integer(ns / 1000);
+
+      const auto fraction = ns % 1000;
+      char buffer[4] = {'.', static_cast<char>('0' + fraction / 100), static_cast<char>('0' + fraction / 10 % 10),
+                        static_cast<char>('0' + fraction % 10)};
+      sink_->put(buffer, sizeof(buffer));
+   }
+
+private:
+   Sink *sink_;
+};
+
+struct string_sink {
+   std::string *out;
+
+   void put(const char *data, std::size_t size) { out->append(data, size); }
+};
+
+//! Buffered file descriptor output for the signal handler
+struct fd_sink {
+   int fd;
+   std::array<char, 4096> buffer{};
+   std::size_t used{0};
+
+   void put(const char *data, std::size_t size) {
+      while (size) {
+         if (used == buffer.size()) {
+            flush();
+         }
+
+         const auto chunk = std::min(size, buffer.size() - used);
+         std::memcpy(buffer.data() + used, data, chunk);
+         used += chunk;
+         data += chunk;
+         size -= chunk;
+      }
+   }
+
+   void flush() {
+      std::size_t offset = 0;
+      while (offset < used) {
+         const auto res = ::write(fd, buffer.data() + offset, used - offset);
+         if (res <= 0) {
+            break;
+         }
+         offset += static_cast<std::size_t>(res);
+      }
+      used = 0;
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Crash handler
+////////////////////////////////////////////////////////////////////////////////
+constexpr std::array fatal_signals{SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+char crash_file[256] = {};
+
+//! Handlers installed before ours (pigpio's stop the DMA and release the pins), indexed like fatal_signals
+std::array<struct sigaction, fatal_signals.size()> previous_actions{};
+
+//! Only the first crashing thread writes the dump
+std::atomic_flag dumping = ATOMIC_FLAG_INIT;
+
+//! The handler has to work even if the crash was caused by a stack overflow
+constexpr std::size_t signal_stack_size = 64 * 1024;
+
+struct signal_stack {
+   std::unique_ptr<char[]> memory;
+
+   ~signal_stack() {
+      if (memory) {
+         stack_t disable{};
+         disable.ss_flags = SS_DISABLE;
+         ::sigaltstack(&disable, nullptr);
+      }
+   }
+};
+
+thread_local signal_stack thread_signal_stack;
+
+void write_crash_file() {
+   // Never follow a link planted in place of the file: replace whatever is there, and create the file exclusively
+   ::unlink(crash_file);
+   const int fd = ::open(crash_file, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+   if (fd >= 0) {
+      fd_sink sink{fd};
+      json_writer<fd_sink>{sink}.write();
+      sink.flush();
+      ::close(fd);
+   }
+}
+
+void on_fatal_signal(int signal, siginfo_t *info, void *context) {
+   if (!dumping.test_and_set()) {
+      write_crash_file();
+   }
+
+   std::size_t index = 0;
+   while (index < fatal_signals.size() && fatal_signals[index] != signal) {
+      ++index;
+   }
+
+   // Hand the signal over to the previous handler. The default disposition takes effect once this handler returns:
+   // the re-raised signal is blocked until then, and a fault re-executes the faulting instruction.
+   const auto &previous = previous_actions[index];
+   ::sigaction(signal, &previous, nullptr);
+   if (previous.sa_flags & SA_SIGINFO) {
+      previous.sa_sigaction(signal, info, context);
+   } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+      previous.sa_handler(signal);
+   } else {
+      ::raise(signal);
+   }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Functions
+////////////////////////////////////////////////////////////////////////////////
+void trace::record(const char *name, clock_t::time_point begin, clock_t::time_point end, std::uint64_t arg) {
+   const auto index = next_index.fetch_add(1, std::memory_order_relaxed);
+   auto &s = ring[index % ring_size];
+
+   s.seq.store(2 * index + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+
+   s.name.store(name, std::memory_order_relaxed);
+   s.begin_ns.store(to_ns(begin.time_since_epoch()), std::memory_order_relaxed);
+   s.duration_ns.store(to_ns(end - begin), std::memory_order_relaxed);
+   s.arg.store(arg, std::memory_order_relaxed);
+   s.tid.store(this_thread_id(), std::memory_order_relaxed);
+
+   s.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+void trace::write_chrome_trace(std::string &out) {
+   string_sink sink{&out};
+   json_writer<string_sink>{sink}.write();
+}
+
+void trace::install_crash_handler(const std::string &path) {
+   const auto size = std::min(path.size(), sizeof(crash_file) - 1);
+   std::memcpy(crash_file, path.data(), size);
+   crash_file[size] = '\0';
+
+   install_signal_stack();
+
+   struct sigaction action {};
+   action.sa_sigaction = on_fatal_signal;
+   action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+   sigemptyset(&action.sa_mask);
+
+   for (std::size_t i = 0; i < fatal_signals.size(); ++i) {
+      ::sigaction(fatal_signals[i], &action, &previous_actions[i]);
+   }
+}
+
+void trace::install_signal_stack() {
+   auto &stack = thread_signal_stack;
+   if (stack.memory) {
+      return;
+   }
+
+   stack.memory = std::make_unique<char[]>(signal_stack_size);
+   stack_t alt{};
+   alt.ss_sp = stack.memory.get();
+   alt.ss_size = signal_stack_size;
+   ::sigaltstack(&alt, nullptr);
+}
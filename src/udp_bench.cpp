@@ -0,0 +1,216 @@
+/**
+ * @file   udp_bench.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 21, 2021
+ *
+ * Benchmark client of the UDP command listener: the ack round trip of one command at a time, and the throughput with
+ * a window of commands in flight. Every command asks for an ack and has its own sequence number, so none of them is
+ * dropped as a duplicate.
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+namespace {
+
+using clock_t = std::chrono::steady_clock;
+
+constexpr std::size_t num_statuses = 6;
+constexpr std::array<const char *, num_statuses> status_names{"ok",        "failed",  "invalid",
+                                                              "duplicate", "expired", "rate_limited"};
+
+struct ack {
+   std::uint8_t status;
+   std::uint32_t sequence;
+};
+
+std::array<std::uint8_t, 12> make_command(std::uint32_t code, std::uint32_t sequence) {
+   std::array<std::uint8_t, 12> d{};
+   d[0] = 1; // Ack requested, NECx, no repeats
+   for (unsigned i = 0; i < 4; ++i) {
+      d[4 + i] = static_cast<std::uint8_t>(code >> (8 * i));
+      d[8 + i] = static_cast<std::uint8_t>(sequence >> (8 * i));
+   }
+   return d;
+}
+
+//! @return False on a timeout
+bool receive_ack(int fd, int timeout_ms, ack &a) {
+   pollfd p{fd, POLLIN, 0};
+   if (::poll(&p, 1, timeout_ms) <= 0) {
+      return false;
+   }
+
+   std::array<std::uint8_t, 64> d{};
+   if (::recv(fd, d.data(), d.size(), 0) < 8) {
+      return false;
+   }
+   a.status = d[0];
+   a.sequence = static_cast<std::uint32_t>(d[4] | (d[5] << 8) | (d[6] << 16) | (d[7] << 24));
+   return true;
+}
+
+void count_status(std::array<std::uint64_t, num_statuses> &statuses, std::uint8_t status) {
+   ++statuses[std::min<std::size_t>(status, num_statuses - 1)];
+}
+
+void print_statuses(const std::array<std::uint64_t, num_statuses> &statuses) {
+   for (std::size_t i = 0; i < num_statuses; ++i) {
+      if (statuses[i]) {
+         std::printf(" %s=%llu", status_names[i], static_cast<unsigned long long>(statuses[i]));
+      }
+   }
+   std::printf("\n");
+}
+
+double percentile_us(const std::vector<clock_t::duration> &sorted, double p) {
+   const auto index = std::min(sorted.size() - 1, static_cast<std::size_t>(p * static_cast<double>(sorted.size())));
+   return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+bool run_latency(int fd, std::uint32_t code, std::size_t commands) {
+   std::vector<clock_t::duration> round_trips;
+   round_trips.reserve(commands);
+   std::array<std::uint64_t, num_statuses> statuses{};
+
+   for (std::uint32_t seq = 1; seq <= commands; ++seq) {
+      const auto d = make_command(code, seq);
+      const auto sent = clock_t::now();
+      ::send(fd, d.data(), d.size(), 0);
+
+      ack a{};
+      do {
+         if (!receive_ack(fd, 2000, a)) {
+            std::fprintf(stderr, "no ack for command %u\n", seq);
+            return false;
+         }
+      } while (a.sequence != seq);
+
+      round_trips.push_back(clock_t::now() - sent);
+      count_status(statuses, a.status);
+   }
+
+   std::sort(round_trips.begin(), round_trips.end());
+   std::printf("ack round trip, %zu commands: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", commands,
+               percentile_us(round_trips, 0.5), percentile_us(round_trips, 0.9), percentile_us(round_trips, 0.99),
+               std::chrono::duration<double, std::micro>(round_trips.back()).count());
+   std::printf("statuses:");
+   print_statuses(statuses);
+   return true;
+}
+
+bool run_throughput(int fd, std::uint32_t code, std::size_t window, std::chrono::seconds duration) {
+   std::array<std::uint64_t, num_statuses> statuses{};
+   std::uint32_t next = 1;
+   std::uint64_t in_flight = 0, acked = 0;
+
+   const auto started = clock_t::now();
+   const auto end = started + duration;
+   while (clock_t::now() < end || in_flight) {
+      while (in_flight < window && clock_t::now() < end) {
+         const auto d = make_command(code, next++);
+         ::send(fd, d.data(), d.size(), 0);
+         ++in_flight;
+      }
+
+      ack a{};
+      if (!receive_ack(fd, 2000, a)) {
+         std::fprintf(stderr, "%llu acks missing\n", static_cast<unsigned long long>(in_flight));
+         break;
+      }
+      --in_flight;
+      ++acked;
+      count_status(statuses, a.status);
+   }
+
+   const auto elapsed = std::chrono::duration<double>(clock_t::now() - started).count();
+   std::printf("window %zu: %u sent, %llu acked in %.2f s, %.0f commands/s\n", window, next - 1,
+               static_cast<unsigned long long>(acked), elapsed, static_cast<double>(acked) / elapsed);
+   std::printf("statuses:");
+   print_statuses(statuses);
+   return in_flight == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+   namespace po = boost::program_options;
+
+   po::options_description all("Benchmark the UDP command listener of ir-ctrl");
+   all.add_options()
+      ("help,h", "Show help")
+      ("host", po::value<std::string>()->default_value("127.0.0.1"), "Address of ir-ctrl")
+      ("port", po::value<std::uint16_t>()->default_value(18081), "UDP port of ir-ctrl (its --udp-port)")
+      ("code", po::value<std::uint32_t>()->default_value(0x81387), "NECx code to send")
+      ("commands", po::value<std::size_t>()->default_value(5000), "Number of commands of the round trip test (0 - skip)")
+      ("window", po::value<std::size_t>()->default_value(16), "Commands in flight in the throughput test, more than the --max-pending-per-client of ir-ctrl are rate limited (0 - skip)")
+      ("duration", po::value<unsigned>()->default_value(3), "Duration of the throughput test, s");
+
+   std::string host;
+   std::uint16_t port = 0;
+   std::uint32_t code = 0;
+   std::size_t commands = 0, window = 0;
+   unsigned duration = 0;
+   try {
+      po::variables_map vm;
+      po::store(po::parse_command_line(argc, argv, all), vm);
+
+      if (vm.count("help")) {
+         std::cout << all << "\n";
+         return EXIT_SUCCESS;
+      }
+
+      po::notify(vm);
+      host = vm["host"].as<std::string>();
+      port = vm["port"].as<std::uint16_t>();
+      code = vm["code"].as<std::uint32_t>();
+      commands = vm["commands"].as<std::size_t>();
+      window = vm["window"].as<std::size_t>();
+      duration = vm["duration"].as<unsigned>();
+   } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      std::cerr << all << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   sockaddr_in addr{};
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+      std::cerr << "Error: invalid address: " << host << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+   if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0) {
+      std::perror("Error connecting the socket");
+      return EXIT_FAILURE;
+   }
+
+   bool ok = true;
+   if (commands) {
+      ok &= run_latency(fd, code, commands);
+   }
+   if (ok && window) {
+      ok &= run_throughput(fd, code, window, std::chrono::seconds{duration});
+   }
+
+   ::close(fd);
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file   udp_listener.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 21, 2021
+ */
+
+#include <ir/log.h>
+#include <ir/server.h>
+#include <ir/udp_listener.h>
+
+using namespace ir;
+
+namespace {
+
+std::uint32_t read_u32(const unsigned char *data) {
+   return std::uint32_t{data[0]} | std::uint32_t{data[1]} << 8 | std::uint32_t{data[2]} << 16 |
+          std::uint32_t{data[3]} << 24;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: udp_listener
+////////////////////////////////////////////////////////////////////////////////
+udp_listener::udp_listener(server &server, boost::asio::io_context &io)
+   : server_{&server}
+   , socket_{io.get_executor()} {
+   // Nothing to do here
+}
+
+void udp_listener::listen(std::uint16_t port) {
+   socket_.open(udp::v4());
+   socket_.set_option(udp::socket::reuse_address(true));
+   socket_.bind({udp::v4(), port});
+
+   boost::asio::co_spawn(socket_.get_executor(), receive_loop(), boost::asio::detached);
+   log::info("udp.listen", {log::kv("port", std::uint32_t{port})});
+}
+
+void udp_listener::stop() {
+   boost::system::error_code ec;
+   socket_.close(ec);
+}
+
+boost::asio::awaitable<void> udp_listener::receive_loop() {
+   auto &stats = server_->stats();
+   udp::endpoint sender;
+   boost::system::error_code ec;
+
+   for (;;) {
+      const auto size = co_await socket_.async_receive_from(
+         boost::asio::buffer(buffer_), sender, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      if (ec == boost::asio::error::operation_aborted) {
+         co_return;
+      }
+
+      if (ec) {
+         log::warning("udp.receive_error", {log::text("error", ec.message())});
+         continue;
+      }
+
+      const auto received = std::chrono::steady_clock::now();
+      stats.udp_datagrams.add();
+
+      auto c = parse(buffer_.data(), size);
+      if (!c) {
+         stats.udp_invalid.add();
+         // Only reply if the sender asked for it, garbage is not worth a packet
+         if (size >= 1 && (buffer_[0] & 1U)) {
+            reply(sender, status::invalid, size >= 12 ? read_u32(buffer_.data() + 8) : 0);
+         }
+         continue;
+      }
+
+      if (c->sequence && is_duplicate(sender, *c->sequence, received)) {
+         stats.udp_duplicates.add();
+         if (c->ack) {
+            reply(sender, status::duplicate, *c->sequence);
+         }
+         continue;
+      }
+
+      const auto client = client_key::from(sender.address());
+      if (!server_->limits().acquire(client, 1U + c->repeat, received).admitted) {
+         stats.udp_rate_limited.add();
+         if (c->ack) {
+            reply(sender, status::rate_limited, c->sequence.value_or(0));
+         }
+         continue;
+      }
+      if (c->sequence) {
+         remember(sender, *c->sequence, received);
+      }
+
+      // The transmission is not awaited: the next datagram is read right away and queued behind this one
+      server_->async_send_necx_wave(
+         client, c->code, 1U + c->repeat, server::deadline_after(received, server_->get_options().udp_deadline),
+         [this, sender, client, c = *c, received](boost::system::error_code ec) {
+            auto &stats = server_->stats();
+            server_->limits().release(client);
+            auto result = ec ? status::failed : status::ok;
+            if (ec == boost::asio::error::timed_out) {
+               stats.udp_expired.add();
+               result = status::expired;
+            } else {
+               stats.udp_dispatch.record(std::chrono::steady_clock::now() - received);
+            }
+
+            if (c.ack) {
+               reply(sender, result, c.sequence.value_or(0));
+            }
+         });
+   }
+}
+
+std::optional<udp_listener::command> udp_listener::parse(const unsigned char *data, std::size_t size) {
+   if (size != 8 && size != 12) {
+      return std::nullopt;
+   }
+
+   command c{(data[0] & 1U) != 0, data[1], data[2], read_u32(data + 4), std::nullopt};
+   if (size == 12) {
+      c.sequence = read_u32(data + 8);
+   }
+
+   // Only NECx for now, the unused flag bits are reserved
+   if (c.protocol != 0 || c.repeat > max_repeat || (data[0] & ~1U)) {
+      return std::nullopt;
+   }
+   return c;
+}
+
+bool udp_listener::is_duplicate(const udp::endpoint &sender,
+                                std::uint32_t sequence,
+                                std::chrono::steady_clock::time_point now) const {
+   // The table is small enough for a linear scan
+   for (const auto &s : seen_) {
+      if (s.sequence == sequence && s.sender == sender && now - s.received < dedup_window) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void udp_listener::remember(const udp::endpoint &sender,
+                            std::uint32_t sequence,
+                            std::chrono::steady_clock::time_point now) {
+   // The oldest entry is overwritten
+   seen_[seen_next_] = seen{sender, sequence, now};
+   seen_next_ = (seen_next_ + 1) % dedup_size;
+}
+
+void udp_listener::reply(const udp::endpoint &to, status s, std::uint32_t sequence) {
+   const std::array<unsigned char, 8> ack{static_cast<unsigned char>(s),
+                                          0,
+                                          0,
+                                          0,
+                                          static_cast<unsigned char>(sequence),
+                                          static_cast<unsigned char>(sequence >> 8),
+                                          static_cast<unsigned char>(sequence >> 16),
+                                          static_cast<unsigned char>(sequence >> 24)};
+
+   // A datagram socket never blocks for long, and a lost ack is handled by the sender retrying
+   boost::system::error_code ec;
+   socket_.send_to(boost::asio::buffer(ack), to, 0, ec);
+   if (ec) {
+      server_->stats().udp_ack_errors.add();
+   }
+}
@@ -0,0 +1,147 @@
+/**
+ * @file   uri.cpp
+ * @author Dennis Sitelew
+ * @date   Nov. 27, 2021
+ */
+
+#include <ir/uri.h>
+
+#include <charconv>
+
+using namespace ir;
+
+namespace {
+
+int hex_value(char c) {
+   if (c >= '0' && c <= '9') {
+      return c - '0';
+   }
+   if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+   }
+   if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+   }
+   return -1;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: uri::query_iterator
+////////////////////////////////////////////////////////////////////////////////
+uri::query_iterator::query_iterator(std::string_view text)
+   : rest_{text}
+   , at_end_{false} {
+   advance();
+}
+
+uri::query_iterator &uri::query_iterator::operator++() {
+   advance();
+   return *this;
+}
+
+uri::query_iterator uri::query_iterator::operator++(int) {
+   auto copy = *this;
+   advance();
+   return copy;
+}
+
+/**
+ * Move to the next parameter with a non-empty name.
+ * Parameters without the '=' sign are reported with an empty value.
+ */
+void uri::query_iterator::advance() {
+   while (!rest_.empty()) {
+      auto end = rest_.find('&');
+      auto param = rest_.substr(0, end);
+      rest_.remove_prefix(end == std::string_view::npos ? rest_.size() : end + 1);
+
+      auto eq = param.find('=');
+      auto key = param.substr(0, eq);
+      if (key.empty()) {
+         // key is empty, ignore it
+         continue;
+      }
+
+      current_.key = key;
+      current_.value = (eq == std::string_view::npos) ? std::string_view{} : param.substr(eq + 1);
+      return;
+   }
+
+   rest_ = {};
+   current_ = {};
+   at_end_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: uri
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Percent-decode a query parameter.
+ * @param text Encoded text.
+ * @param buffer Output buffer, only used if the text actually contains escaped symbols.
+ * @param size Output buffer size.
+ * @return View of the decoded text (either the text itself or a part of the buffer).
+ */
+result_t<std::string_view> uri::decode(std::string_view text, char *buffer, std::size_t size) {
+   if (text.find_first_of("%+") == std::string_view::npos) {
+      return text;
+   }
+
+   std::size_t out = 0;
+   for (std::size_t i = 0; i < text.size(); ++i) {
+      if (out == size) {
+         return std::errc::value_too_large;
+      }
+
+      char c = text[i];
+      if (c == '+') {
+         c = ' ';
+      } else if (c == '%') {
+         if (i + 2 >= text.size()) {
+            return std::errc::invalid_argument;
+         }
+         const int hi = hex_value(text[i + 1]);
+         const int lo = hex_value(text[i + 2]);
+         if (hi < 0 || lo < 0) {
+            return std::errc::invalid_argument;
+         }
+         c = static_cast<char>((hi << 4) | lo);
+         i += 2;
+      }
+      buffer[out++] = c;
+   }
+
+   return std::string_view{buffer, out};
+}
+
+/**
+ * Parse an IR code, either in decimal or in the 0x-prefixed hexadecimal form.
+ * @param text Code text (already decoded).
+ * @return Parsed code.
+ */
+result_t<std::uint32_t> uri::parse_code(std::string_view text) {
+   int base = 10;
+   if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+      base = 16;
+      text.remove_prefix(2);
+   }
+
+   if (text.empty()) {
+      return std::errc::invalid_argument;
+   }
+
+   std::uint32_t code = 0;
+   const auto end = text.data() + text.size();
+   auto [ptr, ec] = std::from_chars(text.data(), end, code, base);
+   if (ec != std::errc{}) {
+      return std::make_error_code(ec);
+   }
+
+   if (ptr != end) {
+      return std::errc::invalid_argument;
+   }
+
+   return code;
+}
@@ -4,6 +4,7 @@
  * @date   Nov. 09, 2021
  */
 
+#include <ir/trace.h>
 #include <ir/wave.h>
 
 #include <stdexcept>
@@ -53,32 +54,111 @@ wave::wave(int pin_number, wave_parameters parameters)
    static wave_setup setup_waves;
 }
 
-wave::~wave() = default;
+wave::~wave() {
+   release();
+}
+
+wave::key wave::make_key(std::string_view protocol, const wave_parameters &parameters, int pin, std::uint32_t code) {
+   // FNV-1a
+   auto hash = [](std::uint32_t h, const void *data, std::size_t size) {
+      auto bytes = static_cast<const unsigned char *>(data);
+      for (std::size_t i = 0; i < size; ++i) {
+         h = (h ^ bytes[i]) * 16777619U;
+      }
+      return h;
+   };
+   constexpr std::uint32_t basis = 2166136261U;
+
+   // Hash the fields one by one: the structures have padding
+   auto add = [&hash](std::uint32_t h, auto value) { return hash(h, &value, sizeof(value)); };
+   auto add_encoding = [&add](std::uint32_t h, const bit_encoding &e) {
+      h = add(h, e.burst_duration.count());
+      h = add(h, e.gap_duration.count());
+      return add(h, e.burst_first);
+   };
+
+   std::uint32_t p = basis;
+   p = add(p, parameters.frequency_hz);
+   p = add(p, parameters.duty_cycle);
+   p = add(p, parameters.leading_pulse.count());
+   p = add(p, parameters.leading_gap.count());
+   p = add_encoding(p, parameters.logical_one);
+   p = add_encoding(p, parameters.logical_zero);
+   p = add(p, parameters.trailing_pulse.value_or(duration_t{-1}).count());
+
+   return key{hash(basis, protocol.data(), protocol.size()), p, pin, code};
+}
+
+std::size_t wave::key_hash::operator()(const key &k) const noexcept {
+   std::uint64_t h = (std::uint64_t{k.protocol} << 32) ^ k.parameters;
+   h = h * 0x9E3779B97F4A7C15ULL ^ ((std::uint64_t{static_cast<std::uint32_t>(k.pin)} << 32) | k.code);
+   return static_cast<std::size_t>(h * 0x9E3779B97F4A7C15ULL);
+}
 
 /**
  * Construct a square wave on the carrier frequency with a leading pulse burst and gap and an optional trailing burst
  */
-void wave::build() {
-   if (wave_id_ != PI_NO_WAVEFORM_ID) {
-      throw std::runtime_error("Wave already constructed");
-   }
+void wave::encode() {
+   trace::span span{"wave.encode"};
 
-   // Construct the wave from its components
-   add_carrier_frequency(parameters_.leading_pulse);
-   add_gap(parameters_.leading_gap);
+   // Construct the wave from its components, waves without a leader (e.g. raw timings) only have the payload
+   if (parameters_.leading_pulse.count()) {
+      add_carrier_frequency(parameters_.leading_pulse);
+   }
+   if (parameters_.leading_gap.count()) {
+      add_gap(parameters_.leading_gap);
+   }
 
    add_payload();
 
    if (parameters_.trailing_pulse.has_value()) {
       add_carrier_frequency(parameters_.trailing_pulse.value());
    }
+}
+
+void wave::assign(std::span<const gpioPulse_t> pulses) {
+   wave_.assign(pulses.begin(), pulses.end());
+}
+
+bool wave::try_upload() {
+   if (uploaded()) {
+      return true;
+   }
 
    // Create a pigpio wave from the wave encoding
-   gpioWaveAddGeneric(wave_.size(), wave_.data());
-   wave_id_ = gpioWaveCreate();
-   if (wave_id_ < 0) {
+   trace::span create_span{"wave.create", wave_.size()};
+   gpioWaveAddNew();
+   if (gpioWaveAddGeneric(wave_.size(), wave_.data()) < 0) {
+      throw std::runtime_error("Wave is too long");
+   }
+
+   const int res = gpioWaveCreate();
+   if (res == PI_TOO_MANY_CBS || res == PI_TOO_MANY_OOL || res == PI_NO_WAVEFORM_ID_ERR) {
+      return false;
+   }
+   if (res < 0) {
       throw std::runtime_error("Wave creation failure");
    }
+
+   wave_id_ = res;
+   control_blocks_ = gpioWaveGetCbs();
+   return true;
+}
+
+std::size_t wave::min_control_blocks() const {
+   std::size_t blocks = 0;
+   for (const auto &p : wave_) {
+      blocks += std::size_t{p.gpioOn != 0} + std::size_t{p.gpioOff != 0} + std::size_t{p.usDelay != 0};
+   }
+   return blocks;
+}
+
+void wave::release() {
+   if (uploaded()) {
+      gpioWaveDelete(static_cast<unsigned>(wave_id_));
+      wave_id_ = PI_NO_WAVEFORM_ID;
+      control_blocks_ = 0;
+   }
 }
 
 /**
@@ -87,14 +167,33 @@ void wave::build() {
  * @note This operation is blocking and will return only when wave is sent.
  */
 void wave::send() {
+   trace::span span{"wave.send"};
+
+   if (!uploaded()) {
+      throw std::runtime_error("Wave is not uploaded");
+   }
+
    int res = gpioWaveTxSend(wave_id_, PI_WAVE_MODE_ONE_SHOT);
    if (res == PI_BAD_WAVE_ID || res == PI_BAD_WAVE_MODE) {
       throw std::runtime_error("Error sending the wave");
    }
 
+   trace::span wait_span{"wave.tx_busy"};
    while (gpioWaveTxBusy()) {
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
    }
+   ++sent_count_;
+}
+
+std::uint32_t wave::send_at(std::uint32_t start_tick) {
+   std::uint32_t now = gpioTick();
+   // The tick wraps around every ~72 minutes, the difference does not
+   while (static_cast<std::int32_t>(now - start_tick) < 0) {
+      now = gpioTick();
+   }
+
+   send();
+   return now;
 }
 
 /**
@@ -0,0 +1,343 @@
+/**
+ * @file   ws_session.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 20, 2021
+ */
+
+#include <ir/log.h>
+#include <ir/server.h>
+#include <ir/uri.h>
+#include <ir/ws_session.h>
+
+#include <charconv>
+#include <cstdio>
+#include <string_view>
+
+using namespace ir;
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+
+namespace {
+
+std::uint32_t read_u32(const unsigned char *data) {
+   return std::uint32_t{data[0]} | std::uint32_t{data[1]} << 8 | std::uint32_t{data[2]} << 16 |
+          std::uint32_t{data[3]} << 24;
+}
+
+void write_u32(char *data, std::uint32_t value) {
+   for (int i = 0; i < 4; ++i) {
+      data[i] = static_cast<char>(value >> (8 * i));
+   }
+}
+
+//! Split off the next space-separated word
+std::string_view next_word(std::string_view &text) {
+   while (!text.empty() && text.front() == ' ') {
+      text.remove_prefix(1);
+   }
+   const auto end = std::min(text.find(' '), text.size());
+   auto word = text.substr(0, end);
+   text.remove_prefix(end);
+   return word;
+}
+
+const char *status_name(std::uint8_t status) {
+   switch (status) {
+      case 0:
+         return "ok";
+      case 2:
+         return "expired";
+      case 3:
+         return "rate_limited";
+      default:
+         return "failed";
+   }
+}
+
+const char *event_name(std::uint8_t type) {
+   switch (type) {
+      case 1:
+         return "sent";
+      case 2:
+         return "released";
+      default:
+         return "error";
+   }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: ws_session
+////////////////////////////////////////////////////////////////////////////////
+ws_session::ws_session(server &server, stream_t &stream, const client_key &client)
+   : server_{&server}
+   , client_{client}
+   , ws_{stream}
+   , hold_timer_{stream.get_executor()}
+   , write_wakeup_{stream.get_executor()}
+   , tasks_done_{stream.get_executor()} {
+   // Nothing to do here
+}
+
+boost::asio::awaitable<void> ws_session::run(const request_t &request) {
+   using boost::asio::redirect_error;
+   auto token = with_handler_memory(read_memory_, boost::asio::use_awaitable);
+
+   // The HTTP deadlines do not apply anymore: an idle client is pinged, and dropped if it does not answer within
+   // the read timeout
+   auto timeout = websocket::stream_base::timeout::suggested(beast::role_type::server);
+   timeout.idle_timeout = server_->get_options().read_timeout;
+   timeout.keep_alive_pings = true;
+   ws_.next_layer().expires_never();
+   ws_.set_option(timeout);
+   ws_.read_message_max(max_frame_size);
+
+   beast::error_code ec;
+   co_await ws_.async_accept(request, redirect_error(boost::asio::use_awaitable, ec));
+   if (ec) {
+      co_return;
+   }
+
+   auto &stats = server_->stats();
+   stats.ws_sessions.add(1);
+   spawn(write_loop());
+
+   for (;;) {
+      buffer_.clear();
+      co_await ws_.async_read(buffer_, redirect_error(token, ec));
+      if (ec) {
+         break;
+      }
+
+      const auto received = std::chrono::steady_clock::now();
+      const bool binary = ws_.got_binary();
+      stats.ws_commands.add();
+
+      auto c = parse(binary);
+      if (!c) {
+         push_event(event_type::error, event_status::failed, command{operation::send, 0, 0, binary}, {});
+         continue;
+      }
+
+      switch (c->op) {
+         case operation::send:
+            // Commands are handled in order: the next one is only read once this one is sent
+            co_await send(*c, received);
+            break;
+
+         case operation::hold:
+            hold_ = *c;
+            holding_ = true;
+            if (!hold_running_) {
+               hold_running_ = true;
+               spawn(hold_loop());
+            }
+            break;
+
+         case operation::release:
+            if (holding_) {
+               holding_ = false;
+               hold_timer_.cancel();
+            } else {
+               push_event(event_type::released, event_status::ok, *c, {});
+            }
+            break;
+      }
+   }
+
+   // Wait for the hold and the writes to finish, the connection object is reused once the session ends
+   closing_ = true;
+   holding_ = false;
+   hold_timer_.cancel();
+   write_wakeup_.cancel();
+   while (tasks_) {
+      tasks_done_.expires_at(std::chrono::steady_clock::time_point::max());
+      co_await tasks_done_.async_wait(redirect_error(token, ec));
+   }
+
+   stats.ws_sessions.add(-1);
+}
+
+std::optional<ws_session::command> ws_session::parse(bool binary) const {
+   const auto data = buffer_.data();
+   const auto bytes = static_cast<const unsigned char *>(data.data());
+
+   if (binary) {
+      if (data.size() != 9 || bytes[0] < 1 || bytes[0] > 3) {
+         return std::nullopt;
+      }
+      return command{static_cast<operation>(bytes[0]), read_u32(bytes + 1), read_u32(bytes + 5), true};
+   }
+
+   std::string_view text{static_cast<const char *>(data.data()), data.size()};
+   const auto word = next_word(text);
+
+   command c{operation::send, 0, 0, false};
+   if (word == "hold") {
+      c.op = operation::hold;
+   } else if (word == "release") {
+      c.op = operation::release;
+   } else if (word != "send") {
+      return std::nullopt;
+   }
+
+   if (c.op != operation::release) {
+      auto code = uri::parse_code(next_word(text));
+      if (!code) {
+         return std::nullopt;
+      }
+      c.code = code.value();
+   }
+
+   if (const auto id = next_word(text); !id.empty()) {
+      auto [ptr, ec] = std::from_chars(id.data(), id.data() + id.size(), c.id);
+      if (ec != std::errc{} || ptr != id.data() + id.size()) {
+         return std::nullopt;
+      }
+   }
+
+   if (!next_word(text).empty()) {
+      return std::nullopt;
+   }
+   return c;
+}
+
+boost::asio::awaitable<void> ws_session::send(command c, std::chrono::steady_clock::time_point received) {
+   beast::error_code ec;
+   const auto started = std::chrono::steady_clock::now();
+   if (!server_->limits().acquire(client_, 1, started).admitted) {
+      server_->stats().ws_rate_limited.add();
+      push_event(event_type::sent, event_status::rate_limited, c, {});
+      co_return;
+   }
+
+   co_await server_->async_send_necx_wave(
+      client_, c.code, 1, server::deadline_after(received, server_->get_options().ws_deadline),
+      boost::asio::redirect_error(with_handler_memory(read_memory_, boost::asio::use_awaitable), ec));
+   server_->limits().release(client_);
+
+   const auto now = std::chrono::steady_clock::now();
+   push_event(event_type::sent, sent_status(ec), c,
+              std::chrono::duration_cast<std::chrono::microseconds>(now - started));
+   server_->stats().ws_command_duration.record(now - received);
+}
+
+boost::asio::awaitable<void> ws_session::hold_loop() {
+   const auto interval = server_->get_options().ws_hold_interval;
+   auto token = with_handler_memory(hold_memory_, boost::asio::use_awaitable);
+   beast::error_code ec;
+
+   while (holding_) {
+      const auto c = hold_;
+      const auto started = std::chrono::steady_clock::now();
+      if (server_->limits().acquire(client_, 1, started).admitted) {
+         co_await server_->async_send_necx_wave(client_, c.code, 1,
+                                                server::deadline_after(started, server_->get_options().ws_deadline),
+                                                boost::asio::redirect_error(token, ec));
+         server_->limits().release(client_);
+         push_event(event_type::sent, sent_status(ec), c,
+                    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started));
+      } else {
+         // The hold goes on, the next repeat may fit into the share again
+         server_->stats().ws_rate_limited.add();
+         push_event(event_type::sent, event_status::rate_limited, c, {});
+      }
+
+      if (!holding_) {
+         break;
+      }
+
+      hold_timer_.expires_after(interval);
+      co_await hold_timer_.async_wait(boost::asio::redirect_error(token, ec));
+   }
+
+   push_event(event_type::released, event_status::ok, hold_, {});
+   hold_running_ = false;
+}
+
+boost::asio::awaitable<void> ws_session::write_loop() {
+   auto token = with_handler_memory(write_memory_, boost::asio::use_awaitable);
+   beast::error_code ec;
+
+   while (!closing_) {
+      if (!events_count_) {
+         write_wakeup_.expires_at(std::chrono::steady_clock::time_point::max());
+         co_await write_wakeup_.async_wait(boost::asio::redirect_error(token, ec));
+         continue;
+      }
+
+      const auto &e = events_[events_head_];
+      ws_.binary(e.binary);
+      co_await ws_.async_write(boost::asio::buffer(e.data.data(), e.size), boost::asio::redirect_error(token, ec));
+      if (ec) {
+         // The read loop fails as well and ends the session, the events pushed until then are dropped
+         break;
+      }
+
+      events_head_ = (events_head_ + 1) % queue_size;
+      --events_count_;
+   }
+}
+
+ws_session::event_status ws_session::sent_status(boost::system::error_code ec) {
+   if (ec == boost::asio::error::timed_out) {
+      server_->stats().ws_expired.add();
+      return event_status::expired;
+   }
+   return ec ? event_status::failed : event_status::ok;
+}
+
+void ws_session::push_event(event_type type,
+                            event_status status,
+                            const command &c,
+                            std::chrono::microseconds duration) {
+   if (closing_) {
+      return;
+   }
+
+   if (events_count_ == queue_size) {
+      // The client is not reading, don't let it hold on to the transmitter's memory
+      server_->stats().ws_events_dropped.add();
+      return;
+   }
+
+   auto &e = events_[(events_head_ + events_count_) % queue_size];
+   ++events_count_;
+
+   const auto us = static_cast<std::uint32_t>(duration.count());
+   e.binary = c.binary;
+   if (c.binary) {
+      e.data[0] = static_cast<char>(type);
+      e.data[1] = static_cast<char>(status);
+      write_u32(&e.data[2], c.id);
+      write_u32(&e.data[6], c.code);
+      write_u32(&e.data[10], us);
+      e.size = 14;
+   } else {
+      const int size = std::snprintf(e.data.data(), e.data.size(),
+                                     R"({"event":"%s","id":%u,"code":%u,"status":"%s","duration_us":%u})",
+                                     event_name(static_cast<std::uint8_t>(type)), c.id, c.code,
+                                     status_name(static_cast<std::uint8_t>(status)), us);
+      e.size = static_cast<std::size_t>(std::max(0, std::min(size, static_cast<int>(e.data.size()) - 1)));
+   }
+
+   write_wakeup_.cancel();
+}
+
+void ws_session::spawn(boost::asio::awaitable<void> task) {
+   ++tasks_;
+   boost::asio::co_spawn(ws_.get_executor(), std::move(task), [this](std::exception_ptr e) {
+      if (e) {
+         try {
+            std::rethrow_exception(e);
+         } catch (const std::exception &ex) {
+            log::error("ws.task_error", {log::text("error", ex.what())});
+         }
+      }
+
+      --tasks_;
+      tasks_done_.cancel();
+   });
+}
@@ -0,0 +1,111 @@
+/**
+ * @file   fair_queue_test.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 26, 2021
+ *
+ * Weighted fair transmit queue, on a fake clock: the jobs advance it by their run time instead of transmitting.
+ */
+
+#define BOOST_TEST_MODULE fair_queue
+#include <boost/test/included/unit_test.hpp>
+
+#include <ir/fair_queue.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace ir;
+using namespace std::chrono_literals;
+
+namespace {
+
+fair_queue::clock_t::time_point fake_now{};
+
+fair_queue::clock_t::time_point fake_clock() {
+   return fake_now;
+}
+
+client_key client(std::uint8_t id) {
+   client_key key;
+   key.bytes[15] = id;
+   return key;
+}
+
+//! Queue with a log of what happened to its jobs, in order
+struct fixture {
+   fixture() { fake_now = fair_queue::clock_t::time_point{} + 1h; }
+
+   //! Queue a job that takes run_time to run
+   void push(const std::string &name,
+             std::uint8_t id,
+             fair_queue::clock_t::time_point deadline = fair_queue::no_deadline,
+             fair_queue::clock_t::duration run_time = 100ms) {
+      queue.push(client(id), 1, 1, deadline, [this, name, run_time](bool expired) {
+         if (expired) {
+            log.push_back(name + " expired");
+         } else {
+            log.push_back(name);
+            fake_now += run_time;
+         }
+      });
+   }
+
+   fair_queue queue{&fake_clock};
+   std::vector<std::string> log{};
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_CASE(job_past_its_deadline_is_expired_instead_of_run, fixture) {
+   push("a", 1, fake_now + 10ms);
+   push("b", 2);
+
+   // Both are done in one go: the expired job is answered before the next one runs
+   BOOST_TEST(!queue.run_next(fake_now + 20ms));
+
+   BOOST_TEST(log == (std::vector<std::string>{"a expired", "b"}), boost::test_tools::per_element());
+   BOOST_TEST(queue.size().jobs == 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(job_that_cannot_start_before_its_deadline_is_expired_right_away, fixture) {
+   // Teaches the queue that a transmission takes 100 ms
+   push("warm-up", 1);
+   BOOST_TEST(!queue.run_next(fake_now));
+
+   // "late" is not due yet, but has to wait for "first" to finish, which takes longer than that
+   const auto now = fake_now;
+   push("first", 1);
+   push("late", 2, now + 50ms);
+   push("in-time", 3, now + 500ms);
+
+   BOOST_TEST(queue.run_next(now));
+   BOOST_TEST(log == (std::vector<std::string>{"warm-up", "late expired", "first"}), boost::test_tools::per_element());
+   BOOST_TEST((fake_now == now + 100ms));
+
+   BOOST_TEST(!queue.run_next(fake_now));
+   BOOST_TEST(log.back() == "in-time");
+}
+
+BOOST_FIXTURE_TEST_CASE(job_is_not_expired_before_the_run_time_is_known, fixture) {
+   const auto now = fake_now;
+   push("first", 1);
+   push("second", 2, now + 50ms);
+
+   BOOST_TEST(queue.run_next(now));
+   BOOST_TEST(!queue.run_next(now + 40ms));
+   BOOST_TEST(log == (std::vector<std::string>{"first", "second"}), boost::test_tools::per_element());
+}
+
+BOOST_FIXTURE_TEST_CASE(flooding_client_only_delays_itself, fixture) {
+   for (int i = 0; i < 5; ++i) {
+      push("flood" + std::to_string(i), 1);
+   }
+   push("other", 2);
+
+   while (queue.run_next(fake_now)) {
+   }
+   BOOST_TEST(log.size() == 6U);
+   BOOST_TEST(log[1] == "other");
+}
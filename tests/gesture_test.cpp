@@ -0,0 +1,183 @@
+/**
+ * @file   gesture_test.cpp
+ * @author Dennis Sitelew
+ * @date   Nov. 08, 2021
+ *
+ * Gesture detection, driven by timestamped edges the way the pigpio alert thread reports them.
+ */
+
+#define BOOST_TEST_MODULE gesture
+#include <boost/test/included/unit_test.hpp>
+
+#include <ir/gesture.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace ir;
+
+namespace {
+
+using ms = std::chrono::milliseconds;
+
+constexpr std::uint32_t operator""_ms(unsigned long long v) {
+   return static_cast<std::uint32_t>(v * 1000);
+}
+
+/**
+ * Detector with a recorder of its gestures, advanced the way the button's deadline timer does it.
+ */
+struct fixture {
+   explicit fixture(gesture_detector::config cfg, std::uint32_t start = 0)
+      : detector{cfg, false, [this](gesture g) { gestures.push_back(g); }}
+      , now{start} {}
+
+   //! Let the time pass until the tick, waking the detector up at each of its deadlines on the way
+   void run_until(std::uint32_t tick) {
+      while (auto deadline = detector.deadline()) {
+         if (static_cast<std::int32_t>(*deadline - tick) > 0) {
+            break;
+         }
+         now = *deadline;
+         detector.advance(now);
+      }
+      now = tick;
+   }
+
+   bool edge(bool pressed, std::uint32_t delay) {
+      run_until(now + delay);
+      return detector.edge(pressed, now);
+   }
+
+   bool press(std::uint32_t delay = 0) { return edge(true, delay); }
+   bool release(std::uint32_t delay) { return edge(false, delay); }
+
+   gesture_detector detector;
+   std::uint32_t now;
+   std::vector<gesture> gestures;
+};
+
+gesture_detector::config all_gestures() {
+   gesture_detector::config cfg;
+   cfg.debounce_interval = ms{50};
+   cfg.double_press_window = ms{300};
+   cfg.long_press_duration = ms{800};
+   cfg.repeat_interval = ms{200};
+   return cfg;
+}
+
+using gestures_t = std::vector<gesture>;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(short_press_without_detection_is_reported_on_press) {
+   fixture f{gesture_detector::config{}};
+   BOOST_TEST(f.press(1000_ms));
+   BOOST_TEST((f.gestures == gestures_t{gesture::short_press}));
+   BOOST_TEST(!f.detector.deadline());
+
+   BOOST_TEST(f.release(100_ms));
+   BOOST_TEST(f.gestures.size() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE(short_press_after_double_press_window) {
+   fixture f{all_gestures()};
+   f.press(1000_ms);
+   f.release(100_ms);
+   BOOST_TEST(f.gestures.empty());
+
+   f.run_until(f.now + 299_ms);
+   BOOST_TEST(f.gestures.empty());
+   f.run_until(f.now + 1_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::short_press}));
+   BOOST_TEST(!f.detector.deadline());
+}
+
+BOOST_AUTO_TEST_CASE(double_press) {
+   fixture f{all_gestures()};
+   f.press(1000_ms);
+   f.release(100_ms);
+   f.press(150_ms);
+   f.release(100_ms);
+   f.run_until(f.now + 2000_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::double_press}));
+}
+
+BOOST_AUTO_TEST_CASE(long_press) {
+   auto cfg = all_gestures();
+   cfg.repeat_interval = ms{0};
+   fixture f{cfg};
+   f.press(1000_ms);
+   f.run_until(f.now + 799_ms);
+   BOOST_TEST(f.gestures.empty());
+   f.run_until(f.now + 1_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::long_press}));
+
+   // No repeats, and the release ends the hold without a short press
+   f.release(2000_ms);
+   f.run_until(f.now + 2000_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::long_press}));
+}
+
+BOOST_AUTO_TEST_CASE(hold_repeat) {
+   fixture f{all_gestures()};
+   f.press(1000_ms);
+
+   // Long press at 800 ms, repeats at 1000, 1200 and 1400 ms
+   f.release(1500_ms);
+   f.run_until(f.now + 2000_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::long_press, gesture::hold_repeat, gesture::hold_repeat,
+                                         gesture::hold_repeat}));
+}
+
+BOOST_AUTO_TEST_CASE(late_wakeup_does_not_burst_repeats) {
+   fixture f{all_gestures()};
+   f.press(1000_ms);
+   f.run_until(f.now + 800_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::long_press}));
+
+   // The event loop was stuck for a second: one repeat, the next one an interval later
+   f.now += 1000_ms;
+   f.detector.advance(f.now);
+   BOOST_TEST(f.gestures.size() == 2U);
+   BOOST_TEST(*f.detector.deadline() == f.now + 200_ms);
+}
+
+BOOST_AUTO_TEST_CASE(short_press_then_long_press) {
+   fixture f{all_gestures()};
+   f.press(1000_ms);
+   f.release(100_ms);
+   f.press(100_ms);
+
+   // The double press window ends first while the button is still down
+   f.run_until(f.now + 800_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::short_press, gesture::long_press}));
+}
+
+BOOST_AUTO_TEST_CASE(bounces_are_ignored) {
+   fixture f{all_gestures()};
+   BOOST_TEST(f.press(1000_ms));
+
+   // Contact bounce right after the press: edges within the debounce interval of the accepted one are dropped
+   BOOST_TEST(!f.release(2_ms));
+   BOOST_TEST(!f.press(3_ms));
+   BOOST_TEST(!f.release(10_ms));
+   BOOST_TEST(f.detector.pressed());
+
+   // Same level twice is not a change either
+   BOOST_TEST(!f.press(100_ms));
+
+   BOOST_TEST(f.release(100_ms));
+   BOOST_TEST(!f.press(49_ms));
+   f.run_until(f.now + 1000_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::short_press}));
+}
+
+BOOST_AUTO_TEST_CASE(tick_wrap_around) {
+   // The pigpio tick wraps around every ~72 minutes
+   fixture f{all_gestures(), 0xFFFFFFFFU - 500_ms};
+   f.press(0);
+   BOOST_TEST(!f.release(20_ms));
+   f.run_until(f.now + 1000_ms);
+   BOOST_TEST((f.gestures == gestures_t{gesture::long_press, gesture::hold_repeat}));
+}
@@ -0,0 +1,190 @@
+/**
+ * @file   shm_ring_test.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 23, 2021
+ *
+ * Shared-memory command ring, with the producers on their own mappings of the memfd the way the clients map it.
+ */
+
+#define BOOST_TEST_MODULE shm_ring
+#include <boost/test/included/unit_test.hpp>
+
+#include <ir/shm_ring.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace ir;
+
+namespace {
+
+shm_ring create(std::uint32_t capacity) {
+   auto ring = shm_ring::create(capacity);
+   BOOST_REQUIRE(ring);
+   return std::move(ring.value());
+}
+
+//! Producer side of the ring, as a client maps it
+shm_ring attach(const shm_ring &ring) {
+   auto producer = shm_ring::attach(::dup(ring.fd()));
+   BOOST_REQUIRE(producer);
+   return std::move(producer.value());
+}
+
+shm_command command(std::uint32_t code) {
+   return shm_command{0, code, 0, 0, 0};
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(commands_are_popped_in_order_until_the_ring_is_full) {
+   auto consumer = create(4);
+   auto producer = attach(consumer);
+
+   for (std::uint32_t i = 0; i < 4; ++i) {
+      BOOST_TEST(producer.try_push(command(i)).value() == i);
+   }
+   BOOST_TEST(!producer.try_push(command(4)));
+
+   shm_command c{};
+   BOOST_TEST(consumer.try_pop(c));
+   BOOST_TEST(c.code == 0U);
+   BOOST_TEST(!producer.done(0));
+   consumer.complete();
+   BOOST_TEST(producer.done(0));
+   BOOST_TEST(!producer.done(1));
+
+   // The popped slot is free for the next round
+   BOOST_TEST(producer.try_push(command(4)).value() == 4U);
+   for (std::uint32_t i = 1; i <= 4; ++i) {
+      BOOST_TEST(consumer.try_pop(c));
+      BOOST_TEST(c.code == i);
+      consumer.complete();
+   }
+   BOOST_TEST(!consumer.try_pop(c));
+   BOOST_TEST(producer.done(4));
+}
+
+BOOST_AUTO_TEST_CASE(consumer_skips_the_slot_of_a_dead_producer) {
+   auto consumer = create(4);
+   auto dead = attach(consumer);
+   auto producer = attach(consumer);
+
+   // Claimed, but never published
+   const auto ticket = dead.claim();
+   BOOST_TEST(ticket.value() == 0U);
+   BOOST_TEST(producer.try_push(command(1)).value() == 1U);
+
+   shm_command c{};
+   BOOST_TEST(!consumer.try_pop(c));
+   BOOST_TEST(consumer.claimed());
+   BOOST_TEST(consumer.skip());
+   consumer.complete();
+   BOOST_TEST(producer.done(*ticket));
+
+   BOOST_TEST(!consumer.claimed());
+   BOOST_TEST(consumer.try_pop(c));
+   BOOST_TEST(c.code == 1U);
+   consumer.complete();
+
+   // Too late, the slot belongs to the next round
+   BOOST_TEST(!dead.publish(*ticket, command(0)));
+   BOOST_TEST(!consumer.try_pop(c));
+
+   // The skipped slot is in use again
+   for (std::uint32_t i = 2; i < 6; ++i) {
+      BOOST_TEST(producer.try_push(command(i)).value() == i);
+   }
+   for (std::uint32_t i = 2; i < 6; ++i) {
+      BOOST_TEST(consumer.try_pop(c));
+      BOOST_TEST(c.code == i);
+      consumer.complete();
+   }
+}
+
+BOOST_AUTO_TEST_CASE(published_slot_is_not_skipped) {
+   auto consumer = create(4);
+   auto producer = attach(consumer);
+
+   const auto ticket = producer.claim();
+   BOOST_TEST(consumer.claimed());
+   BOOST_TEST(producer.publish(ticket.value(), command(7)));
+
+   BOOST_TEST(!consumer.claimed());
+   BOOST_TEST(!consumer.skip());
+
+   shm_command c{};
+   BOOST_TEST(consumer.try_pop(c));
+   BOOST_TEST(c.code == 7U);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_producers_lose_nothing) {
+   constexpr std::uint32_t producers = 4;
+   constexpr std::uint32_t per_producer = 50000;
+   constexpr auto stall_timeout = std::chrono::milliseconds{100};
+
+   auto consumer = create(256);
+
+   // A producer that died right after its claim, ahead of all the others
+   auto dead = attach(consumer);
+   BOOST_REQUIRE(dead.claim());
+
+   std::vector<std::thread> threads;
+   std::array<std::uint32_t, producers> last_tickets{};
+   for (std::uint32_t p = 0; p < producers; ++p) {
+      threads.emplace_back([&, p, ring = attach(consumer)]() mutable {
+         for (std::uint32_t i = 0; i < per_producer;) {
+            if (auto ticket = ring.try_push(command((p << 24) | i))) {
+               last_tickets[p] = *ticket;
+               ++i;
+            } else {
+               std::this_thread::yield();
+            }
+         }
+      });
+   }
+
+   // Every producer's commands arrive complete and in order
+   std::array<std::uint32_t, producers> next{};
+   std::uint32_t popped = 0, skipped = 0, misplaced = 0;
+   std::chrono::steady_clock::time_point claimed_since{};
+   bool claimed = false;
+   shm_command c{};
+   while (popped < producers * per_producer) {
+      if (consumer.try_pop(c)) {
+         const auto p = c.code >> 24;
+         misplaced += p >= producers || (c.code & 0xFFFFFF) != next[p]++;
+         ++popped;
+         consumer.complete();
+         claimed = false;
+      } else if (consumer.claimed()) {
+         const auto now = std::chrono::steady_clock::now();
+         if (!claimed) {
+            claimed = true;
+            claimed_since = now;
+         } else if (now - claimed_since >= stall_timeout && consumer.skip()) {
+            ++skipped;
+            consumer.complete();
+            claimed = false;
+         }
+      } else {
+         std::this_thread::yield();
+      }
+   }
+
+   for (auto &t : threads) {
+      t.join();
+   }
+
+   BOOST_TEST(misplaced == 0U);
+   BOOST_TEST(skipped >= 1U);
+   for (std::uint32_t p = 0; p < producers; ++p) {
+      BOOST_TEST(next[p] == per_producer);
+      BOOST_TEST(consumer.done(last_tickets[p]));
+   }
+}
@@ -0,0 +1,109 @@
+/**
+ * @file   spsc_ring_test.cpp
+ * @author Dennis Sitelew
+ * @date   Dec. 04, 2021
+ *
+ * Single-producer/single-consumer edge ring, with the producer on its own thread the way the pigpio alert thread is.
+ */
+
+#define BOOST_TEST_MODULE spsc_ring
+#include <boost/test/included/unit_test.hpp>
+
+#include <ir/spsc_ring.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace ir;
+
+namespace {
+
+//! Two halves that have to match, a torn copy shows as a mismatch
+struct element {
+   std::uint32_t value;
+   std::uint32_t check;
+};
+
+element make(std::uint32_t value) {
+   return element{value, ~value};
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(elements_are_popped_in_order_and_dropped_when_full) {
+   spsc_ring<element, 4> ring;
+   BOOST_TEST(!ring.try_pop());
+
+   for (std::uint32_t i = 0; i < 4; ++i) {
+      BOOST_TEST(ring.try_push(make(i)));
+   }
+   BOOST_TEST(!ring.try_push(make(4)));
+
+   BOOST_TEST(ring.try_pop()->value == 0U);
+   BOOST_TEST(ring.try_push(make(5)));
+   BOOST_TEST(!ring.try_push(make(6)));
+
+   // The dropped elements leave no trace
+   for (std::uint32_t expected : {1U, 2U, 3U, 5U}) {
+      const auto e = ring.try_pop();
+      BOOST_REQUIRE(e);
+      BOOST_TEST(e->value == expected);
+   }
+   BOOST_TEST(!ring.try_pop());
+}
+
+BOOST_AUTO_TEST_CASE(indices_wrap_around) {
+   spsc_ring<element, 2> ring;
+   for (std::uint32_t i = 0; i < 1000; ++i) {
+      BOOST_TEST(ring.try_push(make(i)));
+      BOOST_TEST(ring.try_push(make(i + 1)));
+      BOOST_TEST(!ring.try_push(make(i + 2)));
+      BOOST_TEST(ring.try_pop()->value == i);
+      BOOST_TEST(ring.try_pop()->value == i + 1);
+      BOOST_TEST(!ring.try_pop());
+   }
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_producer_and_consumer_lose_nothing_they_accepted) {
+   constexpr std::uint32_t count = 1000000;
+
+   spsc_ring<element, 64> ring;
+   std::atomic<bool> done{false};
+
+   // The producer never waits, like the alert callback: whatever does not fit is dropped
+   std::vector<std::uint32_t> accepted;
+   accepted.reserve(count);
+   std::thread producer{[&] {
+      for (std::uint32_t i = 0; i < count; ++i) {
+         if (ring.try_push(make(i))) {
+            accepted.push_back(i);
+         }
+         if (i % 1024 == 0) {
+            std::this_thread::yield();
+         }
+      }
+      done.store(true, std::memory_order_release);
+   }};
+
+   std::vector<std::uint32_t> popped;
+   popped.reserve(count);
+   std::uint32_t torn = 0;
+   for (;;) {
+      const bool finished = done.load(std::memory_order_acquire);
+      while (auto e = ring.try_pop()) {
+         torn += e->check != ~e->value;
+         popped.push_back(e->value);
+      }
+      if (finished) {
+         break;
+      }
+   }
+   producer.join();
+
+   BOOST_TEST(torn == 0U);
+   BOOST_TEST(popped.size() == accepted.size());
+   BOOST_TEST(popped == accepted);
+   BOOST_TEST(!accepted.empty());
+}